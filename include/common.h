@@ -73,10 +73,10 @@ void *calloc_s(size_t nmemb, size_t size);
 	do { \
 		memset(config, 0, sizeof(*config)); \
 		pev_load_config(config); \
-		int ret = plugins_load_all(config); \
-		if (ret < 0) \
-			exit(EXIT_FAILURE); \
-		output_init(); /* Requires plugin for text output. */ \
+		plugins_set_directory((config)->plugins_path); \
+		output_init(); /* Plugins are loaded as formats are used. */ \
+		if ((config)->output_async) \
+			output_set_async(true); \
 	} while (0)
 
 #define PEV_FINALIZE(config) \
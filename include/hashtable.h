@@ -0,0 +1,67 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	hashtable.h - A string-keyed hash table with open addressing.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keys are NOT copied. They must outlive the table.
+typedef struct {
+	const char *key;
+	uint32_t hash;
+	void *value;
+} hashtable_entry_t;
+
+typedef struct {
+	size_t capacity;	// Always a power of 2.
+	size_t count;
+	hashtable_entry_t *entries;
+} hashtable_t;
+
+uint32_t hashtable_hash(const char *key);
+int hashtable_init(hashtable_t *table, size_t expected_count);
+void hashtable_destroy(hashtable_t *table);
+int hashtable_put(hashtable_t *table, const char *key, void *value);
+void *hashtable_get(const hashtable_t *table, const char *key);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -40,6 +40,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -59,6 +60,23 @@ typedef enum {
 	OUTPUT_SCOPE_TYPE_ARRAY		= 3
 } output_scope_type_e;
 
+// Compression of everything written, as a single stream.
+typedef enum {
+	OUTPUT_COMPRESSION_NONE	= 0,
+	OUTPUT_COMPRESSION_GZIP	= 1,
+	OUTPUT_COMPRESSION_ZSTD	= 2
+} output_compression_e;
+
+// Presentation of integers output through `output_int()`.
+typedef enum {
+	OUTPUT_INT_DECIMAL	= 0,	// 1234
+	OUTPUT_INT_HEX		= 1,	// 0x4d2, or 0 (same as printf's "%#x")
+	OUTPUT_INT_HEX_SIZE	= 2		// 0x4d2 (1234 bytes)
+} output_int_hint_e;
+
+// Large enough for any uint64_t in any presentation.
+#define OUTPUT_INT_BUFFER_SIZE 64
+
 typedef struct {
 	char *name;
 	output_scope_type_e type;
@@ -68,17 +86,48 @@ typedef struct {
 
 struct _format_t; // Forward declaration
 
+// Output state for producing documents: the format and its state, the open
+// scopes and the output buffer. The functions without a context work on a
+// default one, created by output_init(). A context must only be used by one
+// thread at a time, but different threads can each use their own.
+typedef struct _output_ctx output_ctx_t;
+
 typedef void (*output_fn)(
+	output_ctx_t *ctx,
 	const struct _format_t *format,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
 	const char *value);
 
+// Optional. Formats that don't provide it get the integer already
+// formatted through `output_fn`.
+typedef void (*output_int_fn)(
+	output_ctx_t *ctx,
+	const struct _format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint);
+
 typedef char * (*escape_fn)(
 	const struct _format_t *format,
 	const char *str);
 
+// Releases what a format allocated in its per-context state. The state
+// itself is freed by the context.
+typedef void (*state_free_fn)(void *state);
+
+// Optional. Receives what follows the colon in a format name given as
+// `name:option`, or "" if there is none, once `ctx` uses the format, so
+// options are kept in the context's format state. Returns 0 if `option` is
+// valid, or -1 otherwise.
+typedef int (*format_option_fn)(output_ctx_t *ctx, const struct _format_t *format, const char *option);
+
+// Optional. Called before a context stops using the format, for formats
+// that hold output back across documents, so they can write it out.
+typedef void (*format_finish_fn)(output_ctx_t *ctx, const struct _format_t *format);
+
 typedef char * const entity_t;
 typedef char ** const entity_table_t;
 
@@ -88,16 +137,29 @@ typedef struct _format_t {
 	const output_fn output_fn;
 	const escape_fn escape_fn;
 	const entity_table_t entities_table;
+	const output_int_fn output_int_fn;
+	// Optional. Size of the state each context keeps for this format, which
+	// plugins get through `output_ctx_format_state()`.
+	const size_t state_size;
+	const state_free_fn state_free;
+	const format_option_fn option_fn;
+	const format_finish_fn finish_fn;
 } format_t;
 
-void output_init(void); // IMPORTANT: Requires the text plugin to be already loaded.
+void output_init(void); // IMPORTANT: Requires the plugins directory to be already set.
 void output_term(void);
 const char *output_cmdline(void);
 void output_set_cmdline(int argc, char *argv[]);
 const format_t *output_format(void);
+// May load the plugin of the format. Plugins change tables that outputting
+// reads without locks, so formats must be parsed before other threads output.
 const format_t *output_parse_format(const char *format_name);
 void output_set_format(const format_t *format);
 int output_set_format_by_name(const char *format_name);
+// Like output_set_format_by_name(), but each call after the first adds
+// another format, the same output then going to all of them. `format_spec`
+// may be `name:file`, or end with `file=<path>`, to write a format to a file.
+int output_add_format_by_name(const char *format_spec);
 size_t output_available_formats(char *buffer, size_t size, char separator);
 void output_open_document(void);
 void output_open_document_with_name(const char *document_name);
@@ -106,6 +168,64 @@ void output_open_scope(const char *scope_name, output_scope_type_e type);
 void output_close_scope(void);
 void output(const char *key, const char *value);
 void output_keyval(const char *key, const char *value);
+void output_int(const char *key, uint64_t value, output_int_hint_e hint);
+size_t output_format_int(char *buffer, size_t size, uint64_t value, output_int_hint_e hint);
+// Keys output over and over, like those of each exported function, can be
+// interned once and the result used instead: formats then don't escape them
+// every time. It stays valid until output_term().
+const char *output_intern_key(const char *key);
+// Restricts the output to a comma-separated list of keys. A listed scope
+// keeps everything inside it. Returns -1 if the list names no key.
+int output_set_fields(const char *fields);
+// Whether an attribute named `key`, output where the document is now,
+// would be kept. Tools check it before computing what is costly to get.
+bool output_wants(const char *key);
+
+void output_flush(void);
+void output_set_fd(int fd);
+int output_set_async(bool async);
+int output_set_compression(output_compression_e compression);
+// "gzip", "zstd" or "none". Returns -1 if unknown, or not supported by this build.
+int output_set_compression_by_name(const char *name);
+
+output_ctx_t *output_ctx_new(const format_t *format); // NULL means the text format.
+void output_ctx_free(output_ctx_t *ctx);
+output_ctx_t *output_default_ctx(void);
+const format_t *output_ctx_format(const output_ctx_t *ctx);
+void output_ctx_set_format(output_ctx_t *ctx, const format_t *format);
+void *output_ctx_format_state(output_ctx_t *ctx);
+void output_ctx_open_document(output_ctx_t *ctx);
+void output_ctx_open_document_with_name(output_ctx_t *ctx, const char *document_name);
+void output_ctx_close_document(output_ctx_t *ctx);
+void output_ctx_open_scope(output_ctx_t *ctx, const char *scope_name, output_scope_type_e type);
+void output_ctx_close_scope(output_ctx_t *ctx);
+void output_ctx_keyval(output_ctx_t *ctx, const char *key, const char *value);
+void output_ctx_int(output_ctx_t *ctx, const char *key, uint64_t value, output_int_hint_e hint);
+bool output_ctx_wants(const output_ctx_t *ctx, const char *key);
+
+// Buffered writer used by the format plugins. Output goes to standard output
+// unless output_ctx_set_fd() says otherwise, and is only guaranteed to have
+// been written after output_ctx_flush(), output_ctx_close_document() or
+// output_ctx_free(). Tools that print something themselves while a document
+// is open must call output_flush() first.
+void output_ctx_set_fd(output_ctx_t *ctx, int fd);
+// Whether a thread of the context writes the output while it's being
+// produced. Flushing waits until it's all written, so nothing else changes.
+// Returns -1 if the thread can't be started; the output is then written as
+// usual.
+int output_ctx_set_async(output_ctx_t *ctx, bool async);
+// Compresses what is written from now on, ending the previous compressed
+// stream if any. The stream also ends when the file descriptor changes and
+// when the context is freed. Returns -1 if this build doesn't support
+// `compression`.
+int output_ctx_set_compression(output_ctx_t *ctx, output_compression_e compression);
+void output_ctx_write(output_ctx_t *ctx, const char *data, size_t length);
+void output_ctx_write_str(output_ctx_t *ctx, const char *str);
+// Writes each string up to the terminating NULL.
+void output_ctx_write_strs(output_ctx_t *ctx, const char *str, ...) __attribute__((sentinel));
+void output_ctx_write_spaces(output_ctx_t *ctx, size_t count);
+void output_ctx_writef(output_ctx_t *ctx, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void output_ctx_flush(output_ctx_t *ctx);
 
 #ifdef __cplusplus
 } //extern "C"
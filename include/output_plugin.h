@@ -38,6 +38,7 @@
 
 #include "plugin.h"
 #include "output.h"
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,6 +60,45 @@ extern "C" {
 #define INDENT_ARGS_(level)		INDENT_COLUMNS_(level), ""
 #define INDENT(level, format)	INDENT_FORMAT_ format, INDENT_ARGS_(level)
 
+//
+// Growable buffer that plugins reuse across calls, so that escaping
+// doesn't allocate once it has grown to fit the longest string.
+//
+
+typedef struct {
+	char *data;
+	size_t length;
+	size_t capacity;
+} output_buffer_t;
+
+void output_buffer_append(output_buffer_t *buffer, const char *str, size_t length);
+// Appends `str` escaped with `entities`. Runs of characters that need no
+// escaping are copied with a single memcpy().
+void output_buffer_append_escaped(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+void output_buffer_free(output_buffer_t *buffer);
+
+// Return `str` escaped with `entities`, NUL-terminated. The result is
+// `str` itself when nothing needs escaping, and lives in `buffer` (whose
+// contents are replaced) otherwise, so it's valid until `buffer` is reused.
+const char *escape_into(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+// Same, but always enclosing the result with quotes.
+const char *escape_into_quoted(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+// Like escape_into() for keys: those interned with output_intern_key() were
+// escaped in advance, and come back as they are.
+const char *escape_key_into(output_buffer_t *buffer, const char *key, const entity_table_t entities);
+
+bool escape_needed_ex(const char *str, const entity_table_t entities);
+char *escape_ex(const char *str, const entity_table_t entities);
+
+// Prepare the vectorized search used by the functions above for `entities`.
+// Called when a format is registered; tables that can't use it (or when
+// there's no SIMD support) are escaped one character at a time.
+int escape_scanner_register(const entity_table_t entities);
+void escape_scanner_unregister(const entity_table_t entities);
+
+// Writes the indentation for `level`, like INDENT() does for printf().
+void output_ctx_write_indent(output_ctx_t *ctx, int level);
+
 //
 // Public API specific for output plugins.
 //
@@ -72,6 +112,22 @@ typedef struct _output_plugin_api {
 	char * (* escape_ex_quoted)(const char *str, const entity_table_t entities);
 	char * (* escape)(const format_t *format, const char *str);
 	char * (* escape_quoted)(const format_t *format, const char *str);
+	bool (* escape_needed_ex)(const char *str, const entity_table_t entities);
+	size_t (* format_int)(char *buffer, size_t size, uint64_t value, output_int_hint_e hint);
+	void (* buffer_append)(output_buffer_t *buffer, const char *str, size_t length);
+	void (* buffer_append_escaped)(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+	void (* buffer_free)(output_buffer_t *buffer);
+	const char * (* escape_into)(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+	const char * (* escape_into_quoted)(output_buffer_t *buffer, const char *str, const entity_table_t entities);
+	void (* write)(output_ctx_t *ctx, const char *data, size_t length);
+	void (* write_str)(output_ctx_t *ctx, const char *str);
+	void (* write_strs)(output_ctx_t *ctx, const char *str, ...) __attribute__((sentinel));
+	void (* write_spaces)(output_ctx_t *ctx, size_t count);
+	void (* write_indent)(output_ctx_t *ctx, int level);
+	void (* writef)(output_ctx_t *ctx, const char *format, ...) __attribute__((format(printf, 2, 3)));
+	void (* flush)(output_ctx_t *ctx);
+	void * (* format_state)(output_ctx_t *ctx);
+	const char * (* escape_key_into)(output_buffer_t *buffer, const char *key, const entity_table_t entities);
 } output_plugin_api_t;
 
 output_plugin_api_t *output_plugin_api_ptr(void);
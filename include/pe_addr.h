@@ -0,0 +1,105 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_addr.h - Sorted section tables for bulk RVA and file offset translation.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#pragma once
+
+#include <libpe/pe.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Translates RVAs to file offsets and back with a binary search over the
+// section table, sorted once, instead of a linear scan per address.
+// Results are the same as pe_rva2ofs() and pe_ofs2rva(), including for
+// overlapping sections, where the first one in the section table wins:
+// overlaps are resolved when the table is built, so the sorted ranges
+// never overlap.
+//
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;			// Exclusive.
+	uint64_t from_base;		// Translated as address - from_base + to_base.
+	uint64_t to_base;
+} pe_addr_range_t;
+
+typedef struct {
+	uint64_t image_base;
+	bool has_sections;
+	bool truncated;			// A NULL section header stopped the table, like it stops libpe.
+	bool single_section;	// libpe translates unmapped RVAs with the only section.
+	pe_addr_range_t first_section;
+	pe_addr_range_t *rva_ranges;
+	size_t rva_count;
+	pe_addr_range_t *ofs_ranges;
+	size_t ofs_count;
+} pe_addr_table_t;
+
+int pe_addr_table_init(pe_addr_table_t *table, pe_ctx_t *ctx);
+void pe_addr_table_destroy(pe_addr_table_t *table);
+
+uint64_t pe_addr_rva2ofs(const pe_addr_table_t *table, uint64_t rva);
+uint64_t pe_addr_ofs2rva(const pe_addr_table_t *table, uint64_t ofs);
+
+// Translates `value` into `result`. Returns false if `value` isn't a valid input.
+typedef bool (*pe_addr_translate_fn)(const pe_addr_table_t *table, uint64_t value, uint64_t *result);
+
+// Room given to a pe_addr_format_fn, terminating NUL included.
+#define PE_ADDR_FORMAT_SIZE 64
+
+// Writes `value` into `buffer`, which holds `size` bytes, and returns the
+// number of characters written, not counting the terminating NUL.
+typedef size_t (*pe_addr_format_fn)(char *buffer, size_t size, uint64_t value);
+
+// Reads one address per line from `in` and writes one translated address
+// per line to `out`, formatted by `format`, so output lines match input
+// lines. Addresses use strtoull()'s base 0 syntax. Blank lines are copied
+// as blank lines, and lines that don't hold a valid input are written as
+// "invalid" and counted in `invalid_count`. Buffers belong to the call, so
+// streams can be translated concurrently. Returns 0 on success or -1 on
+// I/O or memory allocation error.
+int pe_addr_translate_stream(const pe_addr_table_t *table, pe_addr_translate_fn translate, pe_addr_format_fn format, FILE *in, FILE *out, size_t *invalid_count);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,229 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_clr.h - Lazy decoder for .NET CLR (ECMA-335) metadata.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#pragma once
+
+#include <libpe/pe.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Nothing is decoded ahead of time beyond the headers: pe_clr_init()
+// reads the CLI header, the metadata root, the stream headers and the
+// row counts of the #~ stream, and computes the row layout of every
+// table. Rows are decoded only when asked for, straight from the mapping,
+// so dumping a single table touches only that table's rows.
+//
+
+// IMAGE_COR20_HEADER. Prefixed so it won't clash with libpe if it ever
+// grows its own definition.
+typedef struct {
+	uint32_t cb;
+	uint16_t MajorRuntimeVersion;
+	uint16_t MinorRuntimeVersion;
+	IMAGE_DATA_DIRECTORY MetaData;
+	uint32_t Flags;
+	uint32_t EntryPointToken;	// Or EntryPointRVA, if COMIMAGE_FLAGS_NATIVE_ENTRYPOINT.
+	IMAGE_DATA_DIRECTORY Resources;
+	IMAGE_DATA_DIRECTORY StrongNameSignature;
+	IMAGE_DATA_DIRECTORY CodeManagerTable;
+	IMAGE_DATA_DIRECTORY VTableFixups;
+	IMAGE_DATA_DIRECTORY ExportAddressTableJumps;
+	IMAGE_DATA_DIRECTORY ManagedNativeHeader;
+} PEV_IMAGE_COR20_HEADER;
+
+typedef enum {
+	PE_CLR_FLAGS_ILONLY				= 0x00000001,
+	PE_CLR_FLAGS_32BITREQUIRED		= 0x00000002,
+	PE_CLR_FLAGS_IL_LIBRARY			= 0x00000004,
+	PE_CLR_FLAGS_STRONGNAMESIGNED	= 0x00000008,
+	PE_CLR_FLAGS_NATIVE_ENTRYPOINT	= 0x00000010,
+	PE_CLR_FLAGS_TRACKDEBUGDATA		= 0x00010000,
+	PE_CLR_FLAGS_32BITPREFERRED		= 0x00020000
+} pe_clr_flags_e;
+
+// Metadata tables, ECMA-335 II.22.
+typedef enum {
+	PE_CLR_TABLE_MODULE					= 0x00,
+	PE_CLR_TABLE_TYPEREF				= 0x01,
+	PE_CLR_TABLE_TYPEDEF				= 0x02,
+	PE_CLR_TABLE_FIELDPTR				= 0x03,
+	PE_CLR_TABLE_FIELD					= 0x04,
+	PE_CLR_TABLE_METHODPTR				= 0x05,
+	PE_CLR_TABLE_METHODDEF				= 0x06,
+	PE_CLR_TABLE_PARAMPTR				= 0x07,
+	PE_CLR_TABLE_PARAM					= 0x08,
+	PE_CLR_TABLE_INTERFACEIMPL			= 0x09,
+	PE_CLR_TABLE_MEMBERREF				= 0x0a,
+	PE_CLR_TABLE_CONSTANT				= 0x0b,
+	PE_CLR_TABLE_CUSTOMATTRIBUTE		= 0x0c,
+	PE_CLR_TABLE_FIELDMARSHAL			= 0x0d,
+	PE_CLR_TABLE_DECLSECURITY			= 0x0e,
+	PE_CLR_TABLE_CLASSLAYOUT			= 0x0f,
+	PE_CLR_TABLE_FIELDLAYOUT			= 0x10,
+	PE_CLR_TABLE_STANDALONESIG			= 0x11,
+	PE_CLR_TABLE_EVENTMAP				= 0x12,
+	PE_CLR_TABLE_EVENTPTR				= 0x13,
+	PE_CLR_TABLE_EVENT					= 0x14,
+	PE_CLR_TABLE_PROPERTYMAP			= 0x15,
+	PE_CLR_TABLE_PROPERTYPTR			= 0x16,
+	PE_CLR_TABLE_PROPERTY				= 0x17,
+	PE_CLR_TABLE_METHODSEMANTICS		= 0x18,
+	PE_CLR_TABLE_METHODIMPL				= 0x19,
+	PE_CLR_TABLE_MODULEREF				= 0x1a,
+	PE_CLR_TABLE_TYPESPEC				= 0x1b,
+	PE_CLR_TABLE_IMPLMAP				= 0x1c,
+	PE_CLR_TABLE_FIELDRVA				= 0x1d,
+	PE_CLR_TABLE_ENCLOG					= 0x1e,
+	PE_CLR_TABLE_ENCMAP					= 0x1f,
+	PE_CLR_TABLE_ASSEMBLY				= 0x20,
+	PE_CLR_TABLE_ASSEMBLYPROCESSOR		= 0x21,
+	PE_CLR_TABLE_ASSEMBLYOS				= 0x22,
+	PE_CLR_TABLE_ASSEMBLYREF			= 0x23,
+	PE_CLR_TABLE_ASSEMBLYREFPROCESSOR	= 0x24,
+	PE_CLR_TABLE_ASSEMBLYREFOS			= 0x25,
+	PE_CLR_TABLE_FILE					= 0x26,
+	PE_CLR_TABLE_EXPORTEDTYPE			= 0x27,
+	PE_CLR_TABLE_MANIFESTRESOURCE		= 0x28,
+	PE_CLR_TABLE_NESTEDCLASS			= 0x29,
+	PE_CLR_TABLE_GENERICPARAM			= 0x2a,
+	PE_CLR_TABLE_METHODSPEC				= 0x2b,
+	PE_CLR_TABLE_GENERICPARAMCONSTRAINT	= 0x2c,
+	PE_CLR_KNOWN_TABLES					= 0x2d	// Number of tables with a known layout.
+} pe_clr_table_e;
+
+#define PE_CLR_MAX_TABLES	64
+#define PE_CLR_MAX_COLUMNS	9
+#define PE_CLR_MAX_STREAMS	16
+
+typedef struct {
+	const char *name;
+	uint32_t offset;		// Relative to the metadata root.
+	uint32_t size;
+	const uint8_t *data;
+} pe_clr_stream_t;
+
+typedef struct {
+	const char *name;		// NULL for tables with an unknown layout.
+	uint32_t rows;
+	uint32_t row_size;
+	uint8_t columns_count;
+	uint8_t column_offsets[PE_CLR_MAX_COLUMNS];
+	uint8_t column_sizes[PE_CLR_MAX_COLUMNS];
+	const uint8_t *data;	// NULL if the table is absent or doesn't fit in the stream.
+} pe_clr_table_t;
+
+typedef struct {
+	pe_ctx_t *ctx;
+	const PEV_IMAGE_COR20_HEADER *header;
+
+	// Metadata root
+	const uint8_t *metadata;
+	uint32_t metadata_size;
+	uint16_t major_version;
+	uint16_t minor_version;
+	const char *version;	// Not necessarily NUL-terminated.
+	uint32_t version_length;
+	uint16_t streams_count;	// As declared in the root; at most PE_CLR_MAX_STREAMS are kept.
+	pe_clr_stream_t streams[PE_CLR_MAX_STREAMS];
+
+	// Heaps
+	const pe_clr_stream_t *strings;
+	const pe_clr_stream_t *user_strings;
+	const pe_clr_stream_t *guids;
+	const pe_clr_stream_t *blobs;
+
+	// Table stream (#~, or the uncompressed #-)
+	const pe_clr_stream_t *tables_stream;
+	uint8_t tables_major_version;
+	uint8_t tables_minor_version;
+	uint8_t heap_sizes;
+	uint64_t valid;
+	uint64_t sorted;
+	pe_clr_table_t tables[PE_CLR_MAX_TABLES];
+} pe_clr_t;
+
+// Returns false if the image has no CLR header or its metadata root is
+// unreadable. A missing or truncated table stream isn't an error: the
+// tables are left empty.
+bool pe_clr_init(pe_clr_t *clr, pe_ctx_t *ctx);
+
+uint32_t pe_clr_rows(const pe_clr_t *clr, pe_clr_table_e table);
+// Returns the row `rid` (1-based, as in metadata tokens) of `table`, or NULL.
+const uint8_t *pe_clr_row(const pe_clr_t *clr, pe_clr_table_e table, uint32_t rid);
+// Returns the value of `column` in a row returned by pe_clr_row().
+uint32_t pe_clr_column(const pe_clr_t *clr, pe_clr_table_e table, const uint8_t *row, unsigned column);
+
+// Heap accessors. They return NULL if the index points outside the heap.
+const char *pe_clr_string(const pe_clr_t *clr, uint32_t index);
+const uint8_t *pe_clr_guid(const pe_clr_t *clr, uint32_t index);
+const uint8_t *pe_clr_blob(const pe_clr_t *clr, uint32_t index, uint32_t *size);
+
+//
+// Decoded rows of the tables readpe prints.
+//
+
+typedef struct {
+	uint16_t major_version;
+	uint16_t minor_version;
+	uint16_t build_number;
+	uint16_t revision_number;
+	uint32_t flags;
+	const char *name;
+	const char *culture;
+	const uint8_t *public_key;	// Public key, or its token for AssemblyRef rows with no PublicKey flag.
+	uint32_t public_key_size;
+} pe_clr_assembly_t;
+
+typedef struct {
+	uint32_t flags;
+	const char *name;
+	const char *namespace_;
+} pe_clr_type_t;
+
+bool pe_clr_assembly(const pe_clr_t *clr, pe_clr_assembly_t *assembly);
+bool pe_clr_assembly_ref(const pe_clr_t *clr, uint32_t rid, pe_clr_assembly_t *assembly);
+bool pe_clr_typedef(const pe_clr_t *clr, uint32_t rid, pe_clr_type_t *type);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
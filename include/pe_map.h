@@ -0,0 +1,109 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_map.h - Sorted interval index of the regions of a PE file.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#pragma once
+
+#include <libpe/pe.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Classifies file offsets. Regions are kept sorted by start offset, and
+// the sorted array is read as a balanced binary tree whose nodes also hold
+// the furthest end offset in their subtree, so finding every region that
+// contains an offset only visits the subtrees that may contain it.
+//
+// Regions come in two levels. Top-level regions (headers, sections,
+// certificate table, overlay) should tile the file: bytes none of them
+// cover are gaps. Nested regions (header structures, data directories)
+// live inside them. Overlaps are flagged between regions of the same
+// level only, since nesting across levels is expected.
+//
+
+typedef enum {
+	PE_MAP_REGION_HEADERS,
+	PE_MAP_REGION_SECTION,
+	PE_MAP_REGION_DIRECTORY,
+	PE_MAP_REGION_CERTIFICATE,
+	PE_MAP_REGION_OVERLAY,
+	PE_MAP_REGION_OTHER
+} pe_map_region_kind_e;
+
+#define PE_MAP_LEVEL_TOP	0
+#define PE_MAP_LEVEL_NESTED	1
+
+#define PE_MAP_MAX_NAME		48
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;			// Exclusive.
+	pe_map_region_kind_e kind;
+	uint8_t level;
+	bool overlaps;			// Set by pe_map_index().
+	uint32_t index;			// Section or directory index, when applicable.
+	char name[PE_MAP_MAX_NAME];
+} pe_map_region_t;
+
+typedef struct {
+	uint64_t file_size;
+	size_t count;
+	size_t capacity;
+	pe_map_region_t *regions;
+	uint64_t *max_end;		// Furthest end in the subtree of regions[i].
+} pe_map_t;
+
+// Adds every region libpe knows about and indexes them.
+int pe_map_build(pe_map_t *map, pe_ctx_t *ctx);
+void pe_map_destroy(pe_map_t *map);
+
+// Other tools can add their own regions; pe_map_index() must be called
+// again before the next lookup. Empty regions are ignored.
+int pe_map_add(pe_map_t *map, pe_map_region_kind_e kind, uint8_t level, uint64_t start, uint64_t end, uint32_t index, const char *name);
+int pe_map_index(pe_map_t *map);
+
+// Stores up to `max_found` regions containing `offset`, outermost first,
+// and returns how many contain it.
+size_t pe_map_find(const pe_map_t *map, uint64_t offset, const pe_map_region_t **found, size_t max_found);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
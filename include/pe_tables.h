@@ -0,0 +1,163 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_tables.h - Streaming iterators over the PE import, export and relocation tables.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+#pragma once
+
+#include <libpe/pe.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// The iterators below decode the tables directly from the file mapping.
+// No name is ever copied: every `const char *` they hand out points into
+// the mapping and stays valid until the file is unloaded.
+//
+
+#define PE_TABLES_MAX_DLL_NAME		256
+#define PE_TABLES_MAX_FUNCTION_NAME	512
+
+// Returns a pointer to `size` readable bytes at `rva`, or NULL.
+const void *pe_tables_ptr_at_rva(pe_ctx_t *ctx, uint64_t rva, size_t size);
+// Returns the NUL-terminated string at `rva` if it fits in `max_len` bytes, or NULL.
+const char *pe_tables_string_at_rva(pe_ctx_t *ctx, uint64_t rva, size_t max_len);
+// Returns the data directory `entry` if the image has it and it's not empty, or NULL.
+const IMAGE_DATA_DIRECTORY *pe_tables_directory(pe_ctx_t *ctx, ImageDirectoryEntry entry);
+
+//
+// Imports
+//
+
+typedef struct {
+	uint16_t hint;
+	uint16_t ordinal;		// Non-zero only for functions imported by ordinal.
+	const char *name;		// NULL for functions imported by ordinal.
+} pe_import_entry_t;
+
+typedef struct {
+	pe_ctx_t *ctx;
+	bool is_64;
+	const IMAGE_IMPORT_DESCRIPTOR *descriptor;	// Next descriptor to visit.
+	const char *dll_name;						// Name of the current DLL.
+	const void *thunk;							// Next thunk of the current DLL.
+} pe_import_iter_t;
+
+bool pe_import_iter_init(pe_import_iter_t *iter, pe_ctx_t *ctx);
+bool pe_import_iter_next_dll(pe_import_iter_t *iter);
+bool pe_import_iter_next_function(pe_import_iter_t *iter, pe_import_entry_t *entry);
+
+//
+// Exports
+//
+
+// Number of functions whose names are resolved per pass over the name
+// ordinal table. Keeps the iterator at a fixed size regardless of how many
+// functions the DLL exports.
+#define PE_EXPORT_ITER_WINDOW 1024
+
+typedef struct {
+	uint32_t ordinal;
+	uint32_t address;
+	const char *name;		// NULL for functions exported by ordinal only.
+	const char *fwd_name;	// Non-NULL only for forwarded functions.
+} pe_export_entry_t;
+
+typedef struct {
+	pe_ctx_t *ctx;
+	const char *dll_name;
+	uint32_t base;
+	uint32_t dir_rva;
+	uint32_t dir_size;
+	uint32_t functions_count;
+	uint32_t names_count;
+	const uint32_t *functions;	// AddressOfFunctions
+	const uint32_t *names;		// AddressOfNames
+	const uint16_t *ordinals;	// AddressOfNameOrdinals
+	uint32_t index;				// Next function to visit.
+	uint32_t window_start;
+	uint32_t window[PE_EXPORT_ITER_WINDOW]; // Name index + 1 of each function in the window, 0 if unnamed.
+} pe_export_iter_t;
+
+bool pe_export_iter_init(pe_export_iter_t *iter, pe_ctx_t *ctx);
+bool pe_export_iter_next(pe_export_iter_t *iter, pe_export_entry_t *entry);
+
+// Point lookups over the tables of an initialized iterator. They don't
+// move the iterator. The name lookup is a binary search over the export
+// name pointer table, which the PE format requires to be sorted; the
+// Windows loader relies on the same order.
+bool pe_export_lookup_name(const pe_export_iter_t *iter, const char *name, pe_export_entry_t *entry);
+bool pe_export_lookup_ordinal(const pe_export_iter_t *iter, uint32_t ordinal, pe_export_entry_t *entry);
+
+//
+// Base relocations
+//
+
+// Entries aren't counted up front: a block's entries are only known once
+// pe_reloc_iter_next_entry() decoded them, as HIGHADJ ones take two slots.
+typedef struct {
+	uint32_t page_rva;
+	uint32_t size;			// SizeOfBlock, header included.
+} pe_reloc_block_t;
+
+typedef struct {
+	uint8_t type;			// IMAGE_REL_BASED_*
+	uint16_t offset;		// Offset within the page.
+	uint32_t rva;
+	uint16_t param;			// Extra slot of IMAGE_REL_BASED_HIGHADJ entries.
+} pe_reloc_entry_t;
+
+typedef struct {
+	pe_ctx_t *ctx;
+	const uint8_t *block;	// Next block to visit.
+	const uint8_t *end;		// End of the relocation directory.
+	const uint8_t *entry;	// Next entry of the current block.
+	const uint8_t *entries_end;
+	uint32_t page_rva;
+	bool malformed;			// Set when a block header is inconsistent; iteration stops there.
+} pe_reloc_iter_t;
+
+bool pe_reloc_iter_init(pe_reloc_iter_t *iter, pe_ctx_t *ctx);
+bool pe_reloc_iter_next_block(pe_reloc_iter_t *iter, pe_reloc_block_t *block);
+bool pe_reloc_iter_next_entry(pe_reloc_iter_t *iter, pe_reloc_entry_t *entry);
+const char *pe_reloc_type_name(uint8_t type);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
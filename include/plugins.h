@@ -45,6 +45,12 @@ extern "C" {
 int plugins_load(const char *path);
 int plugins_load_all(pev_config_t *config);
 int plugins_load_all_from_directory(const char *path);
+// Plugins can instead be loaded when first needed, from this directory.
+// The plugin for a format named `name` is the file `<name>_plugin.so`.
+void plugins_set_directory(const char *path);
+int plugins_load_by_name(const char *name);
+// Loads those of the directory that weren't loaded yet.
+int plugins_load_remaining(void);
 void plugins_unload_all(void);
 
 #ifdef __cplusplus
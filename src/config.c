@@ -65,6 +65,11 @@ static bool _load_config_cb(pev_config_t * const config, const char *name, const
 		return true;
 	}
 
+	if (!strcmp("output_async", name)) {
+		config->output_async = value != NULL && (!strcmp("yes", value) || !strcmp("true", value) || !strcmp("1", value));
+		return true;
+	}
+
 	return false;
 }
 
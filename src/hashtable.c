@@ -0,0 +1,138 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	hashtable.c - A string-keyed hash table with open addressing.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+#include "hashtable.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HASHTABLE_MIN_CAPACITY 16
+
+// 32-bit FNV-1a
+uint32_t hashtable_hash(const char *key) {
+	uint32_t hash = 2166136261u;
+	for (const unsigned char *p = (const unsigned char *)key; *p != '\0'; p++) {
+		hash ^= *p;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static size_t _capacity_for(size_t count) {
+	size_t capacity = HASHTABLE_MIN_CAPACITY;
+	// Keep the load factor at or below 50%.
+	while (capacity < count * 2)
+		capacity <<= 1;
+	return capacity;
+}
+
+static hashtable_entry_t *_find_slot(hashtable_entry_t *entries, size_t capacity, const char *key, uint32_t hash) {
+	const size_t mask = capacity - 1;
+	size_t i = hash & mask;
+
+	// Linear probing. There is always a free slot because of the load factor.
+	while (entries[i].key != NULL) {
+		if (entries[i].hash == hash && strcmp(entries[i].key, key) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	return &entries[i];
+}
+
+static int _grow(hashtable_t *table) {
+	const size_t new_capacity = table->capacity << 1;
+	hashtable_entry_t *new_entries = calloc(new_capacity, sizeof(*new_entries));
+	if (new_entries == NULL)
+		return -1;
+
+	for (size_t i = 0; i < table->capacity; i++) {
+		const hashtable_entry_t *entry = &table->entries[i];
+		if (entry->key == NULL)
+			continue;
+		*_find_slot(new_entries, new_capacity, entry->key, entry->hash) = *entry;
+	}
+
+	free(table->entries);
+	table->entries = new_entries;
+	table->capacity = new_capacity;
+
+	return 0;
+}
+
+int hashtable_init(hashtable_t *table, size_t expected_count) {
+	table->count = 0;
+	table->capacity = _capacity_for(expected_count);
+	table->entries = calloc(table->capacity, sizeof(*table->entries));
+	if (table->entries == NULL)
+		return -1;
+
+	return 0;
+}
+
+void hashtable_destroy(hashtable_t *table) {
+	free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+	table->count = 0;
+}
+
+// Inserts `key`, or replaces its value if it's already present.
+int hashtable_put(hashtable_t *table, const char *key, void *value) {
+	if ((table->count + 1) * 2 > table->capacity) {
+		if (_grow(table) < 0)
+			return -1;
+	}
+
+	const uint32_t hash = hashtable_hash(key);
+	hashtable_entry_t *entry = _find_slot(table->entries, table->capacity, key, hash);
+	if (entry->key == NULL) {
+		entry->key = key;
+		entry->hash = hash;
+		table->count++;
+	}
+	entry->value = value;
+
+	return 0;
+}
+
+void *hashtable_get(const hashtable_t *table, const char *key) {
+	if (table->capacity == 0)
+		return NULL;
+
+	const hashtable_entry_t *entry = _find_slot(table->entries, table->capacity, key, hashtable_hash(key));
+
+	return entry->key != NULL ? entry->value : NULL;
+}
@@ -37,33 +37,49 @@
 // FIX: Needed if strtoull() is used and to test overflow.
 #include <errno.h>
 #include "common.h"
+#include "pe_addr.h"
 
 #define PROGRAM "ofs2rva"
 
+typedef struct {
+	bool va;
+	const char *input;
+} options_t;
+
+static options_t g_options;
+
 static void usage(void)
 {
-	printf("Usage: %s <offset> FILE\n"
+	printf("Usage: %s [OPTIONS] <offset> FILE\n"
+		"       %s [OPTIONS] -i <list> FILE\n"
 		"Convert raw file offset to RVA\n"
 		"\nExample: %s 0x1b9b8 calc.exe\n"
 		"\nOptions:\n"
+		" -i, --input <list>					 Convert the offsets in <list>, one per line. Use - for stdin.\n"
+		"										 Output lines match input lines; invalid ones show as \"invalid\".\n"
+		" --va									 Show VAs instead of RVAs.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
-		PROGRAM, PROGRAM);
+		PROGRAM, PROGRAM, PROGRAM);
 }
 
 static void parse_options(int argc, char *argv[])
 {
 	/* Parameters for getopt_long() function */
-	static const char short_options[] = "V";
+	static const char short_options[] = "Vi:";
 
 	static const struct option long_options[] = {
-		{ "help",		no_argument,	NULL,  1  },
-		{ "version",	no_argument,	NULL, 'V' },
-		{  NULL,		0,				NULL,  0  }
+		{ "help",		no_argument,		NULL,  1  },
+		{ "input",		required_argument,	NULL, 'i' },
+		{ "va",			no_argument,		NULL,  2  },
+		{ "version",	no_argument,		NULL, 'V' },
+		{  NULL,		0,					NULL,  0  }
 	};
 
 	int c, ind;
 
+	memset(&g_options, 0, sizeof(g_options));
+
 	while ((c = getopt_long(argc, argv, short_options, long_options, &ind)))
 	{
 		if (c < 0)
@@ -74,6 +90,12 @@ static void parse_options(int argc, char *argv[])
 			case 1: // --help option
 				usage();
 				exit(EXIT_SUCCESS);
+			case 'i':
+				g_options.input = optarg;
+				break;
+			case 2: // --va option
+				g_options.va = true;
+				break;
 			case 'V':
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
@@ -84,32 +106,53 @@ static void parse_options(int argc, char *argv[])
 	}
 }
 
+static bool translate(const pe_addr_table_t *table, uint64_t ofs, uint64_t *rva)
+{
+	if (!ofs)
+		return false;
+
+	*rva = pe_addr_ofs2rva(table, ofs);
+
+	// Offsets outside of every section translate to 0, with or without --va.
+	if (g_options.va && *rva != 0)
+		*rva += table->image_base;
+
+	return true;
+}
+
+static size_t format_address(char *buffer, size_t size, uint64_t value)
+{
+	return output_format_int(buffer, size, value, OUTPUT_INT_HEX);
+}
+
 int main(int argc, char *argv[])
 {
 	//PEV_INITIALIZE();
 
-	if (argc != 3) {
+	parse_options(argc, argv);
+
+	if (argc - optind != (g_options.input != NULL ? 1 : 2)) {
 		usage();
 		return EXIT_FAILURE;
 	}
 
-	parse_options(argc, argv);
-
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, argv[2]);
+	pe_err_e err = pe_load_file(&ctx, argv[argc-1]);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
 	}
 
-	uint64_t ofs;
+	uint64_t ofs = 0;
 
-	// FIX: changed to strtoull().
-	errno = 0;
-	ofs = strtoull(argv[1], NULL, 0);
-	if ( !ofs || errno == ERANGE )
-		EXIT_ERROR("invalid offset");
+	if (g_options.input == NULL) {
+		// FIX: changed to strtoull().
+		errno = 0;
+		ofs = strtoull(argv[optind], NULL, 0);
+		if ( !ofs || errno == ERANGE )
+			EXIT_ERROR("invalid offset");
+	}
 
 	err = pe_parse(&ctx);
 	if (err != LIBPE_E_OK) {
@@ -120,12 +163,39 @@ int main(int argc, char *argv[])
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	printf("%#"PRIx64"\n", pe_ofs2rva(&ctx, ofs));
+	// The table is sorted once, so that streams of offsets don't scan the
+	// section table for each one.
+	pe_addr_table_t table;
+	if (pe_addr_table_init(&table, &ctx) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	int ret = EXIT_SUCCESS;
+
+	if (g_options.input != NULL) {
+		const bool use_stdin = strcmp(g_options.input, "-") == 0;
+		FILE *input = use_stdin ? stdin : fopen(g_options.input, "r");
+		if (input == NULL)
+			EXIT_ERROR("unable to open the input file");
+
+		size_t invalid_count;
+		if (pe_addr_translate_stream(&table, translate, format_address, input, stdout, &invalid_count) < 0)
+			EXIT_ERROR("unable to read the input file");
+		if (invalid_count > 0)
+			ret = EXIT_FAILURE;
+
+		if (!use_stdin)
+			fclose(input);
+	} else {
+		uint64_t rva = 0;
+		translate(&table, ofs, &rva);
+		printf("%#"PRIx64"\n", rva);
+	}
 
 	// libera a memoria
+	pe_addr_table_destroy(&table);
 	pe_unload(&ctx);
 
 	//PEV_FINALIZE();
 
-	return EXIT_SUCCESS;
+	return ret;
 }
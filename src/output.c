@@ -36,12 +36,28 @@
 
 #include "output.h"
 #include "output_plugin.h"
+#include "hashtable.h"
+#include "plugins.h"
 #include "stack.h"
 #include "compat/strlcat.h"
 #include "compat/sys/queue.h"
 #include <libpe/utils.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 //
 // Global variables
@@ -49,13 +65,914 @@
 
 #define FORMAT_ID_FOR_TEXT 3
 
-static bool g_is_document_open = false;
-static const format_t *g_format = NULL;
-static STACK_TYPE *g_scope_stack = NULL;
 static int g_argc = 0;
 static char **g_argv = NULL;
 static char *g_cmdline = NULL;
 
+//
+// Scope arena
+//
+// Scopes and their names are bump-allocated from chunks tied to the
+// document instead of a malloc() + strdup() per scope. Scopes are closed
+// in the reverse order they're opened, so closing one gives its memory
+// back to the arena, and the arena never holds more than the open scopes.
+// Chunks are kept until the context is freed and reused by the next document.
+//
+
+#define ARENA_CHUNK_SIZE	4096
+#define ARENA_ALIGNMENT		16
+
+typedef struct _arena_chunk {
+	struct _arena_chunk *next;
+	size_t capacity;
+	size_t used;
+	char *data;
+} arena_chunk_t;
+
+typedef struct {
+	arena_chunk_t *chunk;
+	size_t used;
+} arena_mark_t;
+
+typedef struct {
+	output_scope_t scope;	// Must be the first member, it's what gets pushed.
+	arena_mark_t mark;		// Arena position before this scope was allocated.
+} scope_entry_t;
+
+typedef struct {
+	arena_chunk_t *head;
+	arena_chunk_t *current;
+} arena_t;
+
+static arena_chunk_t *_arena_chunk_alloc(size_t capacity) {
+	// The chunk header is padded so that data starts aligned.
+	const size_t header_size = (sizeof(arena_chunk_t) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	arena_chunk_t *chunk = malloc(header_size + capacity);
+	if (chunk == NULL)
+		abort(); // Abort because it failed miserably!
+
+	chunk->next = NULL;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+	chunk->data = (char *)chunk + header_size;
+	return chunk;
+}
+
+static void *_arena_alloc(arena_t *arena, size_t size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+	arena_chunk_t *chunk = arena->current;
+	if (chunk->capacity - chunk->used < size) {
+		// Chunks after the current one are free; reuse the next one if it fits.
+		arena_chunk_t *next = chunk->next;
+		if (next == NULL || next->capacity < size) {
+			arena_chunk_t *fresh = _arena_chunk_alloc(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+			fresh->next = next;
+			chunk->next = fresh;
+			next = fresh;
+		}
+		next->used = 0;
+		chunk = arena->current = next;
+	}
+
+	void *ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+static arena_mark_t _arena_mark(arena_t *arena) {
+	const arena_mark_t mark = { .chunk = arena->current, .used = arena->current->used };
+	return mark;
+}
+
+// Frees everything allocated after `mark` was taken.
+static void _arena_release(arena_t *arena, arena_mark_t mark) {
+	arena->current = mark.chunk;
+	arena->current->used = mark.used;
+}
+
+static void _arena_reset(arena_t *arena) {
+	arena->current = arena->head;
+	arena->current->used = 0;
+}
+
+static void _arena_destroy(arena_t *arena) {
+	arena_chunk_t *chunk = arena->head;
+	while (chunk != NULL) {
+		arena_chunk_t *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = arena->current = NULL;
+}
+
+//
+// Writer
+//
+// Plugins append their output to a buffer owned by the output layer rather
+// than issuing a printf() per fragment. The buffer goes to the target file
+// descriptor with write()/writev() only when it's full, and at the explicit
+// flush points: closing a document, output_ctx_flush() and freeing the
+// context. With output_ctx_set_async(), a thread does the writing instead.
+//
+
+#define WRITER_BUFFER_SIZE	(64 * 1024)
+#define WRITER_RING_CHUNKS	16
+
+typedef struct _writer_ring writer_ring_t;
+typedef struct _compressor compressor_t;
+
+typedef struct {
+	int fd;
+	bool failed;			// Set on the first write error; later output is dropped.
+	size_t length;
+	char *data;				// What is being filled: `buffer`, or a chunk of the ring.
+	writer_ring_t *ring;	// Only when writing asynchronously.
+	compressor_t *compressor;
+	char buffer[WRITER_BUFFER_SIZE];
+} writer_t;
+
+// Write all of `iov`, resuming after partial writes.
+static int _writer_writev_all(int fd, struct iovec *iov, int iovcnt) {
+	while (iovcnt > 0) {
+		const ssize_t written = writev(fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		size_t remaining = (size_t)written;
+		while (iovcnt > 0 && remaining >= iov->iov_len) {
+			remaining -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + remaining;
+			iov->iov_len -= remaining;
+		}
+	}
+	return 0;
+}
+
+static void _writer_report_failure(bool *failed) {
+	fprintf(stderr, "output: write failed: %s\n", strerror(errno));
+	*failed = true;
+}
+
+//
+// Compression
+//
+// With output_ctx_set_compression(), what is written goes through a
+// streaming compressor instead, on whichever thread does the writing. The
+// stream is only ended when the compression or the file descriptor
+// changes, or when the context is freed, so it spans all documents. Flush
+// points don't flush the compressor.
+//
+
+struct _compressor {
+	output_compression_e type;
+	bool has_input;			// Whether anything was compressed since the stream began.
+#ifdef HAVE_ZLIB
+	z_stream zlib;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zstd;
+#endif
+	char out[WRITER_BUFFER_SIZE];
+};
+
+static compressor_t *_compressor_new(output_compression_e type) {
+	compressor_t * const compressor = calloc(1, sizeof *compressor);
+	if (compressor == NULL)
+		abort(); // Abort because it failed miserably!
+	compressor->type = type;
+
+	switch (type) {
+		default:
+			break;
+#ifdef HAVE_ZLIB
+		case OUTPUT_COMPRESSION_GZIP:
+			// 16 more window bits for a gzip header and trailer, as gzip(1) writes.
+			if (deflateInit2(&compressor->zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+				return compressor;
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case OUTPUT_COMPRESSION_ZSTD:
+			compressor->zstd = ZSTD_createCCtx();
+			if (compressor->zstd != NULL)
+				return compressor;
+			break;
+#endif
+	}
+
+	free(compressor);
+	return NULL;
+}
+
+static void _compressor_free(compressor_t *compressor) {
+	if (compressor == NULL)
+		return;
+#ifdef HAVE_ZLIB
+	if (compressor->type == OUTPUT_COMPRESSION_GZIP)
+		deflateEnd(&compressor->zlib);
+#endif
+#ifdef HAVE_ZSTD
+	if (compressor->type == OUTPUT_COMPRESSION_ZSTD)
+		ZSTD_freeCCtx(compressor->zstd);
+#endif
+	free(compressor);
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static void _compressor_send(int fd, bool *failed, const char *data, size_t length) {
+	struct iovec iov = { (void *)data, length };
+	if (length > 0 && !*failed && _writer_writev_all(fd, &iov, 1) < 0)
+		_writer_report_failure(failed);
+}
+#endif
+
+// Compresses `length` bytes of `data`, or ends the stream if `end`, writing
+// the compressed output to `fd` as it comes.
+static void _compressor_write(compressor_t *compressor, int fd, bool *failed, const char *data, size_t length, bool end) {
+	if (end && !compressor->has_input)
+		return; // Nothing at all, not even an empty stream.
+	compressor->has_input = !end;
+#if !defined(HAVE_ZLIB) && !defined(HAVE_ZSTD)
+	(void)fd;
+	(void)failed;
+	(void)data;
+	(void)length;
+#endif
+
+	switch (compressor->type) {
+		default:
+			break;
+#ifdef HAVE_ZLIB
+		case OUTPUT_COMPRESSION_GZIP:
+		{
+			z_stream * const zlib = &compressor->zlib;
+			zlib->next_in = (Bytef *)data;
+			zlib->avail_in = (uInt)length;
+			int ret;
+			do {
+				zlib->next_out = (Bytef *)compressor->out;
+				zlib->avail_out = sizeof(compressor->out);
+				ret = deflate(zlib, end ? Z_FINISH : Z_NO_FLUSH);
+				_compressor_send(fd, failed, compressor->out, sizeof(compressor->out) - zlib->avail_out);
+			} while (end ? ret == Z_OK : zlib->avail_out == 0);
+			if (end)
+				deflateReset(zlib);
+			break;
+		}
+#endif
+#ifdef HAVE_ZSTD
+		case OUTPUT_COMPRESSION_ZSTD:
+		{
+			ZSTD_inBuffer in = { data, length, 0 };
+			size_t remaining;
+			do {
+				ZSTD_outBuffer out = { compressor->out, sizeof(compressor->out), 0 };
+				remaining = ZSTD_compressStream2(compressor->zstd, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue);
+				if (ZSTD_isError(remaining)) {
+					fprintf(stderr, "output: compression failed: %s\n", ZSTD_getErrorName(remaining));
+					*failed = true;
+					return;
+				}
+				_compressor_send(fd, failed, compressor->out, out.pos);
+			} while (end ? remaining != 0 : in.pos < in.size);
+			break;
+		}
+#endif
+	}
+}
+
+// Sends `iov` to `fd`, through `compressor` if there is one, unless an
+// earlier write failed, and reports the first failure.
+static void _writer_send(int fd, bool *failed, compressor_t *compressor, struct iovec *iov, int iovcnt) {
+	if (*failed)
+		return;
+
+	if (compressor != NULL) {
+		for (int i = 0; i < iovcnt && !*failed; i++)
+			_compressor_write(compressor, fd, failed, iov[i].iov_base, iov[i].iov_len, false);
+		return;
+	}
+
+	// Whatever a tool printed through stdio must come first.
+	if (fd == STDOUT_FILENO)
+		fflush(stdout);
+
+	if (_writer_writev_all(fd, iov, iovcnt) < 0)
+		_writer_report_failure(failed);
+}
+
+//
+// Asynchronous writing
+//
+// When enabled, full buffers are queued in a ring of chunks instead of being
+// written, and a thread of the context writes them in order, so that slow
+// pipes and remote files don't hold back the analysis. Formatting still
+// happens as the tool calls output(), so the output is exactly the same.
+//
+// The tool's thread is the only one to advance `head` and the writer thread
+// the only one to advance `tail`, so neither takes a lock while there is
+// room, or something to write. Each side only sleeps on `cond` when it has to
+// wait for the other: the tool's thread when the ring is full (which is what
+// slows it down to the pace of the output) or at a flush point, and the
+// writer thread when there is nothing left to write.
+//
+
+#define ATOMIC_LOAD(ptr)		__atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(ptr, val)	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+
+struct _writer_ring {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int fd;						// These two are only changed while the ring is empty.
+	compressor_t *compressor;
+	bool failed;
+	bool stop;
+	bool producer_waiting;
+	bool writer_waiting;
+	size_t head;				// Chunks queued so far.
+	size_t tail;				// Chunks written so far.
+	size_t lengths[WRITER_RING_CHUNKS];
+	char chunks[WRITER_RING_CHUNKS][WRITER_BUFFER_SIZE];
+};
+
+static bool _ring_has_room(writer_ring_t *ring) {
+	return ATOMIC_LOAD(&ring->head) - ATOMIC_LOAD(&ring->tail) < WRITER_RING_CHUNKS;
+}
+
+static bool _ring_is_empty(writer_ring_t *ring) {
+	return ATOMIC_LOAD(&ring->head) == ATOMIC_LOAD(&ring->tail);
+}
+
+static bool _ring_has_work(writer_ring_t *ring) {
+	return !_ring_is_empty(ring) || ATOMIC_LOAD(&ring->stop);
+}
+
+// Sleeps until `ready` holds, after saying so in `waiting` so that the other
+// side knows to wake this one up.
+static void _ring_wait(writer_ring_t *ring, bool *waiting, bool (*ready)(writer_ring_t *)) {
+	pthread_mutex_lock(&ring->mutex);
+	ATOMIC_STORE(waiting, true);
+	while (!ready(ring))
+		pthread_cond_wait(&ring->cond, &ring->mutex);
+	ATOMIC_STORE(waiting, false);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+static void _ring_wake(writer_ring_t *ring, bool *waiting) {
+	if (!ATOMIC_LOAD(waiting))
+		return;
+	pthread_mutex_lock(&ring->mutex);
+	pthread_cond_broadcast(&ring->cond);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+static void *_ring_writer_thread(void *arg) {
+	writer_ring_t * const ring = arg;
+
+	for (;;) {
+		const size_t tail = ring->tail;
+		const size_t head = ATOMIC_LOAD(&ring->head);
+		if (head == tail) {
+			if (ATOMIC_LOAD(&ring->stop))
+				break;
+			_ring_wait(ring, &ring->writer_waiting, _ring_has_work);
+			continue;
+		}
+
+		// Everything queued so far goes in a single writev().
+		struct iovec iov[WRITER_RING_CHUNKS];
+		int iovcnt = 0;
+		for (size_t i = tail; i != head; i++) {
+			iov[iovcnt].iov_base = ring->chunks[i % WRITER_RING_CHUNKS];
+			iov[iovcnt].iov_len = ring->lengths[i % WRITER_RING_CHUNKS];
+			iovcnt++;
+		}
+		bool failed = ATOMIC_LOAD(&ring->failed);
+		_writer_send(ring->fd, &failed, ring->compressor, iov, iovcnt);
+		if (failed)
+			ATOMIC_STORE(&ring->failed, true);
+
+		ATOMIC_STORE(&ring->tail, head);
+		_ring_wake(ring, &ring->producer_waiting);
+	}
+
+	return NULL;
+}
+
+// Queues what was buffered and moves on to the next chunk, once the writer
+// thread is done with it.
+static void _ring_queue(writer_t *writer) {
+	writer_ring_t * const ring = writer->ring;
+
+	if (!ATOMIC_LOAD(&ring->failed)) {
+		const size_t head = ring->head;
+		ring->lengths[head % WRITER_RING_CHUNKS] = writer->length;
+		ATOMIC_STORE(&ring->head, head + 1);
+		_ring_wake(ring, &ring->writer_waiting);
+		if (!_ring_has_room(ring))
+			_ring_wait(ring, &ring->producer_waiting, _ring_has_room);
+	}
+
+	writer->data = ring->chunks[ring->head % WRITER_RING_CHUNKS];
+	writer->length = 0;
+}
+
+static void _ring_drain(writer_t *writer, const char *extra, size_t extra_length) {
+	if (writer->length > 0)
+		_ring_queue(writer);
+
+	while (extra_length > 0) {
+		const size_t length = extra_length < WRITER_BUFFER_SIZE ? extra_length : WRITER_BUFFER_SIZE;
+		memcpy(writer->data, extra, length);
+		writer->length = length;
+		_ring_queue(writer);
+		extra += length;
+		extra_length -= length;
+	}
+}
+
+// Send what is buffered followed by `extra`, in a single writev().
+static void _writer_drain(writer_t *writer, const char *extra, size_t extra_length) {
+	if (writer->length == 0 && extra_length == 0)
+		return;
+
+	if (writer->ring != NULL) {
+		_ring_drain(writer, extra, extra_length);
+		return;
+	}
+
+	struct iovec iov[2];
+	int iovcnt = 0;
+	if (writer->length > 0) {
+		iov[iovcnt].iov_base = writer->data;
+		iov[iovcnt].iov_len = writer->length;
+		iovcnt++;
+	}
+	if (extra_length > 0) {
+		iov[iovcnt].iov_base = (void *)extra;
+		iov[iovcnt].iov_len = extra_length;
+		iovcnt++;
+	}
+	writer->length = 0;
+
+	_writer_send(writer->fd, &writer->failed, writer->compressor, iov, iovcnt);
+}
+
+// Like _writer_drain(), but also waits for the writer thread to write
+// everything, if there is one.
+static void _writer_flush(writer_t *writer) {
+	_writer_drain(writer, NULL, 0);
+	if (writer->ring != NULL && !_ring_is_empty(writer->ring))
+		_ring_wait(writer->ring, &writer->ring->producer_waiting, _ring_is_empty);
+}
+
+static void _writer_write(writer_t *writer, const char *data, size_t length) {
+	if (length <= WRITER_BUFFER_SIZE - writer->length) {
+		memcpy(writer->data + writer->length, data, length);
+		writer->length += length;
+		return;
+	}
+	// Large chunks go straight out along with the buffer instead of being
+	// copied in pieces.
+	if (length >= WRITER_BUFFER_SIZE / 2) {
+		_writer_drain(writer, data, length);
+		return;
+	}
+	_writer_drain(writer, NULL, 0);
+	memcpy(writer->data, data, length);
+	writer->length = length;
+}
+
+static int _writer_start_thread(writer_t *writer) {
+	if (writer->ring != NULL)
+		return 0;
+
+	_writer_flush(writer);
+
+	writer_ring_t * const ring = calloc(1, sizeof *ring);
+	if (ring == NULL)
+		abort(); // Abort because it failed miserably!
+	ring->fd = writer->fd;
+	ring->compressor = writer->compressor;
+	ring->failed = writer->failed;
+	pthread_mutex_init(&ring->mutex, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+
+	if (pthread_create(&ring->thread, NULL, _ring_writer_thread, ring) != 0) {
+		pthread_cond_destroy(&ring->cond);
+		pthread_mutex_destroy(&ring->mutex);
+		free(ring);
+		return -1;
+	}
+
+	writer->ring = ring;
+	writer->data = ring->chunks[0];
+	writer->length = 0;
+	return 0;
+}
+
+static void _writer_stop_thread(writer_t *writer) {
+	writer_ring_t * const ring = writer->ring;
+	if (ring == NULL)
+		return;
+
+	_writer_flush(writer);
+	ATOMIC_STORE(&ring->stop, true);
+	_ring_wake(ring, &ring->writer_waiting);
+	pthread_join(ring->thread, NULL);
+
+	writer->failed = ring->failed;
+	pthread_cond_destroy(&ring->cond);
+	pthread_mutex_destroy(&ring->mutex);
+	free(ring);
+
+	writer->ring = NULL;
+	writer->data = writer->buffer;
+	writer->length = 0;
+}
+
+// Ends the compressed stream, if there is one, with what is buffered.
+static void _writer_end_stream(writer_t *writer) {
+	_writer_flush(writer);
+	if (writer->compressor == NULL)
+		return;
+
+	// The writer thread, if any, has nothing left to do, so the compressor
+	// can be used from here.
+	writer_ring_t * const ring = writer->ring;
+	bool failed = ring != NULL ? ATOMIC_LOAD(&ring->failed) : writer->failed;
+	_compressor_write(writer->compressor, writer->fd, &failed, NULL, 0, true);
+	if (ring != NULL)
+		ATOMIC_STORE(&ring->failed, failed);
+	else
+		writer->failed = failed;
+}
+
+//
+// Interned keys
+//
+// Tools intern the keys they output over and over, like those of each
+// exported function, with output_intern_key(). Their escaped forms are
+// computed once per format, when either the key or the format is registered,
+// and plugins get them from escape_key_into() instead of escaping the keys
+// every time.
+//
+// Interning takes a lock, but looking keys up by address doesn't: they are
+// neither moved nor removed until output_term(). Formats are registered
+// before the output starts, when plugins are loaded.
+//
+
+#define KEYS_CAPACITY	1024	// Power of 2. Only half of it is used, so that lookups stop.
+#define KEY_TABLES_MAX	16
+
+typedef struct {
+	char *name;
+	char *escaped[KEY_TABLES_MAX];	// By index in g_key_tables; NULL when `name` needs no escaping.
+} interned_key_t;
+
+static pthread_mutex_t g_keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+static hashtable_t g_keys_by_name;
+static interned_key_t *g_keys_by_address[KEYS_CAPACITY];
+static size_t g_keys_count = 0;
+static char **g_key_tables[KEY_TABLES_MAX];
+
+static size_t _key_slot(const char *key) {
+	return (size_t)(((uint64_t)(uintptr_t)key * UINT64_C(0x9e3779b97f4a7c15)) >> 54) & (KEYS_CAPACITY - 1);
+}
+
+static const interned_key_t *_lookup_interned_key(const char *key) {
+	if (key == NULL)
+		return NULL;
+
+	for (size_t i = _key_slot(key); ; i = (i + 1) & (KEYS_CAPACITY - 1)) {
+		const interned_key_t * const entry = ATOMIC_LOAD(&g_keys_by_address[i]);
+		if (entry == NULL)
+			return NULL;
+		if (entry->name == key)
+			return entry;
+	}
+}
+
+static int _lookup_key_table(const entity_table_t entities) {
+	for (int i = 0; i < KEY_TABLES_MAX; i++) {
+		if (g_key_tables[i] == entities)
+			return i;
+	}
+	return -1;
+}
+
+static void _escape_interned_key(interned_key_t *entry, int table) {
+	const entity_table_t entities = g_key_tables[table];
+	if (escape_needed_ex(entry->name, entities)) {
+		entry->escaped[table] = escape_ex(entry->name, entities);
+		if (entry->escaped[table] == NULL)
+			abort(); // Abort because it failed miserably!
+	}
+}
+
+static void _register_key_table(const entity_table_t entities) {
+	if (entities == NULL || _lookup_key_table(entities) >= 0)
+		return;
+
+	const int table = _lookup_key_table(NULL);
+	if (table < 0)
+		return; // Keys are escaped every time for this format.
+
+	pthread_mutex_lock(&g_keys_mutex);
+	g_key_tables[table] = entities;
+	for (size_t i = 0; i < KEYS_CAPACITY; i++) {
+		if (g_keys_by_address[i] != NULL)
+			_escape_interned_key(g_keys_by_address[i], table);
+	}
+	pthread_mutex_unlock(&g_keys_mutex);
+}
+
+static void _unregister_key_table(const entity_table_t entities) {
+	const int table = entities != NULL ? _lookup_key_table(entities) : -1;
+	if (table < 0)
+		return;
+
+	pthread_mutex_lock(&g_keys_mutex);
+	g_key_tables[table] = NULL;
+	for (size_t i = 0; i < KEYS_CAPACITY; i++) {
+		if (g_keys_by_address[i] == NULL)
+			continue;
+		free(g_keys_by_address[i]->escaped[table]);
+		g_keys_by_address[i]->escaped[table] = NULL;
+	}
+	pthread_mutex_unlock(&g_keys_mutex);
+}
+
+static void _free_interned_keys(void) {
+	pthread_mutex_lock(&g_keys_mutex);
+	for (size_t i = 0; i < KEYS_CAPACITY; i++) {
+		interned_key_t * const entry = g_keys_by_address[i];
+		if (entry == NULL)
+			continue;
+		for (int table = 0; table < KEY_TABLES_MAX; table++)
+			free(entry->escaped[table]);
+		free(entry->name);
+		free(entry);
+		g_keys_by_address[i] = NULL;
+	}
+	g_keys_count = 0;
+	hashtable_destroy(&g_keys_by_name);
+	memset(&g_keys_by_name, 0, sizeof(g_keys_by_name));
+	memset(g_key_tables, 0, sizeof(g_key_tables));
+	pthread_mutex_unlock(&g_keys_mutex);
+}
+
+const char *output_intern_key(const char *key) {
+	if (key == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&g_keys_mutex);
+
+	interned_key_t *entry = hashtable_get(&g_keys_by_name, key);
+	if (entry == NULL && g_keys_count < KEYS_CAPACITY / 2) {
+		if (g_keys_by_name.capacity == 0 && hashtable_init(&g_keys_by_name, KEYS_CAPACITY / 2) < 0)
+			abort(); // Abort because it failed miserably!
+
+		entry = calloc(1, sizeof *entry);
+		if (entry == NULL)
+			abort(); // Abort because it failed miserably!
+		entry->name = strdup(key);
+		if (entry->name == NULL)
+			abort(); // Abort because it failed miserably!
+		for (int table = 0; table < KEY_TABLES_MAX; table++) {
+			if (g_key_tables[table] != NULL)
+				_escape_interned_key(entry, table);
+		}
+		if (hashtable_put(&g_keys_by_name, entry->name, entry) < 0)
+			abort(); // Abort because it failed miserably!
+
+		size_t i = _key_slot(entry->name);
+		while (g_keys_by_address[i] != NULL)
+			i = (i + 1) & (KEYS_CAPACITY - 1);
+		ATOMIC_STORE(&g_keys_by_address[i], entry);
+		g_keys_count++;
+	}
+
+	pthread_mutex_unlock(&g_keys_mutex);
+
+	// Past the capacity, keys are just escaped every time.
+	return entry != NULL ? entry->name : key;
+}
+
+const char *escape_key_into(output_buffer_t *buffer, const char *key, const entity_table_t entities) {
+	const interned_key_t * const entry = _lookup_interned_key(key);
+	if (entry != NULL && entities != NULL) {
+		const int table = _lookup_key_table(entities);
+		if (table >= 0)
+			return entry->escaped[table] != NULL ? entry->escaped[table] : entry->name;
+	}
+	return escape_into(buffer, key, entities);
+}
+
+//
+// Field projection
+//
+// With output_set_fields(), only the listed attributes are output, along
+// with everything inside a listed scope. Scopes are only opened once
+// something in them is output, so that pruned ones leave no trace. The
+// set is filled before the output starts and only read afterwards.
+//
+
+static hashtable_t g_fields;
+static char *g_fields_list = NULL; // Where the keys of g_fields point to.
+
+static void _free_fields(void) {
+	hashtable_destroy(&g_fields);
+	memset(&g_fields, 0, sizeof(g_fields));
+	free(g_fields_list);
+	g_fields_list = NULL;
+}
+
+static bool _is_projecting(void) {
+	return g_fields.count > 0;
+}
+
+static bool _is_field(const char *key) {
+	return key != NULL && hashtable_get(&g_fields, key) != NULL;
+}
+
+int output_set_fields(const char *fields) {
+	_free_fields();
+	if (fields == NULL)
+		return 0;
+
+	g_fields_list = strdup(fields);
+	if (g_fields_list == NULL)
+		abort(); // Abort because it failed miserably!
+	if (hashtable_init(&g_fields, 16) < 0)
+		abort(); // Abort because it failed miserably!
+
+	char *saveptr = NULL;
+	for (char *field = strtok_r(g_fields_list, ",", &saveptr); field != NULL; field = strtok_r(NULL, ",", &saveptr)) {
+		while (isspace((unsigned char)*field))
+			field++;
+		char *end = field + strlen(field);
+		while (end > field && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+		if (*field == '\0')
+			continue;
+		if (hashtable_put(&g_fields, field, field) < 0)
+			abort(); // Abort because it failed miserably!
+	}
+
+	if (!_is_projecting()) {
+		_free_fields();
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// Output context
+//
+// Everything that producing a document involves: the format and its state,
+// the open scopes, the arena they live in and the writer. The global API
+// works on a default context, and threads that produce documents at the
+// same time use one context each.
+//
+
+#define SCOPE_STACK_CAPACITY 15
+
+struct _output_ctx {
+	const format_t *format;
+	void *format_state;		// `format->state_size` bytes, zeroed when the format is set.
+	bool is_document_open;
+	STACK_TYPE *scope_stack;
+	uint16_t emitted_depth;	// Open scopes the format has seen, from the bottom of the stack.
+	uint16_t wanted_depth;	// Depth of the outermost open scope listed in the fields, or 0.
+	arena_t arena;
+	writer_t writer;
+	bool owns_fd;			// The fd was opened for this context, which closes it.
+	output_ctx_t *next_sink;	// The global API sends the same events to it.
+};
+
+static output_ctx_t *g_default_ctx = NULL;	// The first sink.
+static size_t g_added_sinks = 0;
+
+void output_ctx_write(output_ctx_t *ctx, const char *data, size_t length) {
+	_writer_write(&ctx->writer, data, length);
+}
+
+void output_ctx_write_str(output_ctx_t *ctx, const char *str) {
+	_writer_write(&ctx->writer, str, strlen(str));
+}
+
+void output_ctx_write_strs(output_ctx_t *ctx, const char *str, ...) {
+	va_list args;
+	va_start(args, str);
+	for (; str != NULL; str = va_arg(args, const char *))
+		_writer_write(&ctx->writer, str, strlen(str));
+	va_end(args);
+}
+
+void output_ctx_write_spaces(output_ctx_t *ctx, size_t count) {
+	static const char spaces[] = "                                                                ";
+	while (count > 0) {
+		const size_t length = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+		_writer_write(&ctx->writer, spaces, length);
+		count -= length;
+	}
+}
+
+// Formatting costs more than the appends above, so plugins should prefer
+// these, and use this for what is formatted anyway.
+void output_ctx_writef(output_ctx_t *ctx, const char *format, ...) {
+	writer_t * const writer = &ctx->writer;
+	va_list args;
+
+	// Format in place when it fits in what's left of the buffer.
+	size_t available = WRITER_BUFFER_SIZE - writer->length;
+	va_start(args, format);
+	int length = vsnprintf(writer->data + writer->length, available, format, args);
+	va_end(args);
+	if (length < 0)
+		return;
+	if ((size_t)length < available) {
+		writer->length += (size_t)length;
+		return;
+	}
+
+	// Otherwise make room, or go through the heap if it's too long anyway.
+	_writer_drain(writer, NULL, 0);
+	if ((size_t)length < WRITER_BUFFER_SIZE) {
+		va_start(args, format);
+		vsnprintf(writer->data, WRITER_BUFFER_SIZE, format, args);
+		va_end(args);
+		writer->length = (size_t)length;
+		return;
+	}
+
+	char *str = malloc((size_t)length + 1);
+	if (str == NULL)
+		abort(); // Abort because it failed miserably!
+	va_start(args, format);
+	vsnprintf(str, (size_t)length + 1, format, args);
+	va_end(args);
+	_writer_drain(writer, str, (size_t)length);
+	free(str);
+}
+
+void output_ctx_flush(output_ctx_t *ctx) {
+	_writer_flush(&ctx->writer);
+}
+
+void output_ctx_set_fd(output_ctx_t *ctx, int fd) {
+	_writer_end_stream(&ctx->writer);
+	if (ctx->owns_fd) {
+		close(ctx->writer.fd);
+		ctx->owns_fd = false;
+	}
+	ctx->writer.fd = fd;
+	ctx->writer.failed = false;
+	if (ctx->writer.ring != NULL) {
+		ctx->writer.ring->fd = fd;
+		ATOMIC_STORE(&ctx->writer.ring->failed, false);
+	}
+}
+
+int output_ctx_set_compression(output_ctx_t *ctx, output_compression_e compression) {
+	writer_t * const writer = &ctx->writer;
+
+	compressor_t *compressor = NULL;
+	if (compression != OUTPUT_COMPRESSION_NONE) {
+		compressor = _compressor_new(compression);
+		if (compressor == NULL)
+			return -1;
+	}
+
+	_writer_end_stream(writer);
+	_compressor_free(writer->compressor);
+	writer->compressor = compressor;
+	if (writer->ring != NULL)
+		writer->ring->compressor = compressor;
+	return 0;
+}
+
+int output_ctx_set_async(output_ctx_t *ctx, bool async) {
+	if (async)
+		return _writer_start_thread(&ctx->writer);
+	_writer_stop_thread(&ctx->writer);
+	return 0;
+}
+
+void *output_ctx_format_state(output_ctx_t *ctx) {
+	return ctx->format_state;
+}
+
 typedef struct _format_entry {
 	const format_t *format;
 	SLIST_ENTRY(_format_entry) entries;
@@ -107,6 +1024,10 @@ int output_plugin_register_format(const format_t *format) {
 	entry->format = format;
 	SLIST_INSERT_HEAD(&g_registered_formats, entry, entries);
 
+	// Not fatal: the format is still escaped, only more slowly.
+	escape_scanner_register(format->entities_table);
+	_register_key_table(format->entities_table);
+
 	return 0;
 }
 
@@ -115,6 +1036,8 @@ void output_plugin_unregister_format(const format_t *format) {
 	if (entry == NULL)
 		return;
 
+	escape_scanner_unregister(format->entities_table);
+	_unregister_key_table(format->entities_table);
 	SLIST_REMOVE(&g_registered_formats, entry, _format_entry, entries);
 	free(entry);
 }
@@ -123,27 +1046,142 @@ void output(const char *key, const char *value) {
 	output_keyval(key, value);
 }
 
-void output_init(void) {
-	g_format = _lookup_format_by_id(FORMAT_ID_FOR_TEXT);
-	g_scope_stack = STACK_ALLOC(15);
-	if (g_scope_stack == NULL)
+static void _finish_format(output_ctx_t *ctx) {
+	if (ctx->format != NULL && ctx->format->finish_fn != NULL)
+		ctx->format->finish_fn(ctx, ctx->format);
+}
+
+static void _release_format_state(output_ctx_t *ctx) {
+	if (ctx->format_state == NULL)
+		return;
+	if (ctx->format->state_free != NULL)
+		ctx->format->state_free(ctx->format_state);
+	free(ctx->format_state);
+	ctx->format_state = NULL;
+}
+
+output_ctx_t *output_ctx_new(const format_t *format) {
+	output_ctx_t *ctx = calloc(1, sizeof *ctx);
+	if (ctx == NULL)
+		abort(); // Abort because it failed miserably!
+
+	ctx->scope_stack = STACK_ALLOC(SCOPE_STACK_CAPACITY);
+	if (ctx->scope_stack == NULL)
 		abort();
+	ctx->arena.head = ctx->arena.current = _arena_chunk_alloc(ARENA_CHUNK_SIZE);
+	ctx->writer.fd = STDOUT_FILENO;
+	ctx->writer.data = ctx->writer.buffer;
+
+	output_ctx_set_format(ctx, format != NULL ? format : _lookup_format_by_id(FORMAT_ID_FOR_TEXT));
+
+	return ctx;
+}
+
+void output_ctx_free(output_ctx_t *ctx) {
+	if (ctx == NULL)
+		return;
+
+	_finish_format(ctx);
+	_writer_end_stream(&ctx->writer);
+	_writer_stop_thread(&ctx->writer);
+	_compressor_free(ctx->writer.compressor);
+	if (ctx->owns_fd)
+		close(ctx->writer.fd);
+
+	const uint16_t scope_depth = STACK_COUNT(ctx->scope_stack);
+	if (scope_depth > 0) {
+		fprintf(stderr, "output: freeing a context while there are open scopes\n");
+	}
+
+	_release_format_state(ctx);
+	STACK_DEALLOC(ctx->scope_stack);
+	_arena_destroy(&ctx->arena);
+	free(ctx);
+}
+
+// Also ends the compressed stream, so that it can be decompressed.
+static void _output_at_exit(void) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		_writer_end_stream(&sink->writer);
+}
+
+output_ctx_t *output_default_ctx(void) {
+	return g_default_ctx;
+}
+
+void output_init(void) {
+	// Text is the default, so its plugin is loaded now, while there's a
+	// single thread: loading later would change tables that other threads
+	// read without locks as they output.
+	output_parse_format("text");
+	g_default_ctx = output_ctx_new(NULL);
+
+	// Tools may exit() halfway through a document; what was written so far
+	// must still come out, as it did when plugins went through stdio.
+	static bool flush_at_exit = false;
+	if (!flush_at_exit) {
+		atexit(_output_at_exit);
+		flush_at_exit = true;
+	}
 }
 
 void output_term(void) {
+	while (g_default_ctx != NULL) {
+		output_ctx_t * const next_sink = g_default_ctx->next_sink;
+		output_ctx_free(g_default_ctx);
+		g_default_ctx = next_sink;
+	}
+	g_added_sinks = 0;
+	_free_fields();
+
 	free(g_cmdline);
 	g_cmdline = NULL;
 
-	const uint16_t scope_depth = STACK_COUNT(g_scope_stack);
-	if (scope_depth > 0) {
-		fprintf(stderr, "output: terminating the output while there are open scopes will cause memory leaks");
+	_unregister_all_formats();
+	_free_interned_keys();
+}
+
+void output_flush(void) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_flush(sink);
+}
+
+void output_set_fd(int fd) {
+	output_ctx_set_fd(g_default_ctx, fd);
+}
+
+int output_set_compression(output_compression_e compression) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink) {
+		if (output_ctx_set_compression(sink, compression) < 0)
+			return -1;
 	}
+	return 0;
+}
 
-	// TODO(jweyrich): Should we loop to pop + close + output every scope?
-	if (g_scope_stack != NULL)
-		STACK_DEALLOC(g_scope_stack);
+int output_set_compression_by_name(const char *name) {
+	static const struct {
+		const char *name;
+		output_compression_e compression;
+	} compressions[] = {
+		{ "none", OUTPUT_COMPRESSION_NONE },
+		{ "gzip", OUTPUT_COMPRESSION_GZIP },
+		{ "zstd", OUTPUT_COMPRESSION_ZSTD }
+	};
+
+	for (size_t i = 0; i < sizeof(compressions) / sizeof(compressions[0]); i++) {
+		if (strcmp(name, compressions[i].name) == 0)
+			return output_set_compression(compressions[i].compression);
+	}
+	return -1;
+}
 
-	_unregister_all_formats();
+int output_set_async(bool async) {
+	int ret = 0;
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink) {
+		if (output_ctx_set_async(sink, async) < 0)
+			ret = -1;
+	}
+	return ret;
 }
 
 const char *output_cmdline(void) {
@@ -164,11 +1202,15 @@ void output_set_cmdline(int argc, char *argv[]) {
 	//fprintf(stderr, "DEBUG: cmdline = %s\n", g_cmdline);
 }
 
+const format_t *output_ctx_format(const output_ctx_t *ctx) {
+	return ctx->format;
+}
+
 const format_t *output_format(void) {
-	return g_format;
+	return output_ctx_format(g_default_ctx);
 }
 
-const format_t *output_parse_format(const char *format_name) {
+static const format_t *_lookup_format_by_name(const char *format_name) {
 	const format_t *format = NULL;
 
 	format_entry_t *entry;
@@ -183,16 +1225,164 @@ const format_t *output_parse_format(const char *format_name) {
 	return format;
 }
 
+const format_t *output_parse_format(const char *format_name) {
+	const format_t *format = _lookup_format_by_name(format_name);
+	if (format != NULL)
+		return format;
+
+	// The plugin of a format is only loaded once the format is asked for.
+	// If the plugin named after it doesn't provide it, one of the others may.
+	plugins_load_by_name(format_name);
+	format = _lookup_format_by_name(format_name);
+	if (format == NULL) {
+		plugins_load_remaining();
+		format = _lookup_format_by_name(format_name);
+	}
+
+	return format;
+}
+
+void output_ctx_set_format(output_ctx_t *ctx, const format_t *format) {
+	if (format == ctx->format)
+		return;
+	// Cannot switch formats in the middle of a document.
+	assert(!ctx->is_document_open);
+
+	_finish_format(ctx);
+	_release_format_state(ctx);
+	ctx->format = format;
+	if (format != NULL && format->state_size > 0) {
+		ctx->format_state = calloc(1, format->state_size);
+		if (ctx->format_state == NULL)
+			abort(); // Abort because it failed miserably!
+	}
+}
+
 void output_set_format(const format_t *format) {
-	g_format = format;
+	output_ctx_set_format(g_default_ctx, format);
 }
 
-int output_set_format_by_name(const char *format_name) {
-	const format_t *format = output_parse_format(format_name);
+// Splits the options of a format spec into the format's own options and
+// the file the output goes to. `file=<path>` must be the last option, so
+// the path may have commas. Formats that take no options also accept the
+// path alone, as in `json:out.json`. Returns the format's options, which
+// the caller frees, and sets `path` to NULL if no file is given.
+static char *_split_destination(const format_t *format, const char *options, const char **path) {
+	const char *file = NULL;
+	if (strncmp(options, "file=", 5) == 0)
+		file = options;
+	else if ((file = strstr(options, ",file=")) != NULL)
+		file++;
+
+	char *own_options;
+	if (file != NULL) {
+		*path = file + 5;
+		own_options = strndup(options, file > options ? (size_t)(file - options - 1) : 0);
+	} else if (format->option_fn == NULL) {
+		*path = options;
+		own_options = strdup("");
+	} else {
+		*path = NULL;
+		own_options = strdup(options);
+	}
+
+	if (own_options == NULL)
+		abort(); // Abort because it failed miserably!
+	return own_options;
+}
+
+// `spec` is `name` or `name:options`. See _split_destination().
+static int _ctx_set_format_by_spec(output_ctx_t *ctx, const char *spec) {
+	const char *options = strchr(spec, ':');
+	char *name = options != NULL
+		? strndup(spec, (size_t)(options - spec))
+		: strdup(spec);
+	if (name == NULL)
+		abort(); // Abort because it failed miserably!
+
+	const format_t *format = output_parse_format(name);
+	free(name);
 	if (format == NULL)
 		return -1;
 
-	output_set_format(format);
+	const char *path = NULL;
+	char *own_options = options != NULL
+		? _split_destination(format, options + 1, &path)
+		: NULL;
+	if ((path != NULL && *path == '\0')
+		|| (format->option_fn == NULL && own_options != NULL && *own_options != '\0')) {
+		free(own_options);
+		return -1;
+	}
+
+	// Options go to the context's own format state, so set the format first.
+	const format_t * const previous = ctx->format;
+	output_ctx_set_format(ctx, format);
+	if (format->option_fn != NULL
+		&& format->option_fn(ctx, format, own_options != NULL ? own_options : "") < 0) {
+		free(own_options);
+		output_ctx_set_format(ctx, previous);
+		return -1;
+	}
+	free(own_options);
+
+	if (path != NULL) {
+		const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (fd < 0) {
+			fprintf(stderr, "output: %s: %s\n", path, strerror(errno));
+			output_ctx_set_format(ctx, previous);
+			return -1;
+		}
+		output_ctx_set_fd(ctx, fd);
+		ctx->owns_fd = true;
+	}
+
+	return 0;
+}
+
+int output_set_format_by_name(const char *format_name) {
+	return _ctx_set_format_by_spec(g_default_ctx, format_name);
+}
+
+//
+// Sinks
+//
+// Each format added with output_add_format_by_name() is a sink: a context
+// of its own, with its format state, buffer and destination. The global
+// API sends every event to all sinks, in the order they were added, so a
+// tool analyses a file once however many reports it writes.
+//
+
+int output_add_format_by_name(const char *format_spec) {
+	// The first one takes the place of the default format.
+	if (g_added_sinks == 0) {
+		if (_ctx_set_format_by_spec(g_default_ctx, format_spec) < 0)
+			return -1;
+		g_added_sinks++;
+		return 0;
+	}
+
+	// Sinks can't be added while a document is being output.
+	assert(!g_default_ctx->is_document_open);
+
+	output_ctx_t * const sink = output_ctx_new(NULL);
+	if (_ctx_set_format_by_spec(sink, format_spec) < 0) {
+		output_ctx_free(sink);
+		return -1;
+	}
+
+	// Settings made so far apply to it as well.
+	const writer_t * const writer = &g_default_ctx->writer;
+	if (writer->compressor != NULL)
+		output_ctx_set_compression(sink, writer->compressor->type);
+	if (writer->ring != NULL)
+		output_ctx_set_async(sink, true);
+
+	output_ctx_t *last = g_default_ctx;
+	while (last->next_sink != NULL)
+		last = last->next_sink;
+	last->next_sink = sink;
+	g_added_sinks++;
 
 	return 0;
 }
@@ -206,6 +1396,9 @@ size_t output_available_formats(char *buffer, size_t size, char separator) {
 	//        appended at the end of the buffer.
 	memset(buffer, 0, size);
 
+	// Formats not used so far weren't loaded.
+	plugins_load_remaining();
+
 	format_entry_t *entry;
 	SLIST_FOREACH(entry, &g_registered_formats, entries) {
 		if (!truncated) {
@@ -234,29 +1427,32 @@ size_t output_available_formats(char *buffer, size_t size, char separator) {
 	return total_available;
 }
 
-void output_open_document(void) {
-	output_open_document_with_name(NULL);
+void output_ctx_open_document(output_ctx_t *ctx) {
+	output_ctx_open_document_with_name(ctx, NULL);
 }
 
-void output_open_document_with_name(const char *document_name) {
-	assert(g_format != NULL);
+void output_ctx_open_document_with_name(output_ctx_t *ctx, const char *document_name) {
+	if (ctx->format == NULL) {
+		fprintf(stderr, "output: the text format is not available\n");
+		exit(EXIT_FAILURE);
+	}
 	// Cannot open a new document while there's one already open.
-	assert(!g_is_document_open);
+	assert(!ctx->is_document_open);
 
 	const char *key = document_name;
 	const output_scope_type_e scope_type = OUTPUT_SCOPE_TYPE_DOCUMENT;
 
-	output_open_scope(key, scope_type);
-	g_is_document_open = true;
+	output_ctx_open_scope(ctx, key, scope_type);
+	ctx->is_document_open = true;
 }
 
-void output_close_document(void) {
-	assert(g_format != NULL);
+void output_ctx_close_document(output_ctx_t *ctx) {
+	assert(ctx->format != NULL);
 	// Closing a document without first opening it is an error.
-	assert(g_is_document_open);
+	assert(ctx->is_document_open);
 
 	const output_scope_t *scope = NULL;
-	int ret = STACK_PEEK(g_scope_stack, (void *)&scope);
+	int ret = STACK_PEEK(ctx->scope_stack, (void *)&scope);
 	if (ret < 0) {
 		fprintf(stderr, "output: cannot close a scope that has not been opened.\n");
 		abort();
@@ -267,46 +1463,96 @@ void output_close_document(void) {
 		abort();
 	}
 
-	output_close_scope();
-	g_is_document_open = false;
+	output_ctx_close_scope(ctx);
+	ctx->is_document_open = false;
+
+	output_ctx_flush(ctx);
+
+	// Nothing is left open, so the whole arena is free again.
+	_arena_reset(&ctx->arena);
 }
 
-void output_open_scope(const char *scope_name, output_scope_type_e scope_type) {
-	assert(g_format != NULL);
+// Opens the scopes whose opening was held back by the fields.
+static void _emit_pending_scopes(output_ctx_t *ctx) {
+	const format_t * const format = ctx->format;
+	const uint16_t scope_depth = STACK_COUNT(ctx->scope_stack);
+
+	for (; ctx->emitted_depth < scope_depth; ctx->emitted_depth++) {
+		const output_scope_t * const scope = ctx->scope_stack->elements[ctx->emitted_depth];
+		format->output_fn(ctx, format, OUTPUT_TYPE_SCOPE_OPEN, scope, scope->name, NULL);
+	}
+}
+
+bool output_ctx_wants(const output_ctx_t *ctx, const char *key) {
+	return !_is_projecting() || ctx->wanted_depth > 0 || _is_field(key);
+}
+
+bool output_wants(const char *key) {
+	return output_ctx_wants(g_default_ctx, key);
+}
+
+void output_ctx_open_scope(output_ctx_t *ctx, const char *scope_name, output_scope_type_e scope_type) {
+	const format_t * const format = ctx->format;
+	assert(format != NULL);
 
 	const char *key = scope_name;
 	const char *value = NULL;
 	const output_type_e type = OUTPUT_TYPE_SCOPE_OPEN;
-	const uint16_t scope_depth = STACK_COUNT(g_scope_stack);
-
-	output_scope_t * const scope = malloc(sizeof *scope);
-	if (scope == NULL)
-		abort(); // Abort because it failed miserably!
-
-	scope->name = scope_name == NULL ? NULL : strdup(scope_name);
+	const uint16_t scope_depth = STACK_COUNT(ctx->scope_stack);
+
+	// The name is copied because nothing guarantees the caller's string
+	// outlives the scope, but it's a memcpy into the arena, not a strdup().
+	// Interned names outlive all scopes.
+	const arena_mark_t mark = _arena_mark(&ctx->arena);
+	scope_entry_t * const entry = _arena_alloc(&ctx->arena, sizeof *entry);
+	output_scope_t * const scope = &entry->scope;
+	entry->mark = mark;
+
+	const interned_key_t * const interned = _lookup_interned_key(scope_name);
+	if (interned != NULL) {
+		scope->name = interned->name;
+	} else if (scope_name != NULL) {
+		const size_t name_size = strlen(scope_name) + 1;
+		scope->name = memcpy(_arena_alloc(&ctx->arena, name_size), scope_name, name_size);
+	} else {
+		scope->name = NULL;
+	}
 	scope->type = scope_type;
+	scope->parent_type = OUTPUT_SCOPE_TYPE_UNKNOWN;
 	scope->depth = scope_depth + 1;
 
 	if (scope_depth > 0) {
 		output_scope_t * parent_scope = NULL;
-		STACK_PEEK(g_scope_stack, (void *)&parent_scope);
+		STACK_PEEK(ctx->scope_stack, (void *)&parent_scope);
 		scope->parent_type = parent_scope->type;
 	}
 
-	//fprintf(stderr, "DEBUG: output_open_scope: scope_depth=%d\n", STACK_COUNT(g_scope_stack));
-	if (g_format != NULL)
-		g_format->output_fn(g_format, type, scope, key, value);
-
-	int ret = STACK_PUSH(g_scope_stack, (void *)scope);
+	int ret = STACK_PUSH(ctx->scope_stack, (void *)scope);
 	if (ret < 0)
 		abort(); // Abort because it failed miserably!
+
+	if (_is_projecting()) {
+		if (ctx->wanted_depth == 0 && _is_field(scope_name))
+			ctx->wanted_depth = scope->depth;
+		// Open it later, if anything in it is output.
+		if (ctx->wanted_depth == 0 && scope_type != OUTPUT_SCOPE_TYPE_DOCUMENT)
+			return;
+		_emit_pending_scopes(ctx);
+		return;
+	}
+
+	//fprintf(stderr, "DEBUG: output_open_scope: scope_depth=%d\n", STACK_COUNT(ctx->scope_stack));
+	if (format != NULL)
+		format->output_fn(ctx, format, type, scope, key, value);
+	ctx->emitted_depth = scope->depth;
 }
 
-void output_close_scope(void) {
-	assert(g_format != NULL);
+void output_ctx_close_scope(output_ctx_t *ctx) {
+	const format_t * const format = ctx->format;
+	assert(format != NULL);
 
 	output_scope_t *scope = NULL;
-	int ret = STACK_POP(g_scope_stack, (void *)&scope);
+	int ret = STACK_POP(ctx->scope_stack, (void *)&scope);
 	if (ret < 0) {
 		fprintf(stderr, "output: cannot close a scope that has not been opened.\n");
 		abort();
@@ -316,25 +1562,159 @@ void output_close_scope(void) {
 	const char *value = NULL;
 	const output_type_e type = OUTPUT_TYPE_SCOPE_CLOSE;
 
-	//fprintf(stderr, "DEBUG: output_close_scope: scope_depth=%d\n", STACK_COUNT(g_scope_stack));
-	if (g_format != NULL)
-		g_format->output_fn(g_format, type, scope, key, value);
+	if (ctx->wanted_depth == scope->depth)
+		ctx->wanted_depth = 0;
+
+	//fprintf(stderr, "DEBUG: output_close_scope: scope_depth=%d\n", STACK_COUNT(ctx->scope_stack));
+	// Scopes pruned by the fields were never opened.
+	if (ctx->emitted_depth == scope->depth) {
+		if (format != NULL)
+			format->output_fn(ctx, format, type, scope, key, value);
+		ctx->emitted_depth--;
+	}
 
-	free(scope->name);
-	free(scope);
+	_arena_release(&ctx->arena, ((scope_entry_t *)scope)->mark);
 }
 
-void output_keyval(const char *key, const char *value) {
-	assert(g_format != NULL);
+void output_ctx_keyval(output_ctx_t *ctx, const char *key, const char *value) {
+	const format_t * const format = ctx->format;
+	assert(format != NULL);
 
-	const uint16_t scope_depth = STACK_COUNT(g_scope_stack);
+	const uint16_t scope_depth = STACK_COUNT(ctx->scope_stack);
 	const output_scope_t *scope = NULL;
 
 	if (scope_depth > 0)
-		STACK_PEEK(g_scope_stack, (void *)&scope);
+		STACK_PEEK(ctx->scope_stack, (void *)&scope);
 
 	const output_type_e type = OUTPUT_TYPE_ATTRIBUTE;
 
-	if (g_format != NULL)
-		g_format->output_fn(g_format, type, scope, key, value);
+	if (_is_projecting()) {
+		if (!output_ctx_wants(ctx, key))
+			return;
+		_emit_pending_scopes(ctx);
+	}
+
+	if (format != NULL)
+		format->output_fn(ctx, format, type, scope, key, value);
+}
+
+void output_open_document(void) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_open_document(sink);
+}
+
+void output_open_document_with_name(const char *document_name) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_open_document_with_name(sink, document_name);
+}
+
+void output_close_document(void) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_close_document(sink);
+}
+
+void output_open_scope(const char *scope_name, output_scope_type_e scope_type) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_open_scope(sink, scope_name, scope_type);
+}
+
+void output_close_scope(void) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_close_scope(sink);
+}
+
+void output_keyval(const char *key, const char *value) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_keyval(sink, key, value);
+}
+
+static char *_prepend_str(char *p, const char *str, size_t len) {
+	p -= len;
+	memcpy(p, str, len);
+	return p;
+}
+
+static char *_prepend_dec(char *p, uint64_t value) {
+	do {
+		*--p = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	return p;
+}
+
+static char *_prepend_hex(char *p, uint64_t value) {
+	static const char digits[] = "0123456789abcdef";
+	do {
+		*--p = digits[value & 0xf];
+		value >>= 4;
+	} while (value != 0);
+	return p;
+}
+
+// Formats `value` like the equivalent printf() format would, without the
+// cost of parsing a format string. Returns the length of the result,
+// which is truncated to fit in `size`.
+size_t output_format_int(char *buffer, size_t size, uint64_t value, output_int_hint_e hint) {
+	char tmp[OUTPUT_INT_BUFFER_SIZE];
+	char * const end = tmp + sizeof(tmp);
+	char *p = end;
+
+	switch (hint) {
+		default:
+		case OUTPUT_INT_DECIMAL:
+			p = _prepend_dec(p, value);
+			break;
+		case OUTPUT_INT_HEX_SIZE:
+			p = _prepend_str(p, " bytes)", 7);
+			p = _prepend_dec(p, value);
+			p = _prepend_str(p, " (", 2);
+			// fall through
+		case OUTPUT_INT_HEX:
+			p = _prepend_hex(p, value);
+			if (value != 0)
+				p = _prepend_str(p, "0x", 2);
+			break;
+	}
+
+	if (size == 0)
+		return 0;
+
+	size_t length = (size_t)(end - p);
+	if (length > size - 1)
+		length = size - 1;
+	memcpy(buffer, p, length);
+	buffer[length] = '\0';
+
+	return length;
+}
+
+void output_ctx_int(output_ctx_t *ctx, const char *key, uint64_t value, output_int_hint_e hint) {
+	const format_t * const format = ctx->format;
+	assert(format != NULL);
+
+	const uint16_t scope_depth = STACK_COUNT(ctx->scope_stack);
+	const output_scope_t *scope = NULL;
+
+	if (scope_depth > 0)
+		STACK_PEEK(ctx->scope_stack, (void *)&scope);
+
+	if (_is_projecting()) {
+		if (!output_ctx_wants(ctx, key))
+			return;
+		_emit_pending_scopes(ctx);
+	}
+
+	if (format->output_int_fn != NULL) {
+		format->output_int_fn(ctx, format, scope, key, value, hint);
+		return;
+	}
+
+	char buffer[OUTPUT_INT_BUFFER_SIZE];
+	output_format_int(buffer, sizeof(buffer), value, hint);
+	format->output_fn(ctx, format, OUTPUT_TYPE_ATTRIBUTE, scope, key, buffer);
+}
+
+void output_int(const char *key, uint64_t value, output_int_hint_e hint) {
+	for (output_ctx_t *sink = g_default_ctx; sink != NULL; sink = sink->next_sink)
+		output_ctx_int(sink, key, value, hint);
 }
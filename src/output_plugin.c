@@ -35,9 +35,176 @@
 */
 
 #include "output_plugin.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ESCAPE_SCAN_WIDTH	32
+typedef __m256i escape_vector_t;
+#define VECTOR_LOAD(p)		_mm256_load_si256((const __m256i *)(p))
+#define VECTOR_SET1(c)		_mm256_set1_epi8(c)
+#define VECTOR_MIN_U8(a, b)	_mm256_min_epu8(a, b)
+#define VECTOR_EQ(a, b)		_mm256_cmpeq_epi8(a, b)
+#define VECTOR_OR(a, b)		_mm256_or_si256(a, b)
+#define VECTOR_AND(a, b)	_mm256_and_si256(a, b)
+#define VECTOR_MOVEMASK(a)	_mm256_movemask_epi8(a)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ESCAPE_SCAN_WIDTH	16
+typedef __m128i escape_vector_t;
+#define VECTOR_LOAD(p)		_mm_load_si128((const __m128i *)(p))
+#define VECTOR_SET1(c)		_mm_set1_epi8(c)
+#define VECTOR_MIN_U8(a, b)	_mm_min_epu8(a, b)
+#define VECTOR_EQ(a, b)		_mm_cmpeq_epi8(a, b)
+#define VECTOR_OR(a, b)		_mm_or_si128(a, b)
+#define VECTOR_AND(a, b)	_mm_and_si128(a, b)
+#define VECTOR_MOVEMASK(a)	_mm_movemask_epi8(a)
+#endif
+
+//
+// Vectorized search for the first character that needs escaping.
+//
+// Each registered entity table gets a scanner that flags, ESCAPE_SCAN_WIDTH
+// bytes at a time, every byte that *might* need escaping: control characters
+// (including the NUL terminator), bytes >= 0x80 if the table has entities for
+// any of them, and the few printable characters the table escapes. Flagged
+// bytes are then confirmed against the table itself, so a table only needs to
+// be simple enough to be described that way, not exactly so. Tables that
+// aren't registered, or that escape too many printable characters, use the
+// byte-at-a-time loop.
+//
+
+#define ESCAPE_SCAN_MAX_TABLES		8
+#define ESCAPE_SCAN_MAX_SPECIALS	6	// See _escape_scan_block().
+
+#ifdef ESCAPE_SCAN_WIDTH
+
+typedef struct {
+	char **entities;		// Not `entity_table_t`, so that slots can be reused.
+	escape_vector_t high_bit;	// 0x80 if any byte >= 0x80 is escaped, 0 otherwise.
+	// Unused slots are zeroed, which costs no extra hits: NUL is always
+	// looked for anyway.
+	escape_vector_t specials[ESCAPE_SCAN_MAX_SPECIALS];
+} escape_scanner_t;
+
+// Only changed when formats are (un)registered, before and after any output.
+static escape_scanner_t g_escape_scanners[ESCAPE_SCAN_MAX_TABLES];
+
+// The scan reads whole aligned blocks, which may extend past the NUL
+// terminator, though never into another page.
+#if defined(__SANITIZE_ADDRESS__)
+#define ESCAPE_SCAN_NO_SANITIZE __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ESCAPE_SCAN_NO_SANITIZE __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef ESCAPE_SCAN_NO_SANITIZE
+#define ESCAPE_SCAN_NO_SANITIZE
+#endif
+
+static escape_scanner_t *_escape_scanner_lookup(const entity_table_t entities) {
+	for (size_t i = 0; i < ESCAPE_SCAN_MAX_TABLES; i++) {
+		if (g_escape_scanners[i].entities == entities)
+			return &g_escape_scanners[i];
+	}
+	return NULL;
+}
+
+// Returns a mask with bit `i` set if `block[i]` might need escaping.
+ESCAPE_SCAN_NO_SANITIZE
+static uint32_t _escape_scan_block(const escape_scanner_t *scanner, const unsigned char *block) {
+	const escape_vector_t *specials = scanner->specials;
+	const escape_vector_t v = VECTOR_LOAD(block);
+	// Unsigned v <= 0x1f, which includes the NUL terminator.
+	escape_vector_t hits = VECTOR_EQ(VECTOR_MIN_U8(v, VECTOR_SET1(0x1f)), v);
+	// Bytes >= 0x80, if the table escapes any. `high_bit` is 0 otherwise.
+	hits = VECTOR_OR(hits, VECTOR_EQ(VECTOR_AND(v, scanner->high_bit), VECTOR_SET1((char)0x80)));
+	// Written out rather than looped over, so that it's always unrolled.
+	hits = VECTOR_OR(hits,
+		VECTOR_OR(
+			VECTOR_OR(VECTOR_EQ(v, specials[0]), VECTOR_EQ(v, specials[1])),
+			VECTOR_OR(VECTOR_EQ(v, specials[2]), VECTOR_EQ(v, specials[3]))));
+	hits = VECTOR_OR(hits, VECTOR_OR(VECTOR_EQ(v, specials[4]), VECTOR_EQ(v, specials[5])));
+	return (uint32_t)VECTOR_MOVEMASK(hits);
+}
+
+static const unsigned char *_escape_scan(const escape_scanner_t *scanner, const unsigned char *p) {
+	// Start from the aligned block containing `p`, ignoring the bytes before it.
+	const size_t misalignment = (uintptr_t)p & (ESCAPE_SCAN_WIDTH - 1);
+	const unsigned char *block = p - misalignment;
+	uint32_t mask = _escape_scan_block(scanner, block) >> misalignment << misalignment;
+
+	for (;;) {
+		while (mask != 0) {
+			const unsigned char *candidate = block + __builtin_ctz(mask);
+			if (*candidate == '\0' || scanner->entities[*candidate] != NULL)
+				return candidate;
+			mask &= mask - 1;
+		}
+		block += ESCAPE_SCAN_WIDTH;
+		mask = _escape_scan_block(scanner, block);
+	}
+}
+
+#endif // ESCAPE_SCAN_WIDTH
+
+int escape_scanner_register(const entity_table_t entities) {
+#ifdef ESCAPE_SCAN_WIDTH
+	if (entities == NULL || _escape_scanner_lookup(entities) != NULL)
+		return 0;
+
+	escape_scanner_t scanner = { .entities = entities };
+	size_t specials_count = 0;
+	for (unsigned int c = 0x20; c < 256; c++) {
+		if (entities[c] == NULL)
+			continue;
+		if (c >= 0x80) {
+			scanner.high_bit = VECTOR_SET1((char)0x80);
+		} else if (specials_count < ESCAPE_SCAN_MAX_SPECIALS) {
+			scanner.specials[specials_count++] = VECTOR_SET1((char)c);
+		} else {
+			return -1; // Too many to check for; the scalar loop will do.
+		}
+	}
+
+	escape_scanner_t *slot = _escape_scanner_lookup(NULL);
+	if (slot == NULL)
+		return -1;
+	*slot = scanner;
+#else
+	(void)entities;
+#endif
+	return 0;
+}
+
+void escape_scanner_unregister(const entity_table_t entities) {
+#ifdef ESCAPE_SCAN_WIDTH
+	if (entities == NULL)
+		return;
+	escape_scanner_t *slot = _escape_scanner_lookup(entities);
+	if (slot != NULL)
+		memset(slot, 0, sizeof *slot);
+#else
+	(void)entities;
+#endif
+}
+
+// Returns the first character of `str` that `entities` escapes, or its NUL
+// terminator if there is none.
+static const unsigned char *_escape_find(const unsigned char *p, const entity_table_t entities) {
+#ifdef ESCAPE_SCAN_WIDTH
+	const escape_scanner_t *scanner = _escape_scanner_lookup(entities);
+	if (scanner != NULL)
+		return _escape_scan(scanner, p);
+#endif
+	while (*p != '\0' && entities[*p] == NULL)
+		p++;
+	return p;
+}
+
 size_t escape_count_chars_ex(const char *str, size_t len, const entity_table_t entities) {
 	size_t result = 0;
 	for (size_t i = 0; i < len; i++) {
@@ -48,6 +215,13 @@ size_t escape_count_chars_ex(const char *str, size_t len, const entity_table_t e
 	return result;
 }
 
+// Returns whether escaping `str` would change it.
+bool escape_needed_ex(const char *str, const entity_table_t entities) {
+	if (str == NULL || entities == NULL)
+		return false;
+	return *_escape_find((const unsigned char *)str, entities) != '\0';
+}
+
 // Returns a new copy of `str` enclosed with quotes.
 static char *strdup_quoted(const char *str) {
 	if (str == NULL)
@@ -163,10 +337,93 @@ char *escape_quoted(const format_t *format, const char *str) {
 	return escape_ex_quoted(str, format->entities_table);
 }
 
+static void output_buffer_reserve(output_buffer_t *buffer, size_t length) {
+	if (buffer->capacity - buffer->length >= length)
+		return;
+
+	size_t capacity = buffer->capacity ? buffer->capacity : 256;
+	while (capacity - buffer->length < length)
+		capacity *= 2;
+
+	char *data = realloc(buffer->data, capacity);
+	if (data == NULL)
+		abort();
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+}
+
+void output_buffer_append(output_buffer_t *buffer, const char *str, size_t length) {
+	output_buffer_reserve(buffer, length);
+	memcpy(buffer->data + buffer->length, str, length);
+	buffer->length += length;
+}
+
+void output_buffer_append_escaped(output_buffer_t *buffer, const char *str, const entity_table_t entities) {
+	if (entities == NULL) {
+		output_buffer_append(buffer, str, strlen(str));
+		return;
+	}
+
+	const unsigned char *p = (const unsigned char *)str;
+	while (*p != '\0') {
+		const unsigned char *run = p;
+		p = _escape_find(p, entities);
+		output_buffer_append(buffer, (const char *)run, (size_t)(p - run));
+
+		if (*p != '\0') {
+			const entity_t entity = entities[*p++];
+			output_buffer_append(buffer, entity, strlen(entity));
+		}
+	}
+}
+
+void output_buffer_free(output_buffer_t *buffer) {
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->length = 0;
+	buffer->capacity = 0;
+}
+
+const char *escape_into(output_buffer_t *buffer, const char *str, const entity_table_t entities) {
+	if (str == NULL || entities == NULL)
+		return str;
+
+	// Fast path: most keys and values have nothing to escape.
+	const unsigned char *p = _escape_find((const unsigned char *)str, entities);
+	if (*p == '\0')
+		return str;
+
+	const size_t prefix_length = (size_t)((const char *)p - str);
+	buffer->length = 0;
+	output_buffer_append(buffer, str, prefix_length);
+	output_buffer_append_escaped(buffer, str + prefix_length, entities);
+	output_buffer_append(buffer, "", 1);
+
+	return buffer->data;
+}
+
+const char *escape_into_quoted(output_buffer_t *buffer, const char *str, const entity_table_t entities) {
+	if (str == NULL)
+		return NULL;
+
+	buffer->length = 0;
+	output_buffer_append(buffer, "\"", 1);
+	output_buffer_append_escaped(buffer, str, entities);
+	output_buffer_append(buffer, "\"", 2); // Closing quote and NUL terminator.
+
+	return buffer->data;
+}
+
 // These 2 are implemented in `output.c`.
 extern int output_plugin_register_format(const format_t *format);
 extern void output_plugin_unregister_format(const format_t *format);
 
+void output_ctx_write_indent(output_ctx_t *ctx, int level) {
+	if (level > 0)
+		output_ctx_write_spaces(ctx, (size_t)INDENT_COLUMNS_(level));
+}
+
 output_plugin_api_t *output_plugin_api_ptr(void) {
 	static output_plugin_api_t api = {
 		.output_cmdline = output_cmdline,
@@ -176,7 +433,23 @@ output_plugin_api_t *output_plugin_api_ptr(void) {
 		.escape_ex = escape_ex,
 		.escape_ex_quoted = escape_ex_quoted,
 		.escape = escape,
-		.escape_quoted = escape_quoted
+		.escape_quoted = escape_quoted,
+		.escape_needed_ex = escape_needed_ex,
+		.format_int = output_format_int,
+		.buffer_append = output_buffer_append,
+		.buffer_append_escaped = output_buffer_append_escaped,
+		.buffer_free = output_buffer_free,
+		.escape_into = escape_into,
+		.escape_into_quoted = escape_into_quoted,
+		.write = output_ctx_write,
+		.write_str = output_ctx_write_str,
+		.write_strs = output_ctx_write_strs,
+		.write_spaces = output_ctx_write_spaces,
+		.write_indent = output_ctx_write_indent,
+		.writef = output_ctx_writef,
+		.flush = output_ctx_flush,
+		.format_state = output_ctx_format_state,
+		.escape_key_into = escape_key_into
 	};
 	return &api;
 }
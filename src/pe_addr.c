@@ -0,0 +1,455 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_addr.c - Sorted section tables for bulk RVA and file offset translation.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#include "pe_addr.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STREAM_BUFFER_SIZE	(64 * 1024)
+// Longest line worth parsing: "0x" followed by 16 hex digits, with room for blanks.
+#define STREAM_MAX_LINE		256
+
+static int _compare_uint64(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static size_t _lower_bound(const uint64_t *values, size_t count, uint64_t value) {
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (values[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static size_t _next_unowned(size_t *next, size_t k) {
+	size_t root = k;
+	while (next[root] != root)
+		root = next[root];
+	// Path compression.
+	while (next[k] != root) {
+		const size_t parent = next[k];
+		next[k] = root;
+		k = parent;
+	}
+	return root;
+}
+
+// Turns `spans`, in section table order, into sorted ranges that don't
+// overlap. The elementary intervals between span boundaries are given to
+// the first span covering them; a union-find over the intervals that
+// still have no owner keeps this linear-ish even for hostile tables.
+static int _build_ranges(const pe_addr_range_t *spans, size_t count, pe_addr_range_t **ranges, size_t *ranges_count) {
+	*ranges = NULL;
+	*ranges_count = 0;
+
+	if (count == 0)
+		return 0;
+
+	uint64_t *bounds = malloc(2 * count * sizeof(*bounds));
+	if (bounds == NULL)
+		return -1;
+
+	for (size_t i = 0; i < count; i++) {
+		bounds[2 * i] = spans[i].start;
+		bounds[2 * i + 1] = spans[i].end;
+	}
+	qsort(bounds, 2 * count, sizeof(*bounds), _compare_uint64);
+
+	size_t bounds_count = 1;
+	for (size_t i = 1; i < 2 * count; i++) {
+		if (bounds[i] != bounds[bounds_count - 1])
+			bounds[bounds_count++] = bounds[i];
+	}
+
+	// Interval k is [bounds[k], bounds[k+1]).
+	const size_t intervals_count = bounds_count - 1;
+	size_t *owner = malloc((intervals_count + 1) * sizeof(*owner));
+	size_t *next = malloc((intervals_count + 1) * sizeof(*next));
+	pe_addr_range_t *result = malloc(intervals_count * sizeof(*result));
+	if (owner == NULL || next == NULL || result == NULL) {
+		free(bounds);
+		free(owner);
+		free(next);
+		free(result);
+		return -1;
+	}
+
+	for (size_t k = 0; k <= intervals_count; k++) {
+		owner[k] = SIZE_MAX;
+		next[k] = k;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const size_t lo = _lower_bound(bounds, bounds_count, spans[i].start);
+		const size_t hi = _lower_bound(bounds, bounds_count, spans[i].end);
+		for (size_t k = _next_unowned(next, lo); k < hi; k = _next_unowned(next, k + 1)) {
+			owner[k] = i;
+			next[k] = k + 1;
+		}
+	}
+
+	size_t result_count = 0;
+	for (size_t k = 0; k < intervals_count; k++) {
+		if (owner[k] == SIZE_MAX)
+			continue;
+
+		const pe_addr_range_t *span = &spans[owner[k]];
+		pe_addr_range_t *last = result_count > 0 ? &result[result_count - 1] : NULL;
+		if (last != NULL && last->end == bounds[k] && last->from_base == span->from_base && last->to_base == span->to_base) {
+			last->end = bounds[k + 1];
+			continue;
+		}
+
+		pe_addr_range_t *range = &result[result_count++];
+		*range = *span;
+		range->start = bounds[k];
+		range->end = bounds[k + 1];
+	}
+
+	free(bounds);
+	free(owner);
+	free(next);
+
+	*ranges = result;
+	*ranges_count = result_count;
+
+	return 0;
+}
+
+int pe_addr_table_init(pe_addr_table_t *table, pe_ctx_t *ctx) {
+	memset(table, 0, sizeof(*table));
+	table->image_base = ctx->pe.imagebase;
+
+	IMAGE_SECTION_HEADER ** const sections = pe_sections(ctx);
+	const uint16_t sections_count = pe_sections_count(ctx);
+	if (sections == NULL)
+		return 0;
+
+	table->has_sections = true;
+
+	pe_addr_range_t *rva_spans = calloc(sections_count + 1, sizeof(*rva_spans));
+	pe_addr_range_t *ofs_spans = calloc(sections_count + 1, sizeof(*ofs_spans));
+	if (rva_spans == NULL || ofs_spans == NULL) {
+		free(rva_spans);
+		free(ofs_spans);
+		return -1;
+	}
+
+	size_t rva_count = 0;
+	size_t ofs_count = 0;
+
+	for (uint16_t i = 0; i < sections_count; i++) {
+		const IMAGE_SECTION_HEADER *section = sections[i];
+		if (section == NULL) {
+			table->truncated = true;
+			break;
+		}
+
+		// Same bounds as libpe, including the 32-bit wrap of the raw end.
+		uint64_t virtual_size = section->Misc.VirtualSize;
+		if (virtual_size == 0)
+			virtual_size = section->SizeOfRawData;
+
+		const pe_addr_range_t rva_span = {
+			.start = section->VirtualAddress,
+			.end = section->VirtualAddress + virtual_size,
+			.from_base = section->VirtualAddress,
+			.to_base = section->PointerToRawData
+		};
+		const pe_addr_range_t ofs_span = {
+			.start = section->PointerToRawData,
+			.end = (uint32_t)(section->PointerToRawData + section->SizeOfRawData),
+			.from_base = section->PointerToRawData,
+			.to_base = section->VirtualAddress
+		};
+
+		if (i == 0)
+			table->first_section = rva_span;
+
+		if (rva_span.end > rva_span.start)
+			rva_spans[rva_count++] = rva_span;
+		if (ofs_span.end > ofs_span.start)
+			ofs_spans[ofs_count++] = ofs_span;
+	}
+
+	table->single_section = sections_count == 1 && !table->truncated;
+
+	int ret = _build_ranges(rva_spans, rva_count, &table->rva_ranges, &table->rva_count);
+	if (ret == 0)
+		ret = _build_ranges(ofs_spans, ofs_count, &table->ofs_ranges, &table->ofs_count);
+
+	free(rva_spans);
+	free(ofs_spans);
+
+	if (ret < 0)
+		pe_addr_table_destroy(table);
+
+	return ret;
+}
+
+void pe_addr_table_destroy(pe_addr_table_t *table) {
+	free(table->rva_ranges);
+	free(table->ofs_ranges);
+	table->rva_ranges = NULL;
+	table->ofs_ranges = NULL;
+	table->rva_count = 0;
+	table->ofs_count = 0;
+}
+
+static const pe_addr_range_t *_find_range(const pe_addr_range_t *ranges, size_t count, uint64_t value) {
+	// Last range starting at or before `value`.
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (ranges[mid].start <= value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0 || value >= ranges[lo - 1].end)
+		return NULL;
+
+	return &ranges[lo - 1];
+}
+
+uint64_t pe_addr_rva2ofs(const pe_addr_table_t *table, uint64_t rva) {
+	if (rva == 0 || !table->has_sections)
+		return 0;
+
+	const pe_addr_range_t *range = _find_range(table->rva_ranges, table->rva_count, rva);
+	if (range != NULL)
+		return rva - range->from_base + range->to_base;
+
+	if (table->truncated)
+		return 0;
+
+	if (table->single_section)
+		return rva - table->first_section.from_base + table->first_section.to_base;
+
+	return rva;
+}
+
+uint64_t pe_addr_ofs2rva(const pe_addr_table_t *table, uint64_t ofs) {
+	if (ofs == 0 || !table->has_sections)
+		return 0;
+
+	const pe_addr_range_t *range = _find_range(table->ofs_ranges, table->ofs_count, ofs);
+	if (range == NULL)
+		return 0;
+
+	return ofs - range->from_base + range->to_base;
+}
+
+static int _digit_value(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return 99;
+}
+
+// Parses an unsigned number like strtoull() with base 0 would, but
+// requires the whole of [str, end) to be the number, with optional blanks
+// around it. Returns false on syntax errors and overflow.
+static bool _parse_address(const char *str, const char *end, uint64_t *value) {
+	while (str < end && (*str == ' ' || *str == '\t'))
+		str++;
+	while (end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		end--;
+
+	if (str == end)
+		return false;
+
+	unsigned base = 10;
+	if (end - str > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		base = 16;
+		str += 2;
+	} else if (end - str > 1 && str[0] == '0') {
+		base = 8;
+		str += 1;
+	}
+
+	uint64_t result = 0;
+	for (; str < end; str++) {
+		const unsigned digit = (unsigned)_digit_value(*str);
+		if (digit >= base)
+			return false;
+		if (result > (UINT64_MAX - digit) / base)
+			return false;
+		result = result * base + digit;
+	}
+
+	*value = result;
+	return true;
+}
+
+static bool _is_blank(const char *str, const char *end) {
+	for (; str < end; str++) {
+		if (*str != ' ' && *str != '\t' && *str != '\r')
+			return false;
+	}
+	return true;
+}
+
+typedef struct {
+	FILE *stream;
+	size_t length;
+	char buffer[STREAM_BUFFER_SIZE];
+} _writer_t;
+
+typedef struct {
+	const pe_addr_table_t *table;
+	pe_addr_translate_fn translate;
+	pe_addr_format_fn format;
+	size_t invalid_count;
+	_writer_t writer;
+	char input[STREAM_BUFFER_SIZE];
+} _stream_t;
+
+static int _writer_flush(_writer_t *writer) {
+	if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->stream) != writer->length)
+		return -1;
+	writer->length = 0;
+	return 0;
+}
+
+// A NULL `line` is written as invalid.
+static int _write_line(_stream_t *stream, const char *line, const char *end) {
+	_writer_t * const writer = &stream->writer;
+	if (sizeof(writer->buffer) - writer->length < PE_ADDR_FORMAT_SIZE + 1 && _writer_flush(writer) < 0)
+		return -1;
+
+	char *p = writer->buffer + writer->length;
+	uint64_t value, result;
+
+	if (line != NULL && _is_blank(line, end)) {
+		// Keeps the output aligned with the input.
+	} else if (line != NULL && _parse_address(line, end, &value) && stream->translate(stream->table, value, &result)) {
+		const size_t written = stream->format(p, PE_ADDR_FORMAT_SIZE, result);
+		p += written < PE_ADDR_FORMAT_SIZE ? written : PE_ADDR_FORMAT_SIZE - 1;
+	} else {
+		memcpy(p, "invalid", 7);
+		p += 7;
+		stream->invalid_count++;
+	}
+
+	*p++ = '\n';
+	writer->length = (size_t)(p - writer->buffer);
+
+	return 0;
+}
+
+static int _translate_stream(_stream_t *stream, FILE *in) {
+	char * const input = stream->input;
+	size_t length = 0;		// Bytes in `input`, starting with an incomplete line.
+	bool overlong = false;	// Skipping the rest of a line too long to be an address.
+
+	for (;;) {
+		const size_t read = fread(input + length, 1, sizeof(stream->input) - length, in);
+		length += read;
+
+		char *line = input;
+		char * const end = input + length;
+		char *newline;
+
+		while ((newline = memchr(line, '\n', (size_t)(end - line))) != NULL) {
+			// Overlong lines are written as invalid without being parsed.
+			if (_write_line(stream, overlong ? NULL : line, newline) < 0)
+				return -1;
+			overlong = false;
+			line = newline + 1;
+		}
+
+		length = (size_t)(end - line);
+		if (length > STREAM_MAX_LINE) {
+			overlong = true;
+			length = 0;
+		} else {
+			memmove(input, line, length);
+		}
+
+		if (read == 0)
+			break;
+	}
+
+	if (ferror(in))
+		return -1;
+
+	// Last line without a trailing newline.
+	if (overlong || length > 0) {
+		if (_write_line(stream, overlong ? NULL : input, input + length) < 0)
+			return -1;
+	}
+
+	if (_writer_flush(&stream->writer) < 0 || fflush(stream->writer.stream) != 0)
+		return -1;
+
+	return 0;
+}
+
+int pe_addr_translate_stream(const pe_addr_table_t *table, pe_addr_translate_fn translate, pe_addr_format_fn format, FILE *in, FILE *out, size_t *invalid_count) {
+	*invalid_count = 0;
+
+	// Too big for the stack, and static buffers would be shared by concurrent calls.
+	_stream_t *stream = malloc(sizeof(*stream));
+	if (stream == NULL)
+		return -1;
+
+	stream->table = table;
+	stream->translate = translate;
+	stream->format = format;
+	stream->invalid_count = 0;
+	stream->writer.stream = out;
+	stream->writer.length = 0;
+
+	const int ret = _translate_stream(stream, in);
+	*invalid_count = stream->invalid_count;
+	free(stream);
+
+	return ret;
+}
@@ -0,0 +1,479 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_clr.c - Lazy decoder for .NET CLR (ECMA-335) metadata.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#include "pe_clr.h"
+#include "pe_read.h"
+#include "pe_tables.h"
+#include <string.h>
+
+#define METADATA_SIGNATURE		0x424a5342 // "BSJB"
+#define METADATA_MAX_VERSION	256
+#define STREAM_MAX_NAME			32
+
+// HeapSizes bits of the table stream header.
+#define HEAP_STRING_4	0x01
+#define HEAP_GUID_4		0x02
+#define HEAP_BLOB_4		0x04
+#define HEAP_EXTRA_DATA	0x40
+
+//
+// Table schema
+//
+// A column is described by a single byte:
+//   1..4		fixed-size value of that many bytes
+//   COL_STRING, COL_GUID, COL_BLOB		heap index
+//   COL_TABLE | t						index into table t
+//   COL_CODED | c						coded index of kind c
+//
+
+#define COL_STRING	0x10
+#define COL_GUID	0x11
+#define COL_BLOB	0x12
+#define COL_TABLE	0x40
+#define COL_CODED	0x80
+
+#define T(table)	(COL_TABLE | PE_CLR_TABLE_##table)
+#define C(coded)	(COL_CODED | CODED_##coded)
+
+typedef enum {
+	CODED_TYPEDEFORREF,
+	CODED_HASCONSTANT,
+	CODED_HASCUSTOMATTRIBUTE,
+	CODED_HASFIELDMARSHAL,
+	CODED_HASDECLSECURITY,
+	CODED_MEMBERREFPARENT,
+	CODED_HASSEMANTICS,
+	CODED_METHODDEFORREF,
+	CODED_MEMBERFORWARDED,
+	CODED_IMPLEMENTATION,
+	CODED_CUSTOMATTRIBUTETYPE,
+	CODED_RESOLUTIONSCOPE,
+	CODED_TYPEORMETHODDEF
+} coded_index_e;
+
+#define NONE 0xff // Tag values with no table behind them.
+
+static const struct {
+	uint8_t tag_bits;
+	uint8_t tables_count;
+	uint8_t tables[22];
+} coded_indexes[] = {
+	[CODED_TYPEDEFORREF]		= { 2, 3, { PE_CLR_TABLE_TYPEDEF, PE_CLR_TABLE_TYPEREF, PE_CLR_TABLE_TYPESPEC } },
+	[CODED_HASCONSTANT]			= { 2, 3, { PE_CLR_TABLE_FIELD, PE_CLR_TABLE_PARAM, PE_CLR_TABLE_PROPERTY } },
+	[CODED_HASCUSTOMATTRIBUTE]	= { 5, 22, {
+		PE_CLR_TABLE_METHODDEF, PE_CLR_TABLE_FIELD, PE_CLR_TABLE_TYPEREF, PE_CLR_TABLE_TYPEDEF,
+		PE_CLR_TABLE_PARAM, PE_CLR_TABLE_INTERFACEIMPL, PE_CLR_TABLE_MEMBERREF, PE_CLR_TABLE_MODULE,
+		PE_CLR_TABLE_DECLSECURITY, PE_CLR_TABLE_PROPERTY, PE_CLR_TABLE_EVENT, PE_CLR_TABLE_STANDALONESIG,
+		PE_CLR_TABLE_MODULEREF, PE_CLR_TABLE_TYPESPEC, PE_CLR_TABLE_ASSEMBLY, PE_CLR_TABLE_ASSEMBLYREF,
+		PE_CLR_TABLE_FILE, PE_CLR_TABLE_EXPORTEDTYPE, PE_CLR_TABLE_MANIFESTRESOURCE, PE_CLR_TABLE_GENERICPARAM,
+		PE_CLR_TABLE_GENERICPARAMCONSTRAINT, PE_CLR_TABLE_METHODSPEC } },
+	[CODED_HASFIELDMARSHAL]		= { 1, 2, { PE_CLR_TABLE_FIELD, PE_CLR_TABLE_PARAM } },
+	[CODED_HASDECLSECURITY]		= { 2, 3, { PE_CLR_TABLE_TYPEDEF, PE_CLR_TABLE_METHODDEF, PE_CLR_TABLE_ASSEMBLY } },
+	[CODED_MEMBERREFPARENT]		= { 3, 5, { PE_CLR_TABLE_TYPEDEF, PE_CLR_TABLE_TYPEREF, PE_CLR_TABLE_MODULEREF, PE_CLR_TABLE_METHODDEF, PE_CLR_TABLE_TYPESPEC } },
+	[CODED_HASSEMANTICS]		= { 1, 2, { PE_CLR_TABLE_EVENT, PE_CLR_TABLE_PROPERTY } },
+	[CODED_METHODDEFORREF]		= { 1, 2, { PE_CLR_TABLE_METHODDEF, PE_CLR_TABLE_MEMBERREF } },
+	[CODED_MEMBERFORWARDED]		= { 1, 2, { PE_CLR_TABLE_FIELD, PE_CLR_TABLE_METHODDEF } },
+	[CODED_IMPLEMENTATION]		= { 2, 3, { PE_CLR_TABLE_FILE, PE_CLR_TABLE_ASSEMBLYREF, PE_CLR_TABLE_EXPORTEDTYPE } },
+	[CODED_CUSTOMATTRIBUTETYPE]	= { 3, 5, { NONE, NONE, PE_CLR_TABLE_METHODDEF, PE_CLR_TABLE_MEMBERREF, NONE } },
+	[CODED_RESOLUTIONSCOPE]		= { 2, 4, { PE_CLR_TABLE_MODULE, PE_CLR_TABLE_MODULEREF, PE_CLR_TABLE_ASSEMBLYREF, PE_CLR_TABLE_TYPEREF } },
+	[CODED_TYPEORMETHODDEF]		= { 1, 2, { PE_CLR_TABLE_TYPEDEF, PE_CLR_TABLE_METHODDEF } }
+};
+
+// ECMA-335 II.22, in table number order. Columns end at the first 0.
+static const struct {
+	const char *name;
+	uint8_t columns[PE_CLR_MAX_COLUMNS];
+} table_schemas[PE_CLR_KNOWN_TABLES] = {
+	[PE_CLR_TABLE_MODULE]					= { "Module",					{ 2, COL_STRING, COL_GUID, COL_GUID, COL_GUID } },
+	[PE_CLR_TABLE_TYPEREF]					= { "TypeRef",					{ C(RESOLUTIONSCOPE), COL_STRING, COL_STRING } },
+	[PE_CLR_TABLE_TYPEDEF]					= { "TypeDef",					{ 4, COL_STRING, COL_STRING, C(TYPEDEFORREF), T(FIELD), T(METHODDEF) } },
+	[PE_CLR_TABLE_FIELDPTR]					= { "FieldPtr",					{ T(FIELD) } },
+	[PE_CLR_TABLE_FIELD]					= { "Field",					{ 2, COL_STRING, COL_BLOB } },
+	[PE_CLR_TABLE_METHODPTR]				= { "MethodPtr",				{ T(METHODDEF) } },
+	[PE_CLR_TABLE_METHODDEF]				= { "MethodDef",				{ 4, 2, 2, COL_STRING, COL_BLOB, T(PARAM) } },
+	[PE_CLR_TABLE_PARAMPTR]					= { "ParamPtr",					{ T(PARAM) } },
+	[PE_CLR_TABLE_PARAM]					= { "Param",					{ 2, 2, COL_STRING } },
+	[PE_CLR_TABLE_INTERFACEIMPL]			= { "InterfaceImpl",			{ T(TYPEDEF), C(TYPEDEFORREF) } },
+	[PE_CLR_TABLE_MEMBERREF]				= { "MemberRef",				{ C(MEMBERREFPARENT), COL_STRING, COL_BLOB } },
+	[PE_CLR_TABLE_CONSTANT]					= { "Constant",					{ 2, C(HASCONSTANT), COL_BLOB } }, // Type byte + padding byte
+	[PE_CLR_TABLE_CUSTOMATTRIBUTE]			= { "CustomAttribute",			{ C(HASCUSTOMATTRIBUTE), C(CUSTOMATTRIBUTETYPE), COL_BLOB } },
+	[PE_CLR_TABLE_FIELDMARSHAL]				= { "FieldMarshal",				{ C(HASFIELDMARSHAL), COL_BLOB } },
+	[PE_CLR_TABLE_DECLSECURITY]				= { "DeclSecurity",				{ 2, C(HASDECLSECURITY), COL_BLOB } },
+	[PE_CLR_TABLE_CLASSLAYOUT]				= { "ClassLayout",				{ 2, 4, T(TYPEDEF) } },
+	[PE_CLR_TABLE_FIELDLAYOUT]				= { "FieldLayout",				{ 4, T(FIELD) } },
+	[PE_CLR_TABLE_STANDALONESIG]			= { "StandAloneSig",			{ COL_BLOB } },
+	[PE_CLR_TABLE_EVENTMAP]					= { "EventMap",					{ T(TYPEDEF), T(EVENT) } },
+	[PE_CLR_TABLE_EVENTPTR]					= { "EventPtr",					{ T(EVENT) } },
+	[PE_CLR_TABLE_EVENT]					= { "Event",					{ 2, COL_STRING, C(TYPEDEFORREF) } },
+	[PE_CLR_TABLE_PROPERTYMAP]				= { "PropertyMap",				{ T(TYPEDEF), T(PROPERTY) } },
+	[PE_CLR_TABLE_PROPERTYPTR]				= { "PropertyPtr",				{ T(PROPERTY) } },
+	[PE_CLR_TABLE_PROPERTY]					= { "Property",					{ 2, COL_STRING, COL_BLOB } },
+	[PE_CLR_TABLE_METHODSEMANTICS]			= { "MethodSemantics",			{ 2, T(METHODDEF), C(HASSEMANTICS) } },
+	[PE_CLR_TABLE_METHODIMPL]				= { "MethodImpl",				{ T(TYPEDEF), C(METHODDEFORREF), C(METHODDEFORREF) } },
+	[PE_CLR_TABLE_MODULEREF]				= { "ModuleRef",				{ COL_STRING } },
+	[PE_CLR_TABLE_TYPESPEC]					= { "TypeSpec",					{ COL_BLOB } },
+	[PE_CLR_TABLE_IMPLMAP]					= { "ImplMap",					{ 2, C(MEMBERFORWARDED), COL_STRING, T(MODULEREF) } },
+	[PE_CLR_TABLE_FIELDRVA]					= { "FieldRVA",					{ 4, T(FIELD) } },
+	[PE_CLR_TABLE_ENCLOG]					= { "EncLog",					{ 4, 4 } },
+	[PE_CLR_TABLE_ENCMAP]					= { "EncMap",					{ 4 } },
+	[PE_CLR_TABLE_ASSEMBLY]					= { "Assembly",					{ 4, 2, 2, 2, 2, 4, COL_BLOB, COL_STRING, COL_STRING } },
+	[PE_CLR_TABLE_ASSEMBLYPROCESSOR]		= { "AssemblyProcessor",		{ 4 } },
+	[PE_CLR_TABLE_ASSEMBLYOS]				= { "AssemblyOS",				{ 4, 4, 4 } },
+	[PE_CLR_TABLE_ASSEMBLYREF]				= { "AssemblyRef",				{ 2, 2, 2, 2, 4, COL_BLOB, COL_STRING, COL_STRING, COL_BLOB } },
+	[PE_CLR_TABLE_ASSEMBLYREFPROCESSOR]		= { "AssemblyRefProcessor",		{ 4, T(ASSEMBLYREF) } },
+	[PE_CLR_TABLE_ASSEMBLYREFOS]			= { "AssemblyRefOS",			{ 4, 4, 4, T(ASSEMBLYREF) } },
+	[PE_CLR_TABLE_FILE]						= { "File",						{ 4, COL_STRING, COL_BLOB } },
+	[PE_CLR_TABLE_EXPORTEDTYPE]				= { "ExportedType",				{ 4, 4, COL_STRING, COL_STRING, C(IMPLEMENTATION) } },
+	[PE_CLR_TABLE_MANIFESTRESOURCE]			= { "ManifestResource",			{ 4, 4, COL_STRING, C(IMPLEMENTATION) } },
+	[PE_CLR_TABLE_NESTEDCLASS]				= { "NestedClass",				{ T(TYPEDEF), T(TYPEDEF) } },
+	[PE_CLR_TABLE_GENERICPARAM]				= { "GenericParam",				{ 2, 2, C(TYPEORMETHODDEF), COL_STRING } },
+	[PE_CLR_TABLE_METHODSPEC]				= { "MethodSpec",				{ C(METHODDEFORREF), COL_BLOB } },
+	[PE_CLR_TABLE_GENERICPARAMCONSTRAINT]	= { "GenericParamConstraint",	{ T(GENERICPARAM), C(TYPEDEFORREF) } }
+};
+
+#undef T
+#undef C
+
+//
+// Helpers
+//
+
+// Metadata is little-endian and has no alignment guarantees inside rows.
+static uint8_t _column_size(const pe_clr_t *clr, uint8_t column) {
+	if (column <= 4)
+		return column;
+
+	switch (column) {
+		case COL_STRING: return clr->heap_sizes & HEAP_STRING_4 ? 4 : 2;
+		case COL_GUID:   return clr->heap_sizes & HEAP_GUID_4 ? 4 : 2;
+		case COL_BLOB:   return clr->heap_sizes & HEAP_BLOB_4 ? 4 : 2;
+	}
+
+	if (column & COL_CODED) {
+		const unsigned kind = column & ~COL_CODED;
+		// A 2-byte coded index holds 16 - tag_bits bits of row number.
+		const uint32_t max_rows = 1u << (16 - coded_indexes[kind].tag_bits);
+		for (unsigned i = 0; i < coded_indexes[kind].tables_count; i++) {
+			const uint8_t table = coded_indexes[kind].tables[i];
+			if (table != NONE && clr->tables[table].rows >= max_rows)
+				return 4;
+		}
+		return 2;
+	}
+
+	return clr->tables[column & ~COL_TABLE].rows > 0xffff ? 4 : 2;
+}
+
+static const pe_clr_stream_t *_find_stream(const pe_clr_t *clr, const char *name) {
+	const unsigned count = clr->streams_count < PE_CLR_MAX_STREAMS ? clr->streams_count : PE_CLR_MAX_STREAMS;
+	for (unsigned i = 0; i < count; i++) {
+		if (clr->streams[i].data != NULL && strcmp(clr->streams[i].name, name) == 0)
+			return &clr->streams[i];
+	}
+	return NULL;
+}
+
+//
+// Parsing
+//
+
+static bool _parse_streams(pe_clr_t *clr) {
+	const uint8_t * const end = clr->metadata + clr->metadata_size;
+
+	// Signature, MajorVersion, MinorVersion, Reserved, Length
+	if (clr->metadata_size < 16 || pe_read_u32(clr->metadata) != METADATA_SIGNATURE)
+		return false;
+
+	clr->major_version = pe_read_u16(clr->metadata + 4);
+	clr->minor_version = pe_read_u16(clr->metadata + 6);
+	clr->version_length = pe_read_u32(clr->metadata + 12);
+	if (clr->version_length > METADATA_MAX_VERSION || clr->version_length > clr->metadata_size - 16)
+		return false;
+
+	clr->version = (const char *)clr->metadata + 16;
+	// Trailing NULs pad the version string to a multiple of 4.
+	const void *nul = memchr(clr->version, '\0', clr->version_length);
+	const uint32_t padded_length = (clr->version_length + 3) & ~3u;
+	if (nul != NULL)
+		clr->version_length = (uint32_t)((const char *)nul - clr->version);
+
+	// Flags, Streams
+	const uint8_t *p = clr->metadata + 16 + padded_length;
+	if (p + 4 > end)
+		return false;
+
+	clr->streams_count = pe_read_u16(p + 2);
+	p += 4;
+
+	for (unsigned i = 0; i < clr->streams_count && i < PE_CLR_MAX_STREAMS; i++) {
+		if (p + 8 >= end)
+			break;
+
+		pe_clr_stream_t *stream = &clr->streams[i];
+		stream->offset = pe_read_u32(p);
+		stream->size = pe_read_u32(p + 4);
+
+		const size_t name_limit = (size_t)(end - (p + 8)) < STREAM_MAX_NAME ? (size_t)(end - (p + 8)) : STREAM_MAX_NAME;
+		const char *name = memchr(p + 8, '\0', name_limit);
+		if (name == NULL)
+			break;
+
+		stream->name = (const char *)p + 8;
+		// Names are NUL-terminated and padded to a multiple of 4.
+		p += 8 + ((name - stream->name + 1 + 3) & ~3);
+
+		if (stream->offset <= clr->metadata_size && stream->size <= clr->metadata_size - stream->offset)
+			stream->data = clr->metadata + stream->offset;
+	}
+
+	clr->strings = _find_stream(clr, "#Strings");
+	clr->user_strings = _find_stream(clr, "#US");
+	clr->guids = _find_stream(clr, "#GUID");
+	clr->blobs = _find_stream(clr, "#Blob");
+	clr->tables_stream = _find_stream(clr, "#~");
+	if (clr->tables_stream == NULL)
+		clr->tables_stream = _find_stream(clr, "#-");
+
+	return true;
+}
+
+static void _parse_tables(pe_clr_t *clr) {
+	const pe_clr_stream_t *stream = clr->tables_stream;
+	if (stream == NULL || stream->size < 24)
+		return;
+
+	const uint8_t *p = stream->data;
+	const uint8_t * const end = stream->data + stream->size;
+
+	clr->tables_major_version = p[4];
+	clr->tables_minor_version = p[5];
+	clr->heap_sizes = p[6];
+	clr->valid = pe_read_u64(p + 8);
+	clr->sorted = pe_read_u64(p + 16);
+	p += 24;
+
+	// One row count for every table present, in table number order.
+	for (unsigned i = 0; i < PE_CLR_MAX_TABLES; i++) {
+		if (!(clr->valid & ((uint64_t)1 << i)))
+			continue;
+		if (p + 4 > end)
+			return;
+		clr->tables[i].rows = pe_read_u32(p);
+		p += 4;
+	}
+
+	if (clr->heap_sizes & HEAP_EXTRA_DATA)
+		p += 4;
+
+	// Index sizes depend on the row counts of every table, so the layouts
+	// can only be computed once all counts are known.
+	for (unsigned i = 0; i < PE_CLR_KNOWN_TABLES; i++) {
+		pe_clr_table_t *table = &clr->tables[i];
+		table->name = table_schemas[i].name;
+
+		uint32_t offset = 0;
+		for (unsigned c = 0; c < PE_CLR_MAX_COLUMNS && table_schemas[i].columns[c] != 0; c++) {
+			const uint8_t size = _column_size(clr, table_schemas[i].columns[c]);
+			table->column_offsets[c] = (uint8_t)offset;
+			table->column_sizes[c] = size;
+			table->columns_count = (uint8_t)(c + 1);
+			offset += size;
+		}
+		table->row_size = offset;
+	}
+
+	// Tables are stored back to back. Tables past the first unknown or
+	// truncated one can't be located, so they are left without data.
+	for (unsigned i = 0; i < PE_CLR_MAX_TABLES; i++) {
+		pe_clr_table_t *table = &clr->tables[i];
+		if (table->rows == 0)
+			continue;
+		if (i >= PE_CLR_KNOWN_TABLES)
+			return;
+
+		const uint64_t size = (uint64_t)table->rows * table->row_size;
+		if (p > end || size > (uint64_t)(end - p))
+			return;
+
+		table->data = p;
+		p += size;
+	}
+}
+
+bool pe_clr_init(pe_clr_t *clr, pe_ctx_t *ctx) {
+	memset(clr, 0, sizeof(*clr));
+	clr->ctx = ctx;
+
+	const IMAGE_DATA_DIRECTORY *directory = pe_tables_directory(ctx, IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR);
+	if (directory == NULL)
+		return false;
+
+	clr->header = pe_tables_ptr_at_rva(ctx, directory->VirtualAddress, sizeof(PEV_IMAGE_COR20_HEADER));
+	if (clr->header == NULL)
+		return false;
+
+	clr->metadata_size = clr->header->MetaData.Size;
+	clr->metadata = pe_tables_ptr_at_rva(ctx, clr->header->MetaData.VirtualAddress, clr->metadata_size);
+	if (clr->metadata == NULL || !_parse_streams(clr))
+		return false;
+
+	_parse_tables(clr);
+
+	return true;
+}
+
+//
+// Rows
+//
+
+uint32_t pe_clr_rows(const pe_clr_t *clr, pe_clr_table_e table) {
+	if ((unsigned)table >= PE_CLR_MAX_TABLES || clr->tables[table].data == NULL)
+		return 0;
+	return clr->tables[table].rows;
+}
+
+const uint8_t *pe_clr_row(const pe_clr_t *clr, pe_clr_table_e table, uint32_t rid) {
+	if (rid == 0 || rid > pe_clr_rows(clr, table))
+		return NULL;
+	return clr->tables[table].data + (size_t)(rid - 1) * clr->tables[table].row_size;
+}
+
+uint32_t pe_clr_column(const pe_clr_t *clr, pe_clr_table_e table, const uint8_t *row, unsigned column) {
+	const pe_clr_table_t *t = &clr->tables[table];
+	if (row == NULL || column >= t->columns_count)
+		return 0;
+
+	const uint8_t *p = row + t->column_offsets[column];
+	return t->column_sizes[column] == 4 ? pe_read_u32(p) : pe_read_u16(p);
+}
+
+//
+// Heaps
+//
+
+const char *pe_clr_string(const pe_clr_t *clr, uint32_t index) {
+	if (clr->strings == NULL || index >= clr->strings->size)
+		return NULL;
+
+	const char *str = (const char *)clr->strings->data + index;
+	return memchr(str, '\0', clr->strings->size - index) != NULL ? str : NULL;
+}
+
+const uint8_t *pe_clr_guid(const pe_clr_t *clr, uint32_t index) {
+	// GUID indexes are 1-based and count 16-byte entries.
+	if (clr->guids == NULL || index == 0 || index > clr->guids->size / 16)
+		return NULL;
+	return clr->guids->data + (size_t)(index - 1) * 16;
+}
+
+const uint8_t *pe_clr_blob(const pe_clr_t *clr, uint32_t index, uint32_t *size) {
+	*size = 0;
+	if (clr->blobs == NULL || index >= clr->blobs->size)
+		return NULL;
+
+	const uint8_t *p = clr->blobs->data + index;
+	const uint32_t available = clr->blobs->size - index;
+	uint32_t length, header;
+
+	// Compressed length, ECMA-335 II.24.2.4.
+	if ((p[0] & 0x80) == 0) {
+		header = 1;
+		length = p[0];
+	} else if ((p[0] & 0xc0) == 0x80) {
+		header = 2;
+		if (available < header)
+			return NULL;
+		length = ((uint32_t)(p[0] & 0x3f) << 8) | p[1];
+	} else if ((p[0] & 0xe0) == 0xc0) {
+		header = 4;
+		if (available < header)
+			return NULL;
+		length = ((uint32_t)(p[0] & 0x1f) << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+	} else {
+		return NULL;
+	}
+
+	if (length > available - header)
+		return NULL;
+
+	*size = length;
+	return p + header;
+}
+
+//
+// Decoded rows
+//
+
+static bool _assembly_from_row(const pe_clr_t *clr, pe_clr_table_e table, const uint8_t *row, unsigned first, pe_clr_assembly_t *assembly) {
+	memset(assembly, 0, sizeof(*assembly));
+	if (row == NULL)
+		return false;
+
+	assembly->major_version = (uint16_t)pe_clr_column(clr, table, row, first);
+	assembly->minor_version = (uint16_t)pe_clr_column(clr, table, row, first + 1);
+	assembly->build_number = (uint16_t)pe_clr_column(clr, table, row, first + 2);
+	assembly->revision_number = (uint16_t)pe_clr_column(clr, table, row, first + 3);
+	assembly->flags = pe_clr_column(clr, table, row, first + 4);
+	assembly->public_key = pe_clr_blob(clr, pe_clr_column(clr, table, row, first + 5), &assembly->public_key_size);
+	assembly->name = pe_clr_string(clr, pe_clr_column(clr, table, row, first + 6));
+	assembly->culture = pe_clr_string(clr, pe_clr_column(clr, table, row, first + 7));
+
+	return true;
+}
+
+bool pe_clr_assembly(const pe_clr_t *clr, pe_clr_assembly_t *assembly) {
+	// Assembly starts with HashAlgId, then shares AssemblyRef's layout.
+	return _assembly_from_row(clr, PE_CLR_TABLE_ASSEMBLY, pe_clr_row(clr, PE_CLR_TABLE_ASSEMBLY, 1), 1, assembly);
+}
+
+bool pe_clr_assembly_ref(const pe_clr_t *clr, uint32_t rid, pe_clr_assembly_t *assembly) {
+	return _assembly_from_row(clr, PE_CLR_TABLE_ASSEMBLYREF, pe_clr_row(clr, PE_CLR_TABLE_ASSEMBLYREF, rid), 0, assembly);
+}
+
+bool pe_clr_typedef(const pe_clr_t *clr, uint32_t rid, pe_clr_type_t *type) {
+	memset(type, 0, sizeof(*type));
+
+	const uint8_t *row = pe_clr_row(clr, PE_CLR_TABLE_TYPEDEF, rid);
+	if (row == NULL)
+		return false;
+
+	type->flags = pe_clr_column(clr, PE_CLR_TABLE_TYPEDEF, row, 0);
+	type->name = pe_clr_string(clr, pe_clr_column(clr, PE_CLR_TABLE_TYPEDEF, row, 1));
+	type->namespace_ = pe_clr_string(clr, pe_clr_column(clr, PE_CLR_TABLE_TYPEDEF, row, 2));
+
+	return true;
+}
@@ -0,0 +1,274 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_map.c - Sorted interval index of the regions of a PE file.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+
+#include "pe_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIZEOF_PE_SIGNATURE	4
+
+int pe_map_add(pe_map_t *map, pe_map_region_kind_e kind, uint8_t level, uint64_t start, uint64_t end, uint32_t index, const char *name) {
+	if (end <= start)
+		return 0;
+
+	if (map->count == map->capacity) {
+		const size_t capacity = map->capacity ? map->capacity * 2 : 32;
+		pe_map_region_t *regions = realloc(map->regions, capacity * sizeof(*regions));
+		if (regions == NULL)
+			return -1;
+		map->regions = regions;
+		map->capacity = capacity;
+	}
+
+	pe_map_region_t *region = &map->regions[map->count++];
+	memset(region, 0, sizeof(*region));
+	region->start = start;
+	region->end = end;
+	region->kind = kind;
+	region->level = level;
+	region->index = index;
+	snprintf(region->name, sizeof(region->name), "%s", name);
+
+	return 0;
+}
+
+static int _compare_regions(const void *a, const void *b) {
+	const pe_map_region_t *ra = a;
+	const pe_map_region_t *rb = b;
+
+	// By start, then outermost first.
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	if (ra->level != rb->level)
+		return ra->level < rb->level ? -1 : 1;
+	if (ra->end != rb->end)
+		return ra->end > rb->end ? -1 : 1;
+	return 0;
+}
+
+// The sorted regions are an implicit balanced binary tree: the node of
+// [lo, hi) is the middle one, and each half is a subtree. max_end[] holds
+// the furthest end within each node's subtree.
+static uint64_t _index_subtree(pe_map_t *map, size_t lo, size_t hi) {
+	if (lo >= hi)
+		return 0;
+
+	const size_t mid = lo + (hi - lo) / 2;
+	uint64_t max_end = map->regions[mid].end;
+	const uint64_t left = _index_subtree(map, lo, mid);
+	const uint64_t right = _index_subtree(map, mid + 1, hi);
+	if (left > max_end)
+		max_end = left;
+	if (right > max_end)
+		max_end = right;
+
+	map->max_end[mid] = max_end;
+	return max_end;
+}
+
+int pe_map_index(pe_map_t *map) {
+	if (map->count == 0)
+		return 0;
+
+	qsort(map->regions, map->count, sizeof(*map->regions), _compare_regions);
+
+	uint64_t *max_end = realloc(map->max_end, map->count * sizeof(*max_end));
+	if (max_end == NULL)
+		return -1;
+	map->max_end = max_end;
+
+	// The region reaching furthest so far, per level.
+	pe_map_region_t *furthest[PE_MAP_LEVEL_NESTED + 1] = { NULL };
+
+	_index_subtree(map, 0, map->count);
+
+	for (size_t i = 0; i < map->count; i++) {
+		pe_map_region_t *region = &map->regions[i];
+		region->overlaps = false;
+		const uint8_t level = region->level > PE_MAP_LEVEL_NESTED ? PE_MAP_LEVEL_NESTED : region->level;
+		pe_map_region_t *previous = furthest[level];
+		if (previous != NULL && region->start < previous->end) {
+			previous->overlaps = true;
+			region->overlaps = true;
+		}
+		if (previous == NULL || region->end > previous->end)
+			furthest[level] = region;
+	}
+
+	return 0;
+}
+
+// Visits the subtree of [lo, hi) in order, skipping the subtrees that end
+// before `offset` and those that start after it.
+static void _find_in_subtree(const pe_map_t *map, size_t lo, size_t hi, uint64_t offset, const pe_map_region_t **found, size_t max_found, size_t *count) {
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (map->max_end[mid] <= offset)
+			return;
+
+		_find_in_subtree(map, lo, mid, offset, found, max_found, count);
+
+		const pe_map_region_t *region = &map->regions[mid];
+		if (region->start > offset)
+			return;
+		if (region->end > offset) {
+			if (*count < max_found)
+				found[*count] = region;
+			(*count)++;
+		}
+
+		lo = mid + 1;
+	}
+}
+
+size_t pe_map_find(const pe_map_t *map, uint64_t offset, const pe_map_region_t **found, size_t max_found) {
+	// In order, which is outermost first.
+	size_t count = 0;
+	_find_in_subtree(map, 0, map->count, offset, found, max_found, &count);
+	return count;
+}
+
+void pe_map_destroy(pe_map_t *map) {
+	free(map->regions);
+	free(map->max_end);
+	memset(map, 0, sizeof(*map));
+}
+
+//
+// PE regions
+//
+
+static int _add_headers(pe_map_t *map, pe_ctx_t *ctx) {
+	const IMAGE_DOS_HEADER *dos = pe_dos(ctx);
+	const IMAGE_COFF_HEADER *coff = pe_coff(ctx);
+	const IMAGE_OPTIONAL_HEADER *optional = pe_optional(ctx);
+	if (dos == NULL || coff == NULL || optional == NULL)
+		return 0;
+
+	const uint64_t size_of_headers = optional->_32 != NULL
+		? optional->_32->SizeOfHeaders
+		: optional->_64 != NULL ? optional->_64->SizeOfHeaders : 0;
+
+	const uint64_t nt_start = dos->e_lfanew;
+	const uint64_t optional_start = nt_start + SIZEOF_PE_SIGNATURE + sizeof(IMAGE_COFF_HEADER);
+	const uint64_t sections_start = optional_start + coff->SizeOfOptionalHeader;
+	const uint64_t sections_end = sections_start + (uint64_t)pe_sections_count(ctx) * sizeof(IMAGE_SECTION_HEADER);
+
+	// Some packers put the section table past SizeOfHeaders.
+	const uint64_t headers_end = size_of_headers > sections_end ? size_of_headers : sections_end;
+
+	if (pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_TOP, 0, headers_end, 0, "Headers") < 0
+		|| pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_NESTED, 0, sizeof(IMAGE_DOS_HEADER), 0, "DOS header") < 0
+		|| pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_NESTED, sizeof(IMAGE_DOS_HEADER), nt_start, 0, "DOS stub") < 0
+		|| pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_NESTED, nt_start, optional_start, 0, "PE signature and COFF header") < 0
+		|| pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_NESTED, optional_start, sections_start, 0, "Optional header") < 0
+		|| pe_map_add(map, PE_MAP_REGION_HEADERS, PE_MAP_LEVEL_NESTED, sections_start, sections_end, 0, "Section table") < 0)
+		return -1;
+
+	return 0;
+}
+
+int pe_map_build(pe_map_t *map, pe_ctx_t *ctx) {
+	memset(map, 0, sizeof(*map));
+	map->file_size = pe_filesize(ctx);
+
+	if (_add_headers(map, ctx) < 0)
+		return -1;
+
+	// Sections, by raw data. The end of the last one is where the overlay starts.
+	uint64_t image_end = map->count > 0 ? map->regions[0].end : 0;
+
+	IMAGE_SECTION_HEADER **sections = pe_sections(ctx);
+	const uint16_t sections_count = pe_sections_count(ctx);
+	for (uint16_t i = 0; sections != NULL && i < sections_count; i++) {
+		const IMAGE_SECTION_HEADER *section = sections[i];
+		if (section->PointerToRawData == 0 || section->SizeOfRawData == 0)
+			continue;
+
+		char section_name[SECTION_NAME_SIZE + 1];
+		char name[PE_MAP_MAX_NAME];
+		snprintf(name, sizeof(name), "Section %s", pe_section_name(ctx, section, section_name, sizeof(section_name)));
+
+		const uint64_t start = section->PointerToRawData;
+		const uint64_t end = start + section->SizeOfRawData;
+		if (pe_map_add(map, PE_MAP_REGION_SECTION, PE_MAP_LEVEL_TOP, start, end, i, name) < 0)
+			return -1;
+
+		if (end > image_end)
+			image_end = end;
+	}
+
+	// Data directories. The certificate table is the only one whose
+	// address is a file offset; it lives outside the sections.
+	uint64_t certificate_start = 0, certificate_end = 0;
+
+	IMAGE_DATA_DIRECTORY **directories = pe_directories(ctx);
+	const uint32_t directories_count = pe_directories_count(ctx);
+	for (uint32_t i = 0; directories != NULL && i < directories_count && i < MAX_DIRECTORIES; i++) {
+		const IMAGE_DATA_DIRECTORY *directory = directories[i];
+		if (directory->VirtualAddress == 0 || directory->Size == 0)
+			continue;
+
+		if (i == IMAGE_DIRECTORY_ENTRY_SECURITY) {
+			certificate_start = directory->VirtualAddress;
+			certificate_end = certificate_start + directory->Size;
+			if (pe_map_add(map, PE_MAP_REGION_CERTIFICATE, PE_MAP_LEVEL_TOP, certificate_start, certificate_end, i, pe_directory_name(i)) < 0)
+				return -1;
+			continue;
+		}
+
+		const uint64_t start = pe_rva2ofs(ctx, directory->VirtualAddress);
+		if (start == 0)
+			continue;
+		if (pe_map_add(map, PE_MAP_REGION_DIRECTORY, PE_MAP_LEVEL_NESTED, start, start + directory->Size, i, pe_directory_name(i)) < 0)
+			return -1;
+	}
+
+	// Everything after the image is overlay, except the certificate table.
+	if (image_end < map->file_size) {
+		if (certificate_end > certificate_start && certificate_start >= image_end && certificate_start < map->file_size) {
+			if (pe_map_add(map, PE_MAP_REGION_OVERLAY, PE_MAP_LEVEL_TOP, image_end, certificate_start, 0, "Overlay") < 0
+				|| pe_map_add(map, PE_MAP_REGION_OVERLAY, PE_MAP_LEVEL_TOP, certificate_end, map->file_size, 0, "Overlay") < 0)
+				return -1;
+		} else if (pe_map_add(map, PE_MAP_REGION_OVERLAY, PE_MAP_LEVEL_TOP, image_end, map->file_size, 0, "Overlay") < 0) {
+			return -1;
+		}
+	}
+
+	return pe_map_index(map);
+}
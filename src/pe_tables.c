@@ -0,0 +1,413 @@
+/* vim: set ts=4 sw=4 noet: */
+/*
+	pev - the PE file analyzer toolkit
+
+	pe_tables.c - Streaming iterators over the PE import, export and relocation tables.
+
+	Copyright (C) 2020 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	In addition, as a special exception, the copyright holders give
+	permission to link the code of portions of this program with the
+	OpenSSL library under certain conditions as described in each
+	individual source file, and distribute linked combinations
+	including the two.
+
+	You must obey the GNU General Public License in all respects
+	for all of the code used other than OpenSSL.  If you modify
+	file(s) with this exception, you may extend this exception to your
+	version of the file(s), but you are not obligated to do so.  If you
+	do not wish to do so, delete this exception statement from your
+	version.  If you delete this exception statement from all source
+	files in the program, then also delete it here.
+*/
+
+#include "pe_read.h"
+#include "pe_tables.h"
+#include <string.h>
+
+//
+// Helpers
+//
+
+const void *pe_tables_ptr_at_rva(pe_ctx_t *ctx, uint64_t rva, size_t size) {
+	if (rva == 0)
+		return NULL;
+
+	const uint64_t ofs = pe_rva2ofs(ctx, rva);
+	if (ofs == 0 || ofs >= (uint64_t)ctx->map_size)
+		return NULL;
+
+	const void *ptr = LIBPE_PTR_ADD(ctx->map_addr, ofs);
+	if (!pe_can_read(ctx, ptr, size))
+		return NULL;
+
+	return ptr;
+}
+
+const char *pe_tables_string_at_rva(pe_ctx_t *ctx, uint64_t rva, size_t max_len) {
+	const char *str = pe_tables_ptr_at_rva(ctx, rva, 1);
+	if (str == NULL)
+		return NULL;
+
+	// Never scan past the end of the mapping, nor past `max_len`.
+	const size_t available = (size_t)(ctx->map_end - (uintptr_t)str);
+	const size_t limit = available < max_len ? available : max_len;
+
+	return memchr(str, '\0', limit) != NULL ? str : NULL;
+}
+
+const IMAGE_DATA_DIRECTORY *pe_tables_directory(pe_ctx_t *ctx, ImageDirectoryEntry entry) {
+	if (ctx->pe.num_directories == 0 || ctx->pe.num_directories > MAX_DIRECTORIES)
+		return NULL;
+
+	if ((uint32_t)entry >= ctx->pe.num_directories)
+		return NULL;
+
+	const IMAGE_DATA_DIRECTORY *directory = pe_directory_by_entry(ctx, entry);
+	if (directory == NULL || directory->VirtualAddress == 0 || directory->Size == 0)
+		return NULL;
+
+	return directory;
+}
+
+//
+// Imports
+//
+
+bool pe_import_iter_init(pe_import_iter_t *iter, pe_ctx_t *ctx) {
+	memset(iter, 0, sizeof(*iter));
+	iter->ctx = ctx;
+
+	const IMAGE_OPTIONAL_HEADER *optional_hdr = pe_optional(ctx);
+	if (optional_hdr == NULL)
+		return false;
+
+	iter->is_64 = optional_hdr->type == MAGIC_PE64;
+
+	const IMAGE_DATA_DIRECTORY *directory = pe_tables_directory(ctx, IMAGE_DIRECTORY_ENTRY_IMPORT);
+	if (directory == NULL)
+		return false;
+
+	iter->descriptor = pe_tables_ptr_at_rva(ctx, directory->VirtualAddress, sizeof(IMAGE_IMPORT_DESCRIPTOR));
+
+	return iter->descriptor != NULL;
+}
+
+bool pe_import_iter_next_dll(pe_import_iter_t *iter) {
+	const IMAGE_IMPORT_DESCRIPTOR *descriptor = iter->descriptor;
+
+	iter->dll_name = NULL;
+	iter->thunk = NULL;
+
+	if (descriptor == NULL || !pe_can_read(iter->ctx, descriptor, sizeof(*descriptor)))
+		return false;
+
+	// A zeroed descriptor terminates the table.
+	if (descriptor->u1.OriginalFirstThunk == 0 && descriptor->FirstThunk == 0)
+		return false;
+
+	iter->descriptor = descriptor + 1;
+	iter->dll_name = pe_tables_string_at_rva(iter->ctx, descriptor->Name, PE_TABLES_MAX_DLL_NAME);
+
+	// Prefer the unbound copy (INT), since the IAT may already be bound.
+	const uint32_t thunk_rva = descriptor->u1.OriginalFirstThunk != 0
+		? descriptor->u1.OriginalFirstThunk
+		: descriptor->FirstThunk;
+	const size_t thunk_size = iter->is_64 ? sizeof(IMAGE_THUNK_DATA64) : sizeof(IMAGE_THUNK_DATA32);
+	iter->thunk = pe_tables_ptr_at_rva(iter->ctx, thunk_rva, thunk_size);
+
+	return true;
+}
+
+bool pe_import_iter_next_function(pe_import_iter_t *iter, pe_import_entry_t *entry) {
+	if (iter->thunk == NULL)
+		return false;
+
+	uint64_t value;
+	bool is_ordinal;
+
+	if (iter->is_64) {
+		const IMAGE_THUNK_DATA64 *thunk = iter->thunk;
+		if (!pe_can_read(iter->ctx, thunk, sizeof(*thunk)))
+			return false;
+		value = thunk->u1.AddressOfData;
+		is_ordinal = (value & IMAGE_ORDINAL_FLAG64) != 0;
+		iter->thunk = thunk + 1;
+	} else {
+		const IMAGE_THUNK_DATA32 *thunk = iter->thunk;
+		if (!pe_can_read(iter->ctx, thunk, sizeof(*thunk)))
+			return false;
+		value = thunk->u1.AddressOfData;
+		is_ordinal = (value & IMAGE_ORDINAL_FLAG32) != 0;
+		iter->thunk = thunk + 1;
+	}
+
+	// A zeroed thunk terminates the list.
+	if (value == 0) {
+		iter->thunk = NULL;
+		return false;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+
+	if (is_ordinal) {
+		entry->ordinal = (uint16_t)(value & 0xffff);
+		return true;
+	}
+
+	// Bits 30-0 hold the RVA of the IMAGE_IMPORT_BY_NAME structure.
+	const uint64_t hint_rva = value & 0x7fffffff;
+	const IMAGE_IMPORT_BY_NAME *by_name = pe_tables_ptr_at_rva(iter->ctx, hint_rva, sizeof(uint16_t));
+	if (by_name != NULL) {
+		entry->hint = by_name->Hint;
+		entry->name = pe_tables_string_at_rva(iter->ctx, hint_rva + sizeof(uint16_t), PE_TABLES_MAX_FUNCTION_NAME);
+	}
+
+	return true;
+}
+
+//
+// Exports
+//
+
+// Maps every function in [window_start, window_start + PE_EXPORT_ITER_WINDOW)
+// to the first name that refers to it. This is a single pass over the name
+// ordinal table, so a DLL exporting N functions costs N / WINDOW passes
+// instead of one pass per function.
+static void _export_iter_fill_window(pe_export_iter_t *iter) {
+	iter->window_start = iter->index;
+	memset(iter->window, 0, sizeof(iter->window));
+
+	for (uint32_t i = 0; i < iter->names_count; i++) {
+		const uint32_t function_index = iter->ordinals[i];
+		if (function_index < iter->window_start)
+			continue;
+
+		const uint32_t slot = function_index - iter->window_start;
+		if (slot >= PE_EXPORT_ITER_WINDOW)
+			continue;
+
+		if (iter->window[slot] == 0)
+			iter->window[slot] = i + 1;
+	}
+}
+
+static void _export_fill_entry(const pe_export_iter_t *iter, uint32_t index, const char *name, pe_export_entry_t *entry) {
+	memset(entry, 0, sizeof(*entry));
+	entry->ordinal = iter->base + index;
+	entry->address = iter->functions[index];
+	entry->name = name;
+
+	if (entry->address >= iter->dir_rva && entry->address - iter->dir_rva < iter->dir_size)
+		entry->fwd_name = pe_tables_string_at_rva(iter->ctx, entry->address, PE_TABLES_MAX_FUNCTION_NAME);
+}
+
+bool pe_export_iter_init(pe_export_iter_t *iter, pe_ctx_t *ctx) {
+	memset(iter, 0, sizeof(*iter));
+	iter->ctx = ctx;
+
+	const IMAGE_DATA_DIRECTORY *directory = pe_tables_directory(ctx, IMAGE_DIRECTORY_ENTRY_EXPORT);
+	if (directory == NULL)
+		return false;
+
+	const IMAGE_EXPORT_DIRECTORY *exp = pe_tables_ptr_at_rva(ctx, directory->VirtualAddress, sizeof(IMAGE_EXPORT_DIRECTORY));
+	if (exp == NULL)
+		return false;
+
+	iter->dir_rva = directory->VirtualAddress;
+	iter->dir_size = directory->Size;
+	iter->base = exp->Base;
+	iter->dll_name = pe_tables_string_at_rva(ctx, exp->Name, PE_TABLES_MAX_DLL_NAME);
+
+	if (exp->NumberOfFunctions == 0)
+		return true;
+
+	iter->functions = pe_tables_ptr_at_rva(ctx, exp->AddressOfFunctions, (size_t)exp->NumberOfFunctions * sizeof(uint32_t));
+	if (iter->functions == NULL)
+		return false;
+
+	iter->functions_count = exp->NumberOfFunctions;
+
+	if (exp->NumberOfNames != 0) {
+		iter->names = pe_tables_ptr_at_rva(ctx, exp->AddressOfNames, (size_t)exp->NumberOfNames * sizeof(uint32_t));
+		iter->ordinals = pe_tables_ptr_at_rva(ctx, exp->AddressOfNameOrdinals, (size_t)exp->NumberOfNames * sizeof(uint16_t));
+		// Without both tables, every function is reported as exported by ordinal.
+		if (iter->names != NULL && iter->ordinals != NULL)
+			iter->names_count = exp->NumberOfNames;
+	}
+
+	_export_iter_fill_window(iter);
+
+	return true;
+}
+
+bool pe_export_iter_next(pe_export_iter_t *iter, pe_export_entry_t *entry) {
+	if (iter->index >= iter->functions_count)
+		return false;
+
+	if (iter->index - iter->window_start >= PE_EXPORT_ITER_WINDOW)
+		_export_iter_fill_window(iter);
+
+	const uint32_t index = iter->index++;
+	const uint32_t name_slot = iter->window[index - iter->window_start];
+	const char *name = name_slot != 0
+		? pe_tables_string_at_rva(iter->ctx, iter->names[name_slot - 1], PE_TABLES_MAX_FUNCTION_NAME)
+		: NULL;
+
+	_export_fill_entry(iter, index, name, entry);
+
+	return true;
+}
+
+bool pe_export_lookup_name(const pe_export_iter_t *iter, const char *name, pe_export_entry_t *entry) {
+	uint32_t lo = 0;
+	uint32_t hi = iter->names_count;
+
+	while (lo < hi) {
+		const uint32_t mid = lo + (hi - lo) / 2;
+		const char *mid_name = pe_tables_string_at_rva(iter->ctx, iter->names[mid], PE_TABLES_MAX_FUNCTION_NAME);
+		// An unreadable name breaks the ordering, so there's nothing left to search.
+		if (mid_name == NULL)
+			return false;
+
+		const int cmp = strcmp(name, mid_name);
+		if (cmp == 0) {
+			const uint32_t index = iter->ordinals[mid];
+			if (index >= iter->functions_count)
+				return false;
+			_export_fill_entry(iter, index, mid_name, entry);
+			return true;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return false;
+}
+
+bool pe_export_lookup_ordinal(const pe_export_iter_t *iter, uint32_t ordinal, pe_export_entry_t *entry) {
+	if (ordinal < iter->base)
+		return false;
+
+	const uint32_t index = ordinal - iter->base;
+	if (index >= iter->functions_count || iter->functions[index] == 0)
+		return false;
+
+	// Names are indexed by name, not by ordinal, so finding the name of
+	// a given ordinal takes a scan of the name ordinal table.
+	const char *name = NULL;
+	for (uint32_t i = 0; i < iter->names_count; i++) {
+		if (iter->ordinals[i] == index) {
+			name = pe_tables_string_at_rva(iter->ctx, iter->names[i], PE_TABLES_MAX_FUNCTION_NAME);
+			break;
+		}
+	}
+
+	_export_fill_entry(iter, index, name, entry);
+
+	return true;
+}
+
+//
+// Base relocations
+//
+
+#define RELOC_BLOCK_HEADER_SIZE	8	// VirtualAddress, SizeOfBlock
+#define RELOC_TYPE_HIGHADJ		4
+
+bool pe_reloc_iter_init(pe_reloc_iter_t *iter, pe_ctx_t *ctx) {
+	memset(iter, 0, sizeof(*iter));
+	iter->ctx = ctx;
+
+	const IMAGE_DATA_DIRECTORY *directory = pe_tables_directory(ctx, IMAGE_DIRECTORY_ENTRY_BASERELOC);
+	if (directory == NULL)
+		return false;
+
+	iter->block = pe_tables_ptr_at_rva(ctx, directory->VirtualAddress, RELOC_BLOCK_HEADER_SIZE);
+	if (iter->block == NULL)
+		return false;
+
+	// A directory running past the end of the file is decoded up to there.
+	const size_t available = (size_t)(ctx->map_end - (uintptr_t)iter->block);
+	iter->end = iter->block + (directory->Size < available ? directory->Size : available);
+
+	return true;
+}
+
+bool pe_reloc_iter_next_block(pe_reloc_iter_t *iter, pe_reloc_block_t *block) {
+	iter->entry = iter->entries_end = NULL;
+
+	if (iter->block == NULL || (size_t)(iter->end - iter->block) < RELOC_BLOCK_HEADER_SIZE)
+		return false;
+
+	const uint32_t page_rva = pe_read_u32(iter->block);
+	const uint32_t size = pe_read_u32(iter->block + 4);
+
+	// Some linkers pad the directory with a zeroed block.
+	if (page_rva == 0 && size == 0)
+		return false;
+
+	if (size < RELOC_BLOCK_HEADER_SIZE || size > (size_t)(iter->end - iter->block)) {
+		iter->malformed = true;
+		return false;
+	}
+
+	iter->page_rva = page_rva;
+	iter->entry = iter->block + RELOC_BLOCK_HEADER_SIZE;
+	// An odd SizeOfBlock leaves a trailing byte that isn't an entry.
+	iter->entries_end = iter->entry + ((size - RELOC_BLOCK_HEADER_SIZE) & ~1u);
+	iter->block += size;
+
+	block->page_rva = page_rva;
+	block->size = size;
+
+	return true;
+}
+
+bool pe_reloc_iter_next_entry(pe_reloc_iter_t *iter, pe_reloc_entry_t *entry) {
+	if (iter->entry == NULL || iter->entry >= iter->entries_end)
+		return false;
+
+	const uint16_t value = pe_read_u16(iter->entry);
+	iter->entry += 2;
+
+	entry->type = (uint8_t)(value >> 12);
+	entry->offset = value & 0x0fff;
+	entry->rva = iter->page_rva + entry->offset;
+	entry->param = 0;
+
+	// HIGHADJ entries take the next slot for the low 16 bits of the target.
+	if (entry->type == RELOC_TYPE_HIGHADJ && iter->entry < iter->entries_end) {
+		entry->param = pe_read_u16(iter->entry);
+		iter->entry += 2;
+	}
+
+	return true;
+}
+
+const char *pe_reloc_type_name(uint8_t type) {
+	// Types 5, 7, 8 and 9 are machine-specific; the names below are the
+	// most common meaning.
+	static const char * const names[16] = {
+		"ABSOLUTE", "HIGH", "LOW", "HIGHLOW", "HIGHADJ", "MACHINE_SPECIFIC_5", "RESERVED",
+		"MACHINE_SPECIFIC_7", "MACHINE_SPECIFIC_8", "MACHINE_SPECIFIC_9", "DIR64"
+	};
+
+	return type < 16 && names[type] != NULL ? names[type] : "UNKNOWN";
+}
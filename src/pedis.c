@@ -70,6 +70,8 @@ static void usage(void)
 		" --att									 Set AT&T assembly syntax (default: Intel).\n"
 		" -e, --entrypoint						 Disassemble the entire entrypoint function.\n"
 		" -f, --format <%s>  Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -m, --mode <16|32|64>					 Disassembly mode (default: auto).\n"
 		" -i <number>							 Number of instructions to disassemble.\n"
 		" -n <number>							 Number of bytes to disassemble\n"
@@ -106,6 +108,8 @@ static options_t *parse_options(int argc, char *argv[])
 		{ "rva",			  required_argument, NULL, 'r' },
 		{ "section",		  required_argument, NULL, 's' },
 		{ "format",			  required_argument, NULL, 'f' },
+		{ "fields",			  required_argument, NULL,  3  },
+		{ "compress",		  required_argument, NULL,  4  },
 		{ "version",		  no_argument,		 NULL, 'V' },
 		{ NULL,				  0,				 NULL,	0  }
 	};
@@ -176,9 +180,17 @@ static options_t *parse_options(int argc, char *argv[])
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 3: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 4: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			default:
 				fprintf(stderr, "%s: try '--help' for more information\n", PROGRAM);
 				exit(EXIT_FAILURE);
@@ -405,7 +417,7 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	ud_set_syntax(&ud_obj, options->syntax ? UD_SYN_ATT : UD_SYN_INTEL);
 	ud_set_input_buffer(&ud_obj, ctx.map_addr, pe_filesize(&ctx));
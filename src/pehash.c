@@ -65,6 +65,8 @@ static void usage(void)
 		"\nExample: %s -s '.text' winzip.exe\n"
 		"\nOptions:\n"
 		" -f, --format <%s> Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -a, --all								Hash file, sections and headers with md5, sha1, sha256, ssdeep and imphash.\n"
 		" -c, --content							Hash only the file content (default).\n"
 		" -h, --header <dos|coff|optional>		Hash only the header with the specified name.\n"
@@ -105,6 +107,8 @@ static options_t *parse_options(int argc, char *argv[])
 	static const struct option long_options[] = {
 		{ "help",		   no_argument,			NULL,  1  },
 		{ "format",		   required_argument,	NULL, 'f' },
+		{ "fields",		   required_argument,	NULL,  3  },
+		{ "compress",	   required_argument,	NULL,  4  },
 		{ "all",		   no_argument,			NULL, 'a' },
 		{ "content",	   no_argument,			NULL, 'c' },
 		{ "header",		   required_argument,	NULL, 'h' },
@@ -129,9 +133,17 @@ static options_t *parse_options(int argc, char *argv[])
 				usage();
 				exit(EXIT_SUCCESS);
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 3: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 4: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			case 'a':
 				options->all = true;
 				break;
@@ -182,6 +194,8 @@ static void print_basic_hash(const unsigned char *data, size_t data_size)
 	char *hash_value = malloc_s(hash_value_size);
 
 	for (size_t i=0; i < sizeof(basic_hashes) / sizeof(char *); i++) {
+		if (!output_wants(basic_hashes[i]))
+			continue;
 		pe_hash_raw_data(hash_value, hash_value_size, basic_hashes[i], data, data_size);
 		output(basic_hashes[i], hash_value);
 	}
@@ -230,7 +244,7 @@ int main(int argc, char *argv[])
 	data = ctx.map_addr;
 	data_size = pe_filesize(&ctx);
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	if (options->headers.all || options->headers.dos || options->headers.coff || options->headers.optional ||
 		options->sections.name || options->sections.index) {
@@ -254,8 +268,9 @@ int main(int argc, char *argv[])
 		// output("imphash (Mandiant)", imphash);
 		// free(imphash);
 
-		imphash = pe_imphash(&ctx, LIBPE_IMPHASH_FLAVOR_PEFILE);
-		
+		if (output_wants("imphash"))
+			imphash = pe_imphash(&ctx, LIBPE_IMPHASH_FLAVOR_PEFILE);
+
 		if (imphash) {
 			output("imphash", imphash);
 			free(imphash);
@@ -36,19 +36,45 @@
 
 #include "common.h"
 #include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "output.h"
+#include "hashtable.h"
+#include "pe_tables.h"
 
 #define PROGRAM "peldd"
 
+#define MAX_SEARCH_PATHS	32
+#define MAX_JOBS			64
+
+typedef struct {
+	bool recursive;
+	bool flat;
+	bool verify;
+	unsigned jobs;
+	const char *search_paths[MAX_SEARCH_PATHS];
+	size_t search_paths_count;
+} options_t;
+
+static options_t g_options;
+
 static void usage(void)
 {
 	static char formats[255];
 	output_available_formats(formats, sizeof(formats), '|');
 	printf("Usage: %s FILE\n"
 		"Display PE library dependencies\n"
-		"\nExample: %s winzip.exe\n"
+		"\nExample: %s -r -s /mnt/windows/System32 winzip.exe\n"
 		"\nOptions:\n"
 		" -f, --format <%s>  Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
+		" -r, --recursive						 Resolve dependencies recursively.\n"
+		" -s, --search-path <dir>				 Directory where to look for DLLs. It can be used multiple times.\n"
+		" --flat								 Show recursive dependencies as a flat list instead of a tree.\n"
+		" --verify								 Check that imported functions are exported by the resolved DLLs. Implies -r.\n"
+		" -j, --jobs <n>						 Number of threads parsing DLLs (default: number of CPUs).\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show help.\n",
 		PROGRAM, PROGRAM, formats);
@@ -57,17 +83,26 @@ static void usage(void)
 static void parse_options(int argc, char *argv[])
 {
 	/* Parameters for getopt_long() function */
-	static const char short_options[] = "Vf:";
+	static const char short_options[] = "Vf:rs:j:";
 
 	static const struct option long_options[] = {
 		{ "help",			  no_argument,		 NULL,	1  },
 		{ "format",			  required_argument, NULL, 'f' },
+		{ "fields",			  required_argument, NULL,  4  },
+		{ "compress",		  required_argument, NULL,  5  },
+		{ "recursive",		  no_argument,		 NULL, 'r' },
+		{ "search-path",	  required_argument, NULL, 's' },
+		{ "flat",			  no_argument,		 NULL,	2  },
+		{ "jobs",			  required_argument, NULL, 'j' },
+		{ "verify",			  no_argument,		 NULL,	3  },
 		{ "version",		  no_argument,		 NULL, 'V' },
 		{  NULL,			  0,				 NULL,	0  }
 	};
 
 	int c, ind;
 
+	memset(&g_options, 0, sizeof(g_options));
+
 	while ((c = getopt_long(argc, argv, short_options, long_options, &ind)))
 	{
 		if (c < 0)
@@ -82,9 +117,41 @@ static void parse_options(int argc, char *argv[])
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 4: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 5: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
+			case 'r':
+				g_options.recursive = true;
+				break;
+			case 's':
+				if (g_options.search_paths_count == MAX_SEARCH_PATHS)
+					EXIT_ERROR("too many search paths");
+				g_options.search_paths[g_options.search_paths_count++] = optarg;
+				break;
+			case 2: // --flat option
+				g_options.flat = true;
+				break;
+			case 3: // --verify option
+				g_options.verify = true;
+				g_options.recursive = true;
+				break;
+			case 'j':
+			{
+				char *endptr;
+				const long jobs = strtol(optarg, &endptr, 10);
+				if (*optarg == '\0' || *endptr != '\0' || jobs < 1 || jobs > MAX_JOBS)
+					EXIT_ERROR("invalid jobs option");
+				g_options.jobs = (unsigned)jobs;
+				break;
+			}
 			default:
 				fprintf(stderr, "%s: try '--help' for more information\n", PROGRAM);
 				exit(EXIT_FAILURE);
@@ -103,6 +170,632 @@ static void print_dependencies(pe_ctx_t *ctx)
 	output_close_scope();
 }
 
+//
+// Recursive resolution
+//
+// Every DLL is parsed at most once and kept in a cache keyed by its
+// lowercase name, since Windows resolves DLL names case-insensitively.
+// Resolution proceeds level by level: all DLLs first seen at the same
+// depth are independent of each other, so they're parsed in parallel
+// by a pool of worker threads. Linking the results and discovering the
+// next level happen on the main thread, so the cache needs no locking.
+//
+
+typedef enum {
+	DLL_PENDING,
+	DLL_FOUND,
+	DLL_NOT_FOUND,
+	DLL_INVALID
+} dll_state_e;
+
+typedef struct {
+	char *name;					// NULL for functions imported by ordinal.
+	uint16_t ordinal;
+} import_ref_t;
+
+typedef struct {
+	char *dll_name;				// Lowercase.
+	import_ref_t *functions;	// Only collected when verifying imports.
+	size_t functions_count;
+	size_t functions_capacity;
+} dll_import_t;
+
+typedef struct dll_node {
+	char *name;					// Lowercase; the cache key.
+	char *path;
+	dll_state_e state;
+	dll_import_t *imports;		// Filled by the parser, one entry per imported DLL.
+	size_t imports_count;
+	size_t imports_capacity;
+	struct dll_node **deps;		// Filled when linking, parallel to `imports`.
+	size_t deps_count;
+	// Export sets, only built when verifying imports. Both map an export
+	// to EXPORT_DEFINED or to its forwarder string ("NTDLL.RtlFoo").
+	hashtable_t export_names;
+	uint32_t ordinal_base;
+	uint32_t ordinals_count;
+	const char **ordinals;		// Indexed by ordinal - ordinal_base, NULL where there's no function.
+	char **fwd_dlls;			// Lowercase names of the DLLs exports are forwarded to.
+	size_t fwd_dlls_count;
+	size_t fwd_dlls_capacity;
+	bool visiting;				// On the path currently being output.
+	bool listed;				// Already output with its dependencies.
+} dll_node_t;
+
+static const char EXPORT_DEFINED[] = "";
+
+// Forwarders may chain across DLLs; the loader gives up eventually as well.
+#define MAX_FORWARDER_HOPS	16
+#define MAX_REASON			512
+
+typedef struct {
+	hashtable_t files;			// Lowercase file name -> path, first search path wins.
+	hashtable_t cache;			// Lowercase DLL name -> dll_node_t
+	dll_node_t **nodes;			// Every node, in discovery order.
+	size_t nodes_count;
+	size_t nodes_capacity;
+} resolver_t;
+
+static void *grow_array(void *array, size_t *capacity, size_t element_size)
+{
+	*capacity = *capacity ? *capacity * 2 : 16;
+	array = realloc(array, *capacity * element_size);
+	if (array == NULL)
+		EXIT_ERROR("memory allocation failed");
+	return array;
+}
+
+static char *strdup_lower(const char *str)
+{
+	char *result = strdup(str);
+	if (result == NULL)
+		EXIT_ERROR("memory allocation failed");
+	for (char *p = result; *p != '\0'; p++)
+		*p = (char)tolower((unsigned char)*p);
+	return result;
+}
+
+static void index_search_path(resolver_t *resolver, const char *dir_path)
+{
+	DIR *dir = opendir(dir_path);
+	if (dir == NULL) {
+		fprintf(stderr, "%s: could not open directory '%s'\n", PROGRAM, dir_path);
+		return;
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		char *name = strdup_lower(entry->d_name);
+		if (hashtable_get(&resolver->files, name) != NULL) {
+			free(name);
+			continue;
+		}
+
+		const size_t path_size = strlen(dir_path) + 1 + strlen(entry->d_name) + 1;
+		char *path = malloc_s(path_size);
+		snprintf(path, path_size, "%s/%s", dir_path, entry->d_name);
+
+		if (hashtable_put(&resolver->files, name, path) < 0)
+			EXIT_ERROR("memory allocation failed");
+	}
+
+	closedir(dir);
+}
+
+static dll_node_t *resolver_node(resolver_t *resolver, const char *name)
+{
+	dll_node_t *node = hashtable_get(&resolver->cache, name);
+	if (node != NULL)
+		return node;
+
+	node = calloc_s(1, sizeof(*node));
+	node->name = strdup_lower(name);
+
+	const char *path = hashtable_get(&resolver->files, node->name);
+	if (path != NULL) {
+		node->path = strdup(path);
+		node->state = DLL_PENDING;
+	} else {
+		node->state = DLL_NOT_FOUND;
+	}
+
+	if (hashtable_put(&resolver->cache, node->name, node) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	if (resolver->nodes_count == resolver->nodes_capacity)
+		resolver->nodes = grow_array(resolver->nodes, &resolver->nodes_capacity, sizeof(*resolver->nodes));
+	resolver->nodes[resolver->nodes_count++] = node;
+
+	return node;
+}
+
+static void collect_imports(dll_node_t *node, pe_ctx_t *ctx)
+{
+	pe_import_iter_t iter;
+	if (!pe_import_iter_init(&iter, ctx))
+		return;
+
+	while (pe_import_iter_next_dll(&iter)) {
+		if (iter.dll_name == NULL)
+			continue;
+
+		char *name = strdup_lower(iter.dll_name);
+
+		// Import tables are short; a linear scan is enough to merge
+		// descriptors naming the same DLL.
+		dll_import_t *import = NULL;
+		for (size_t i=0; i < node->imports_count && import == NULL; i++) {
+			if (strcmp(node->imports[i].dll_name, name) == 0)
+				import = &node->imports[i];
+		}
+
+		if (import != NULL) {
+			free(name);
+		} else {
+			if (node->imports_count == node->imports_capacity)
+				node->imports = grow_array(node->imports, &node->imports_capacity, sizeof(*node->imports));
+			import = &node->imports[node->imports_count++];
+			memset(import, 0, sizeof(*import));
+			import->dll_name = name;
+		}
+
+		if (!g_options.verify)
+			continue;
+
+		pe_import_entry_t entry;
+		while (pe_import_iter_next_function(&iter, &entry)) {
+			if (import->functions_count == import->functions_capacity)
+				import->functions = grow_array(import->functions, &import->functions_capacity, sizeof(*import->functions));
+			import_ref_t *function = &import->functions[import->functions_count++];
+			function->name = entry.name != NULL ? strdup(entry.name) : NULL;
+			function->ordinal = entry.ordinal;
+		}
+	}
+}
+
+// Returns the lowercase name of the DLL a forwarder string points to,
+// e.g. "NTDLL.RtlFoo" -> "ntdll.dll", or NULL if it's malformed.
+static char *forwarder_dll_name(const char *forwarder)
+{
+	const char *dot = strrchr(forwarder, '.');
+	if (dot == NULL || dot == forwarder)
+		return NULL;
+
+	const size_t length = (size_t)(dot - forwarder);
+	char *name = malloc_s(length + sizeof(".dll"));
+	for (size_t i=0; i < length; i++)
+		name[i] = (char)tolower((unsigned char)forwarder[i]);
+	memcpy(name + length, ".dll", sizeof(".dll"));
+	return name;
+}
+
+static void collect_exports(dll_node_t *node, pe_ctx_t *ctx)
+{
+	pe_export_iter_t iter;
+	if (!pe_export_iter_init(&iter, ctx) || iter.functions_count == 0)
+		return;
+
+	node->ordinal_base = iter.base;
+	node->ordinals_count = iter.functions_count;
+	node->ordinals = calloc_s(iter.functions_count, sizeof(*node->ordinals));
+
+	// Sequential iteration; a point lookup per ordinal would scan the name table each time.
+	pe_export_entry_t entry;
+	while (pe_export_iter_next(&iter, &entry)) {
+		const uint32_t i = entry.ordinal - iter.base;
+		if (entry.address == 0)
+			continue;
+
+		if (entry.fwd_name == NULL) {
+			node->ordinals[i] = EXPORT_DEFINED;
+			continue;
+		}
+
+		char *forwarder = strdup(entry.fwd_name);
+		char *dll_name = forwarder != NULL ? forwarder_dll_name(forwarder) : NULL;
+		if (dll_name == NULL) {
+			free(forwarder);
+			continue;
+		}
+		node->ordinals[i] = forwarder;
+
+		bool known = false;
+		for (size_t j=0; j < node->fwd_dlls_count && !known; j++)
+			known = strcmp(node->fwd_dlls[j], dll_name) == 0;
+		if (known) {
+			free(dll_name);
+		} else {
+			if (node->fwd_dlls_count == node->fwd_dlls_capacity)
+				node->fwd_dlls = grow_array(node->fwd_dlls, &node->fwd_dlls_capacity, sizeof(*node->fwd_dlls));
+			node->fwd_dlls[node->fwd_dlls_count++] = dll_name;
+		}
+	}
+
+	// A function may be exported under several names, so walk the name
+	// table itself rather than one name per function.
+	if (hashtable_init(&node->export_names, iter.names_count) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	for (uint32_t i=0; i < iter.names_count; i++) {
+		const uint16_t index = iter.ordinals[i];
+		if (index >= iter.functions_count || node->ordinals[index] == NULL)
+			continue;
+
+		const char *name = pe_tables_string_at_rva(ctx, iter.names[i], PE_TABLES_MAX_FUNCTION_NAME);
+		if (name == NULL)
+			continue;
+
+		char *key = strdup(name);
+		if (key == NULL || hashtable_get(&node->export_names, key) != NULL) {
+			free(key);
+			continue;
+		}
+
+		if (hashtable_put(&node->export_names, key, (void *)node->ordinals[index]) < 0)
+			EXIT_ERROR("memory allocation failed");
+	}
+}
+
+// Runs on worker threads. Only touches `node`.
+static void parse_dll(dll_node_t *node)
+{
+	pe_ctx_t ctx;
+
+	if (pe_load_file(&ctx, node->path) != LIBPE_E_OK) {
+		node->state = DLL_INVALID;
+		return;
+	}
+
+	if (pe_parse(&ctx) != LIBPE_E_OK || !pe_is_pe(&ctx)) {
+		node->state = DLL_INVALID;
+		pe_unload(&ctx);
+		return;
+	}
+
+	collect_imports(node, &ctx);
+	if (g_options.verify)
+		collect_exports(node, &ctx);
+
+	node->state = DLL_FOUND;
+	pe_unload(&ctx);
+}
+
+typedef struct {
+	dll_node_t **nodes;
+	size_t count;
+	size_t next;
+	pthread_mutex_t lock;
+} parse_queue_t;
+
+static void *parse_worker(void *arg)
+{
+	parse_queue_t *queue = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		const size_t index = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+
+		if (index >= queue->count)
+			break;
+
+		parse_dll(queue->nodes[index]);
+	}
+
+	return NULL;
+}
+
+static void parse_level(dll_node_t **nodes, size_t count, unsigned jobs)
+{
+	parse_queue_t queue = { .nodes = nodes, .count = count, .next = 0 };
+	pthread_t threads[MAX_JOBS];
+
+	if (jobs > count)
+		jobs = (unsigned)count;
+
+	pthread_mutex_init(&queue.lock, NULL);
+
+	unsigned started = 0;
+	if (jobs > 1) {
+		for (; started < jobs; started++) {
+			if (pthread_create(&threads[started], NULL, parse_worker, &queue) != 0)
+				break;
+		}
+	}
+
+	// With a single job, or if no thread could be started, do the work here.
+	if (started == 0)
+		parse_worker(&queue);
+
+	for (unsigned i=0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&queue.lock);
+}
+
+static void link_node(resolver_t *resolver, dll_node_t *node)
+{
+	if (node->imports_count > 0) {
+		node->deps = calloc_s(node->imports_count, sizeof(*node->deps));
+		for (size_t i=0; i < node->imports_count; i++)
+			node->deps[node->deps_count++] = resolver_node(resolver, node->imports[i].dll_name);
+	}
+
+	// DLLs that exports are forwarded to are needed to verify imports, but
+	// they're not dependencies of their own, so they don't show up in the tree.
+	for (size_t i=0; i < node->fwd_dlls_count; i++)
+		resolver_node(resolver, node->fwd_dlls[i]);
+}
+
+static void resolve(resolver_t *resolver, unsigned jobs)
+{
+	size_t level_start = 0;
+	size_t level_end = resolver->nodes_count;
+
+	while (level_start < level_end) {
+		// Parse everything found in the previous level.
+		size_t pending_count = 0;
+		dll_node_t **pending = calloc_s(level_end - level_start, sizeof(*pending));
+		for (size_t i = level_start; i < level_end; i++) {
+			if (resolver->nodes[i]->state == DLL_PENDING)
+				pending[pending_count++] = resolver->nodes[i];
+		}
+		parse_level(pending, pending_count, jobs);
+		free(pending);
+
+		// Link, discovering the next level.
+		for (size_t i = level_start; i < level_end; i++)
+			link_node(resolver, resolver->nodes[i]);
+
+		level_start = level_end;
+		level_end = resolver->nodes_count;
+	}
+}
+
+static const char *dll_state_name(dll_state_e state)
+{
+	switch (state) {
+		case DLL_FOUND:		return "found";
+		case DLL_NOT_FOUND:	return "not found";
+		case DLL_INVALID:	return "invalid";
+		default:			return "pending";
+	}
+}
+
+static void print_dependency_node(dll_node_t *node, bool with_children);
+
+static void print_dependency_children(dll_node_t *node)
+{
+	output_open_scope("Dependencies", OUTPUT_SCOPE_TYPE_ARRAY);
+	node->visiting = true;
+	for (size_t i=0; i < node->deps_count; i++)
+		print_dependency_node(node->deps[i], true);
+	node->visiting = false;
+	output_close_scope(); // Dependencies
+}
+
+static void print_dependency_node(dll_node_t *node, bool with_children)
+{
+	output_open_scope("Dependency", OUTPUT_SCOPE_TYPE_OBJECT);
+	output("Name", node->name);
+	output("Status", dll_state_name(node->state));
+	if (node->path != NULL)
+		output("Path", node->path);
+
+	if (with_children && node->deps_count > 0) {
+		// A DLL's dependencies are listed the first time it shows up only.
+		if (node->visiting) {
+			output("Cycle", "yes");
+		} else if (node->listed) {
+			output("Dependencies", "listed above");
+		} else {
+			node->listed = true;
+			print_dependency_children(node);
+		}
+	}
+
+	output_close_scope(); // Dependency
+}
+
+//
+// Import verification
+//
+
+// Looks an import up in the export sets of `dll`, following forwarders
+// through the cache. Returns true if it resolves; otherwise `reason` says why.
+static bool verify_import(resolver_t *resolver, dll_node_t *dll, const char *name, uint32_t ordinal, char *reason, size_t reason_size)
+{
+	const char *forwarder = NULL;
+
+	for (unsigned hops = 0; hops < MAX_FORWARDER_HOPS; hops++) {
+		if (dll == NULL || dll->state != DLL_FOUND) {
+			// Only reachable through a forwarder: imports from missing DLLs aren't verified.
+			snprintf(reason, reason_size, "forwarded to %s, whose DLL was %s", forwarder,
+				dll != NULL ? dll_state_name(dll->state) : "not found");
+			return false;
+		}
+
+		const char *target;
+		if (name != NULL) {
+			target = dll->export_names.entries != NULL ? hashtable_get(&dll->export_names, name) : NULL;
+		} else {
+			const uint32_t index = ordinal - dll->ordinal_base;
+			target = ordinal >= dll->ordinal_base && index < dll->ordinals_count ? dll->ordinals[index] : NULL;
+		}
+
+		if (target == NULL) {
+			if (forwarder != NULL)
+				snprintf(reason, reason_size, "forwarded to %s, not exported by %s", forwarder, dll->name);
+			else
+				snprintf(reason, reason_size, "not exported by %s", dll->name);
+			return false;
+		}
+
+		if (target == EXPORT_DEFINED)
+			return true;
+
+		// Follow the forwarder: "DLL.Function" or "DLL.#Ordinal".
+		forwarder = target;
+		char *dll_name = forwarder_dll_name(forwarder);
+		dll = hashtable_get(&resolver->cache, dll_name);
+		free(dll_name);
+
+		const char *function = strrchr(forwarder, '.') + 1;
+		if (function[0] == '#') {
+			name = NULL;
+			ordinal = (uint32_t)strtoul(function + 1, NULL, 10);
+		} else {
+			name = function;
+		}
+	}
+
+	snprintf(reason, reason_size, "too many forwarders, last was %s", forwarder);
+	return false;
+}
+
+static void print_unresolved_imports(resolver_t *resolver, dll_node_t *node)
+{
+	if (node->state != DLL_FOUND)
+		return;
+
+	for (size_t i=0; i < node->imports_count; i++) {
+		const dll_import_t *import = &node->imports[i];
+		dll_node_t *dll = node->deps[i];
+
+		// Missing DLLs are already reported as such.
+		if (dll->state != DLL_FOUND)
+			continue;
+
+		for (size_t j=0; j < import->functions_count; j++) {
+			const import_ref_t *function = &import->functions[j];
+			char reason[MAX_REASON];
+
+			if (verify_import(resolver, dll, function->name, function->ordinal, reason, sizeof(reason)))
+				continue;
+
+			output_open_scope("Unresolved import", OUTPUT_SCOPE_TYPE_OBJECT);
+			output("Module", node->name);
+			output("Library", dll->name);
+			if (function->name != NULL)
+				output("Function", function->name);
+			else
+				output_int("Ordinal", function->ordinal, OUTPUT_INT_DECIMAL);
+			output("Reason", reason);
+			output_close_scope(); // Unresolved import
+		}
+	}
+}
+
+static void free_node(dll_node_t *node)
+{
+	for (size_t i=0; i < node->imports_count; i++) {
+		dll_import_t *import = &node->imports[i];
+		for (size_t j=0; j < import->functions_count; j++)
+			free(import->functions[j].name);
+		free(import->functions);
+		free(import->dll_name);
+	}
+	free(node->imports);
+
+	// Forwarder strings are owned by the ordinal table; the name table points to them.
+	for (uint32_t i=0; i < node->ordinals_count; i++) {
+		if (node->ordinals[i] != EXPORT_DEFINED)
+			free((char *)node->ordinals[i]);
+	}
+	free(node->ordinals);
+
+	for (size_t i=0; i < node->export_names.capacity; i++)
+		free((char *)node->export_names.entries[i].key);
+	hashtable_destroy(&node->export_names);
+
+	for (size_t i=0; i < node->fwd_dlls_count; i++)
+		free(node->fwd_dlls[i]);
+	free(node->fwd_dlls);
+
+	free(node->deps);
+	free(node->path);
+	free(node->name);
+	free(node);
+}
+
+static void print_recursive_dependencies(pe_ctx_t *ctx, const char *path)
+{
+	resolver_t resolver;
+	memset(&resolver, 0, sizeof(resolver));
+	if (hashtable_init(&resolver.files, 1024) < 0 || hashtable_init(&resolver.cache, 256) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	// Like Windows, look in the application directory first.
+	char *app_dir = strdup(path);
+	if (app_dir == NULL)
+		EXIT_ERROR("memory allocation failed");
+	char *slash = strrchr(app_dir, '/');
+	if (slash != NULL) {
+		*slash = '\0';
+		index_search_path(&resolver, app_dir[0] != '\0' ? app_dir : "/");
+	} else {
+		index_search_path(&resolver, ".");
+	}
+	free(app_dir);
+
+	for (size_t i=0; i < g_options.search_paths_count; i++)
+		index_search_path(&resolver, g_options.search_paths[i]);
+
+	// The root is already loaded and isn't part of the cache: a DLL
+	// importing a module with the same name gets its own node.
+	const char *base_name = strrchr(path, '/');
+	dll_node_t *root = calloc_s(1, sizeof(*root));
+	root->name = strdup_lower(base_name != NULL ? base_name + 1 : path);
+	root->path = strdup(path);
+	root->state = DLL_FOUND;
+	collect_imports(root, ctx);
+	link_node(&resolver, root);
+
+	unsigned jobs = g_options.jobs;
+	if (jobs == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus < 1 ? 1 : cpus > MAX_JOBS ? MAX_JOBS : (unsigned)cpus;
+	}
+
+	resolve(&resolver, jobs);
+
+	if (g_options.flat) {
+		output_open_scope("Dependencies", OUTPUT_SCOPE_TYPE_ARRAY);
+		for (size_t i=0; i < resolver.nodes_count; i++)
+			print_dependency_node(resolver.nodes[i], false);
+		output_close_scope(); // Dependencies
+	} else {
+		print_dependency_children(root);
+	}
+
+	if (g_options.verify) {
+		output_open_scope("Unresolved imports", OUTPUT_SCOPE_TYPE_ARRAY);
+		print_unresolved_imports(&resolver, root);
+		for (size_t i=0; i < resolver.nodes_count; i++)
+			print_unresolved_imports(&resolver, resolver.nodes[i]);
+		output_close_scope(); // Unresolved imports
+	}
+
+	// free
+	for (size_t i=0; i < resolver.nodes_count; i++)
+		free_node(resolver.nodes[i]);
+	free(resolver.nodes);
+	free_node(root);
+
+	for (size_t i=0; i < resolver.files.capacity; i++) {
+		const hashtable_entry_t *entry = &resolver.files.entries[i];
+		if (entry->key == NULL)
+			continue;
+		free((char *)entry->key);
+		free(entry->value);
+	}
+	hashtable_destroy(&resolver.files);
+	hashtable_destroy(&resolver.cache);
+}
+
 int main(int argc, char *argv[])
 {
 	pev_config_t config;
@@ -134,11 +827,13 @@ int main(int argc, char *argv[])
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	IMAGE_DATA_DIRECTORY **directories = pe_directories(&ctx);
 	if (directories == NULL) {
 		LIBPE_WARNING("directories not found");
+	} else if (g_options.recursive) {
+		print_recursive_dependencies(&ctx, argv[argc-1]);
 	} else {
 		print_dependencies(&ctx);
 	}
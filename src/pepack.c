@@ -54,6 +54,8 @@ static void usage(void)
 		"\nOptions:\n"
 		" -d, --database <file>					 Use database file (default: ./userdb.txt).\n"
 		" -f, --format <%s>  Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
 		PROGRAM, PROGRAM, formats);
@@ -77,6 +79,8 @@ static options_t *parse_options(int argc, char *argv[])
 	static const struct option long_options[] = {
 		{ "database",		  required_argument, NULL, 'd' },
 		{ "format",			  required_argument, NULL, 'f' },
+		{ "fields",			  required_argument, NULL,  2  },
+		{ "compress",		  required_argument, NULL,  3  },
 		{ "help",			  no_argument,		 NULL,	1  },
 		{ "version",		  no_argument,		 NULL, 'V' },
 		{ NULL,				  0,				 NULL,	0  }
@@ -97,9 +101,17 @@ static options_t *parse_options(int argc, char *argv[])
 				options->dbfile = strdup(optarg);
 				break;
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 2: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 3: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			case 'V':
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
@@ -296,7 +308,7 @@ int main(int argc, char *argv[])
 	else
 		snprintf(value, MAX_MSG, "no packer found");
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	output("packer", value);
 
@@ -67,6 +67,8 @@ static void usage(void)
 		"\nOptions:\n"
 		" -a, --all								 Show all information, statistics and extract resources\n"
 		" -f, --format <%s>  change output format (default: text)\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -i, --info							 Show resources information\n"
 		" -l, --list							 Show list view\n"
 		" -s, --statistics						 Show resources statistics\n"
@@ -97,6 +99,8 @@ static options_t *parse_options(int argc, char *argv[])
 	static const struct option long_options[] = {
 		{ "all",			required_argument,	NULL, 'a' },
 		{ "format",			required_argument,	NULL, 'f' },
+		{ "fields",			required_argument,	NULL,  2  },
+		{ "compress",		required_argument,	NULL,  3  },
 		{ "info",			no_argument,		NULL, 'i' },
 		{ "list",			no_argument,		NULL, 'l' },
 		{ "statistics",		no_argument,		NULL, 's' },
@@ -121,9 +125,17 @@ static options_t *parse_options(int argc, char *argv[])
 				options->all = true;
 				break;
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 2: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 3: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			case 'i':
 				options->info = true;
 				break;
@@ -308,6 +320,9 @@ static void peres_show_list(pe_ctx_t *ctx, const pe_resource_node_t *node)
 	if (node == NULL)
 		return;
 
+	// The list is printed directly, so anything already output goes first.
+	output_flush();
+
 	peres_show_list_node(ctx, node);
 
 	peres_show_list(ctx, node->childNode);
@@ -683,7 +698,7 @@ int main(int argc, char **argv)
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	pe_resources_t *resources = pe_resources(&ctx);
 	if (resources == NULL || resources->err != LIBPE_E_OK) {
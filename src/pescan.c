@@ -55,6 +55,8 @@ static void usage(void)
 		"\nExample: %s putty.exe\n"
 		"\nOptions:\n"
 		" -f, --format <%s>  Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -v, --verbose							 Show more information about found items.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
@@ -79,6 +81,8 @@ static options_t *parse_options(int argc, char *argv[])
 
 	static const struct option long_options[] = {
 		{ "format",		required_argument,	NULL,	'f' },
+		{ "fields",		required_argument,	NULL,	 2  },
+		{ "compress",	required_argument,	NULL,	 3  },
 		{ "help",		no_argument,		NULL,	 1	},
 		{ "verbose",	no_argument,		NULL,	'v' },
 		{ "version",	no_argument,		NULL,	'V' },
@@ -98,9 +102,17 @@ static options_t *parse_options(int argc, char *argv[])
 				usage();
 				exit(EXIT_SUCCESS);
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 2: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 3: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			case 'v':
 				options->verbose = true;
 				break;
@@ -485,18 +497,20 @@ int main(int argc, char *argv[])
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	output_open_document();
-
-	// File entropy
-	const double entropy = pe_calculate_entropy_file(&ctx);
+	output_open_document_with_name(ctx.path);
 
 	static char value[MAX_MSG];
 
-	if (entropy < 7.0)
-		snprintf(value, MAX_MSG, "%f (normal)", entropy);
-	else
-		snprintf(value, MAX_MSG, "%f (probably packed)", entropy);
-	output("file entropy", value);
+	// File entropy
+	if (output_wants("file entropy")) {
+		const double entropy = pe_calculate_entropy_file(&ctx);
+
+		if (entropy < 7.0)
+			snprintf(value, MAX_MSG, "%f (normal)", entropy);
+		else
+			snprintf(value, MAX_MSG, "%f (probably packed)", entropy);
+		output("file entropy", value);
+	}
 
 	if (pe_is_dll(&ctx)) {
 		uint16_t ret = cpl_analysis(&ctx);
@@ -510,7 +524,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	output("fpu anti-disassembly", pe_fpu_trick(&ctx) ? "yes" : "no");
+	if (output_wants("fpu anti-disassembly"))
+		output("fpu anti-disassembly", pe_fpu_trick(&ctx) ? "yes" : "no");
 
 	// imagebase analysis
 	if (!normal_imagebase(&ctx)) {
@@ -564,16 +579,18 @@ int main(int argc, char *argv[])
 	output("DOS stub", value);
 
 	// tls callbacks
-	int callbacks = pe_get_tls_callbacks(&ctx, options);
+	if (output_wants("TLS directory") || output_wants("TLS callback function")) {
+		int callbacks = pe_get_tls_callbacks(&ctx, options);
 
-	if (callbacks == 0)
-		snprintf(value, MAX_MSG, "not found");
-	else if (callbacks == -1)
-		snprintf(value, MAX_MSG, "found - no functions");
-	else if (callbacks > 0)
-		snprintf(value, MAX_MSG, "found - %d function(s)", callbacks);
+		if (callbacks == 0)
+			snprintf(value, MAX_MSG, "not found");
+		else if (callbacks == -1)
+			snprintf(value, MAX_MSG, "found - no functions");
+		else if (callbacks > 0)
+			snprintf(value, MAX_MSG, "found - %d function(s)", callbacks);
 
-	output("TLS directory", value);
+		output("TLS directory", value);
+	}
 
 	// invalid timestamp
 	IMAGE_COFF_HEADER *coff = pe_coff(&ctx);
@@ -64,6 +64,8 @@ static void usage(void)
 		"\nExample: %s wordpad.exe\n"
 		"\nOptions:\n"
 		" -f, --format <%s>  Change output format (default: text)\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -c, --certoutform <text|pem>			 Specifies the certificate output format (default: text).\n"
 		" -o, --certout <filename>				 Specifies the output filename to write certificates to (default: stdout).\n"
 		" -V, --version							 Show version.\n"
@@ -126,6 +128,8 @@ static options_t *parse_options(int argc, char *argv[])
 
 	static const struct option long_options[] = {
 		{ "format",			required_argument,	NULL,	'f' },
+		{ "fields",			required_argument,	NULL,	 2  },
+		{ "compress",		required_argument,	NULL,	 3  },
 		{ "certoutform",	required_argument,	NULL,	'c' },
 		{ "certout",		required_argument,	NULL,	'o' },
 		{ "help",			no_argument,		NULL,	 1	},
@@ -146,9 +150,17 @@ static options_t *parse_options(int argc, char *argv[])
 				usage();
 				exit(EXIT_SUCCESS);
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 2: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 3: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			case 'v':
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
@@ -207,6 +219,8 @@ static void print_certificate(BIO *out, cert_format_e format, X509 *cert)
 {
 	if (out == NULL)
 		return;
+	// The certificate may go to stdout, after anything already output.
+	output_flush();
 	switch (format) {
 		default:
 		case CERT_FORMAT_TEXT:
@@ -480,7 +494,7 @@ int main(int argc, char *argv[])
 			break;
 	}
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	static char field[MAX_MSG];
 
@@ -43,12 +43,22 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include "config.h"
 #include "pev_api.h"
 
+typedef struct {
+	const char *name;
+	plugin_loaded_fn_t plugin_loaded_fn;
+	plugin_initialize_fn_t plugin_initialize_fn;
+	plugin_shutdown_fn_t plugin_shutdown_fn;
+	plugin_unloaded_fn_t plugin_unloaded_fn;
+} builtin_plugin_t;
+
 typedef struct _plugins_entry {
 	dylib_t library;
+	const builtin_plugin_t *builtin; // NULL unless linked into the binary.
 	plugin_loaded_fn_t plugin_loaded_fn;
 	plugin_initialize_fn_t plugin_initialize_fn;
 	plugin_shutdown_fn_t plugin_shutdown_fn;
@@ -56,8 +66,107 @@ typedef struct _plugins_entry {
 	SLIST_ENTRY(_plugins_entry) entries;
 } plugins_entry_t;
 
+// Plugins linked into the binary (make BUILTIN_PLUGINS=1) are listed by
+// the build as `BUILTIN_PLUGIN(name) ...`, their functions prefixed with
+// the name so that they don't clash.
+#ifdef PEV_BUILTIN_PLUGINS
+#define BUILTIN_PLUGIN(name) \
+	int name##_plugin_loaded(void); \
+	int name##_plugin_initialize(const struct _pev_api_t *api); \
+	void name##_plugin_shutdown(void); \
+	void name##_plugin_unloaded(void);
+PEV_BUILTIN_PLUGINS
+#undef BUILTIN_PLUGIN
+#define BUILTIN_PLUGIN(name) \
+	{ #name, name##_plugin_loaded, name##_plugin_initialize, name##_plugin_shutdown, name##_plugin_unloaded },
+#else
+#define PEV_BUILTIN_PLUGINS
+#endif
+
+static const builtin_plugin_t g_builtin_plugins[] = {
+	PEV_BUILTIN_PLUGINS
+	{ NULL, NULL, NULL, NULL, NULL }
+};
+
 static SLIST_HEAD(_plugins_t_list, _plugins_entry) g_loaded_plugins = SLIST_HEAD_INITIALIZER(g_loaded_plugins);
 
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define PLUGINS_SUFFIX	".so"
+#elif defined(__APPLE__)
+#define PLUGINS_SUFFIX	".dylib"
+#elif defined(__CYGWIN__)
+#define PLUGINS_SUFFIX	".dll"
+#else
+#error Not supported
+#endif
+
+// Where plugins are loaded from when they're first needed.
+static char *g_plugins_path = NULL;
+
+static bool _is_loaded(const char *path) {
+	plugins_entry_t *entry;
+	SLIST_FOREACH(entry, &g_loaded_plugins, entries) {
+		if (entry->library.path != NULL && strcmp(entry->library.path, path) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Whether `filename` is the file of a plugin that is built in.
+static bool _is_builtin_file(const char *filename) {
+	for (const builtin_plugin_t *builtin = g_builtin_plugins; builtin->name != NULL; builtin++) {
+		const size_t length = strlen(builtin->name);
+		if (strncmp(filename, builtin->name, length) == 0 && strcmp(filename + length, "_plugin" PLUGINS_SUFFIX) == 0)
+			return true;
+	}
+	return false;
+}
+
+static int _start_plugin(plugins_entry_t *entry) {
+	if (entry->plugin_loaded_fn != NULL) {
+		const int loaded = entry->plugin_loaded_fn();
+		if (loaded < 0) {
+			fprintf(stderr, "plugins: plugin didn't load correctly\n");
+			return -4;
+		}
+	}
+
+	const pev_api_t *pev_api = pev_api_ptr();
+	const int initialized = entry->plugin_initialize_fn(pev_api);
+	if (initialized < 0) {
+		fprintf(stderr, "plugins: plugin didn't initialize correctly\n");
+		return -5;
+	}
+
+	SLIST_INSERT_HEAD(&g_loaded_plugins, entry, entries);
+	return 0;
+}
+
+static int _load_builtin(const builtin_plugin_t *builtin) {
+	plugins_entry_t *entry;
+	SLIST_FOREACH(entry, &g_loaded_plugins, entries) {
+		if (entry->builtin == builtin)
+			return 0;
+	}
+
+	entry = calloc(1, sizeof *entry);
+	if (entry == NULL) {
+		fprintf(stderr, "plugin: allocation failed for entry\n");
+		return -1;
+	}
+
+	entry->builtin = builtin;
+	entry->plugin_loaded_fn = builtin->plugin_loaded_fn;
+	entry->plugin_initialize_fn = builtin->plugin_initialize_fn;
+	entry->plugin_shutdown_fn = builtin->plugin_shutdown_fn;
+	entry->plugin_unloaded_fn = builtin->plugin_unloaded_fn;
+
+	const int ret = _start_plugin(entry);
+	if (ret < 0)
+		free(entry);
+	return ret;
+}
+
 int plugins_load(const char *path) {
 	plugins_entry_t *entry = calloc(1, sizeof *entry);
 	if (entry == NULL) {
@@ -93,27 +202,12 @@ int plugins_load(const char *path) {
 		return -3;
 	}
 
-	if (entry->plugin_loaded_fn != NULL) {
-		const int loaded = entry->plugin_loaded_fn();
-		if (loaded < 0) {
-			fprintf(stderr, "plugins: plugin didn't load correctly\n");
-			dylib_unload(library);
-			free(entry);
-			return -4;
-		}
-	}
-
-	const pev_api_t *pev_api = pev_api_ptr();
-	const int initialized = entry->plugin_initialize_fn(pev_api);
-	if (initialized < 0) {
-		fprintf(stderr, "plugins: plugin didn't initialize correctly\n");
+	ret = _start_plugin(entry);
+	if (ret < 0) {
 		dylib_unload(library);
 		free(entry);
-		return -5;
 	}
-
-	SLIST_INSERT_HEAD(&g_loaded_plugins, entry, entries);
-	return 0;
+	return ret;
 }
 
 static void plugin_unload_without_removal(plugins_entry_t *entry) {
@@ -125,6 +219,9 @@ static void plugin_unload_without_removal(plugins_entry_t *entry) {
 		entry->plugin_unloaded_fn();
 	}
 
+	if (entry->builtin != NULL)
+		return;
+
 	int ret = dylib_unload(library);
 	if (ret < 0) {
 		// TODO(jweyrich): What should we do?
@@ -180,17 +277,8 @@ int plugins_load_all_from_directory(const char *path) {
 			{
 				const char *filename = dir_entry->d_name;
 
-				// TODO(jweyrich): Use macro conditions for each system: .so, .dylib, .dll
-#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
-				const bool possible_plugin = pe_utils_str_ends_with(filename, ".so") != 0;
-#elif defined(__APPLE__)
-				const bool possible_plugin = pe_utils_str_ends_with(filename, ".dylib") != 0;
-#elif defined(__CYGWIN__)
-				const bool possible_plugin = pe_utils_str_ends_with(filename, ".dll") != 0;
-#else
-#error Not supported
-#endif
-				if (!possible_plugin)
+				const bool possible_plugin = pe_utils_str_ends_with(filename, PLUGINS_SUFFIX) != 0;
+				if (!possible_plugin || _is_builtin_file(filename))
 					break;
 
 				if ( asprintf(&relative_path, "%s/%s", path, filename) < 0 )
@@ -200,9 +288,15 @@ int plugins_load_all_from_directory(const char *path) {
 					return -2;
 				}
 
+				// Some may have been loaded on demand already.
+				if (_is_loaded(relative_path)) {
+					free(relative_path);
+					break;
+				}
+
 				int ret = plugins_load(relative_path);
+				free(relative_path);
 				if (ret < 0) {
-					free(relative_path);
 					closedir(dir);
 					return ret;
 				}
@@ -214,7 +308,6 @@ int plugins_load_all_from_directory(const char *path) {
 		}
 	}
 
-	free(relative_path);
 	closedir(dir);
 
 	return load_count;
@@ -224,6 +317,57 @@ int plugins_load_all(pev_config_t *config) {
 	return plugins_load_all_from_directory(config->plugins_path);
 }
 
+void plugins_set_directory(const char *path) {
+	free(g_plugins_path);
+	g_plugins_path = strdup(path);
+	if (g_plugins_path == NULL)
+		abort(); // Abort because it failed miserably!
+}
+
+int plugins_load_by_name(const char *name) {
+	for (const builtin_plugin_t *builtin = g_builtin_plugins; builtin->name != NULL; builtin++) {
+		if (strcmp(builtin->name, name) == 0)
+			return _load_builtin(builtin);
+	}
+
+	if (g_plugins_path == NULL)
+		return -1;
+
+	// Only a file right in the plugins directory will do.
+	if (*name == '\0' || *name == '.' || strchr(name, '/') != NULL)
+		return -1;
+
+	char *path;
+	if (asprintf(&path, "%s/%s_plugin" PLUGINS_SUFFIX, g_plugins_path, name) < 0) {
+		fprintf(stderr, "plugins: allocation failed for path\n");
+		return -2;
+	}
+
+	int ret = 0;
+	if (!_is_loaded(path))
+		ret = access(path, F_OK) == 0 ? plugins_load(path) : -1;
+
+	free(path);
+	return ret;
+}
+
+int plugins_load_remaining(void) {
+	for (const builtin_plugin_t *builtin = g_builtin_plugins; builtin->name != NULL; builtin++) {
+		const int ret = _load_builtin(builtin);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (g_plugins_path == NULL)
+		return 0;
+
+	// With the plugins built in, a plugins directory is optional.
+	if (g_builtin_plugins[0].name != NULL && access(g_plugins_path, F_OK) != 0)
+		return 0;
+
+	return plugins_load_all_from_directory(g_plugins_path);
+}
+
 void plugins_unload_all(void) {
 	while (!SLIST_EMPTY(&g_loaded_plugins)) {
 		plugins_entry_t *entry = SLIST_FIRST(&g_loaded_plugins);
@@ -231,4 +375,7 @@ void plugins_unload_all(void) {
 		SLIST_REMOVE_HEAD(&g_loaded_plugins, entries);
 		free(entry);
 	}
+
+	free(g_plugins_path);
+	g_plugins_path = NULL;
 }
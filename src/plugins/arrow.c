@@ -0,0 +1,921 @@
+/*
+	pev - the PE file analyzer toolkit
+
+	arrow.c - Principal implementation file for the Arrow output plugin
+
+	Copyright (C) 2012 - 2014 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations
+    including the two.
+
+    You must obey the GNU General Public License in all respects
+    for all of the code used other than OpenSSL.  If you modify
+    file(s) with this exception, you may extend this exception to your
+    version of the file(s), but you are not obligated to do so.  If you
+    do not wish to do so, delete this exception statement from your
+    version.  If you delete this exception statement from all source
+    files in the program, then also delete it here.
+*/
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pev_api.h"
+#include "output_plugin.h"
+
+const pev_api_t *g_pev_api = NULL;
+
+//
+// Columnar output as an Arrow IPC stream, for loading into analytics
+// engines without going through JSON.
+//
+// Output is a table with one row per record, where a record is an object
+// scope. The records that become rows are selected by name: the key of the
+// object, or the key of the array it is in, so `-f arrow:rows=Sections` gives
+// one row per section from readpe. By default, rows are the first records
+// that have attributes, such as the "file" object of pehash. Everything
+// output from all documents ends up in the same table.
+//
+// Each attribute becomes a column named by its key. Attributes inside scopes
+// nested in a row are prefixed by the names of those scopes, and attributes
+// of the scopes enclosing a row are repeated on each of its rows, prefixed
+// the same way (as in "Imported functions.Name" for `rows=Functions`). Values
+// of an array of strings are joined into a single column.
+//
+// Integers output through output_int() make unsigned 64-bit columns, other
+// values make UTF-8 columns. Rows are written in record batches of up to
+// `batch=N` rows (65536 by default), so memory use is bounded regardless of
+// how many rows there are. Columns are fixed once the first batch has been
+// written; attributes that show up later under new names are dropped.
+//
+// REFERENCE: https://arrow.apache.org/docs/format/Columnar.html
+//
+
+#define ARROW_DEFAULT_BATCH_ROWS	65536
+// Keeps offsets into UTF-8 columns well within int32.
+#define ARROW_MAX_BATCH_BYTES		(1U << 30)
+#define ARROW_MAX_DEPTH				16
+
+#define ARROW_CONTINUATION			0xffffffffU
+#define ARROW_METADATA_V5			4
+#define ARROW_HEADER_SCHEMA			1
+#define ARROW_HEADER_RECORD_BATCH	3
+#define ARROW_TYPE_INT				2
+#define ARROW_TYPE_UTF8				5
+
+typedef enum {
+	COLUMN_UINT64,
+	COLUMN_UTF8
+} column_type_e;
+
+typedef struct {
+	char *name;
+	column_type_e type;
+	bool is_set;				// Whether the current row has a value yet.
+	uint64_t pending;			// The current row's value, for COLUMN_UINT64.
+	size_t null_count;
+	output_buffer_t validity;	// One bit per row.
+	output_buffer_t offsets;	// Rows + 1 int32, for COLUMN_UTF8.
+	output_buffer_t values;		// uint64 values, or UTF-8 bytes.
+} column_t;
+
+// An attribute of a scope enclosing the row, repeated on every row.
+typedef struct {
+	size_t depth;
+	char *column;
+	bool is_int;
+	uint64_t int_value;
+	char *value;
+} context_attribute_t;
+
+typedef struct {
+	const char *name;
+	output_scope_type_e type;
+} scope_entry_t;
+
+// What each output context keeps for this format.
+typedef struct {
+	char *rows;					// Name of the records that are rows.
+	size_t batch_rows;			// Rows per batch, from `batch=`; 0 for the default.
+	bool is_used;				// Whether a document was output.
+	bool schema_written;
+	bool dropped_warning;
+
+	scope_entry_t scopes[ARROW_MAX_DEPTH];
+	size_t depth;
+	size_t row_depth;			// Depth of the current row's scope, or 0.
+	size_t row_count;			// Rows in the current batch.
+
+	column_t *columns;
+	size_t column_count;
+	size_t column_capacity;
+
+	context_attribute_t *context;
+	size_t context_count;
+	size_t context_capacity;
+
+	output_buffer_t name_buffer;
+	output_buffer_t message;
+} arrow_state_t;
+
+static char *escape_arrow(const format_t *format, const char *str) {
+	return g_pev_api->output->escape(format, str);
+}
+
+static void *xrealloc(void *ptr, size_t size) {
+	void *result = realloc(ptr, size);
+	if (result == NULL)
+		abort(); // Abort because it failed miserably!
+	return result;
+}
+
+static char *xstrdup(const char *str) {
+	char *result = strdup(str);
+	if (result == NULL)
+		abort(); // Abort because it failed miserably!
+	return result;
+}
+
+//
+// Little-endian encoding, as Arrow requires.
+//
+
+static void append(output_buffer_t *buffer, const void *data, size_t length) {
+	g_pev_api->output->buffer_append(buffer, data, length);
+}
+
+static void append_le(output_buffer_t *buffer, uint64_t value, size_t size) {
+	unsigned char bytes[8];
+	for (size_t i = 0; i < size; i++) {
+		bytes[i] = (unsigned char)value;
+		value >>= 8;
+	}
+	append(buffer, bytes, size);
+}
+
+static void put_le(output_buffer_t *buffer, size_t position, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		buffer->data[position + i] = (char)(unsigned char)value;
+		value >>= 8;
+	}
+}
+
+static void append_zeros(output_buffer_t *buffer, size_t count) {
+	static const char zeros[8] = { 0 };
+	while (count > 0) {
+		const size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+		append(buffer, zeros, n);
+		count -= n;
+	}
+}
+
+static size_t align_to(size_t value, size_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t pad(output_buffer_t *buffer, size_t alignment) {
+	append_zeros(buffer, align_to(buffer->length, alignment) - buffer->length);
+	return buffer->length;
+}
+
+//
+// Minimal FlatBuffers builder for the IPC metadata. Unlike the reference
+// builder it writes front to back: each table comes before what it refers
+// to, and its offsets are filled in once their targets have been written.
+//
+// REFERENCE: https://flatbuffers.dev/internals/
+//
+
+typedef struct {
+	uint16_t id;
+	uint8_t size;			// In bytes. Offsets are 4 bytes.
+	uint64_t value;			// Unused for offsets.
+	size_t position;		// Where fb_table() put the field.
+} fb_field_t;
+
+// Writes a table with its vtable before it. Returns its position.
+static size_t fb_table(output_buffer_t *buffer, fb_field_t *fields, size_t count) {
+	size_t slots = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (fields[i].id + 1U > slots)
+			slots = fields[i].id + 1U;
+	}
+
+	// Lay the fields out after the vtable offset, aligned to their size. The
+	// table itself is 8-aligned, so that's also their absolute alignment.
+	size_t table_size = 4;
+	size_t relative[8] = { 0 };
+	if (count > sizeof(relative) / sizeof(relative[0]))
+		abort(); // Programming error.
+	for (size_t i = 0; i < count; i++) {
+		table_size = align_to(table_size, fields[i].size);
+		relative[i] = table_size;
+		table_size += fields[i].size;
+	}
+
+	const size_t vtable = pad(buffer, 2);
+	append_le(buffer, 4 + 2 * slots, 2);
+	append_le(buffer, table_size, 2);
+	for (size_t slot = 0; slot < slots; slot++) {
+		size_t offset = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (fields[i].id == slot)
+				offset = relative[i];
+		}
+		append_le(buffer, offset, 2);
+	}
+
+	const size_t table = pad(buffer, 8);
+	append_le(buffer, table - vtable, 4);
+	append_zeros(buffer, table_size - 4);
+	for (size_t i = 0; i < count; i++) {
+		fields[i].position = table + relative[i];
+		put_le(buffer, fields[i].position, fields[i].value, fields[i].size);
+	}
+
+	return table;
+}
+
+// Points the offset at `position` to `target`, which must come after it.
+static void fb_patch(output_buffer_t *buffer, size_t position, size_t target) {
+	put_le(buffer, position, target - position, 4);
+}
+
+static size_t fb_string(output_buffer_t *buffer, const char *str) {
+	const size_t length = strlen(str);
+	const size_t position = pad(buffer, 4);
+	append_le(buffer, length, 4);
+	append(buffer, str, length + 1);
+	return position;
+}
+
+// Writes a vector of `count` offsets, to be patched. Returns its position.
+static size_t fb_offsets(output_buffer_t *buffer, size_t count) {
+	const size_t position = pad(buffer, 4);
+	append_le(buffer, count, 4);
+	append_zeros(buffer, 4 * count);
+	return position;
+}
+
+// Starts a vector of `count` structs with 8-byte fields. The caller appends
+// the structs.
+static size_t fb_structs(output_buffer_t *buffer, size_t count) {
+	pad(buffer, 4);
+	if (buffer->length % 8 == 0)
+		append_zeros(buffer, 4);
+	const size_t position = buffer->length;
+	append_le(buffer, count, 4);
+	return position;
+}
+
+// Writes the Message table that starts every metadata buffer, returning the
+// position of its `header` offset.
+static size_t fb_message(output_buffer_t *buffer, uint8_t header_type, uint64_t body_length) {
+	append_zeros(buffer, 4); // Root offset.
+	fb_field_t fields[] = {
+		{ 3, 8, body_length, 0 },
+		{ 0, 2, ARROW_METADATA_V5, 0 },
+		{ 1, 1, header_type, 0 },
+		{ 2, 4, 0, 0 },
+	};
+	const size_t table = fb_table(buffer, fields, sizeof(fields) / sizeof(fields[0]));
+	fb_patch(buffer, 0, table);
+	return fields[3].position;
+}
+
+//
+// IPC messages.
+//
+
+// Writes the metadata in `state->message` with its prefix, padded to 8 bytes.
+static void write_message(output_ctx_t *ctx, arrow_state_t *state) {
+	pad(&state->message, 8);
+
+	unsigned char prefix[8];
+	for (size_t i = 0; i < 4; i++) {
+		prefix[i] = (unsigned char)(ARROW_CONTINUATION >> (8 * i));
+		prefix[4 + i] = (unsigned char)(state->message.length >> (8 * i));
+	}
+	g_pev_api->output->write(ctx, (const char *)prefix, sizeof(prefix));
+	g_pev_api->output->write(ctx, state->message.data, state->message.length);
+}
+
+static void write_schema(output_ctx_t *ctx, arrow_state_t *state) {
+	output_buffer_t * const buffer = &state->message;
+	buffer->length = 0;
+
+	const size_t header = fb_message(buffer, ARROW_HEADER_SCHEMA, 0);
+
+	fb_field_t schema[] = {
+		{ 0, 2, 0, 0 },		// endianness: Little
+		{ 1, 4, 0, 0 },		// fields
+	};
+	fb_patch(buffer, header, fb_table(buffer, schema, 2));
+
+	const size_t fields = fb_offsets(buffer, state->column_count);
+	fb_patch(buffer, schema[1].position, fields);
+
+	for (size_t i = 0; i < state->column_count; i++) {
+		const column_t * const column = &state->columns[i];
+		fb_field_t field[] = {
+			{ 0, 4, 0, 0 },		// name
+			{ 1, 1, 1, 0 },		// nullable
+			{ 2, 1, column->type == COLUMN_UINT64 ? ARROW_TYPE_INT : ARROW_TYPE_UTF8, 0 },
+			{ 3, 4, 0, 0 },		// type
+			{ 5, 4, 0, 0 },		// children
+		};
+		fb_patch(buffer, fields + 4 + 4 * i, fb_table(buffer, field, 5));
+		fb_patch(buffer, field[0].position, fb_string(buffer, column->name));
+
+		if (column->type == COLUMN_UINT64) {
+			fb_field_t type[] = {
+				{ 0, 4, 64, 0 },	// bitWidth
+				{ 1, 1, 0, 0 },		// is_signed
+			};
+			fb_patch(buffer, field[3].position, fb_table(buffer, type, 2));
+		} else {
+			fb_patch(buffer, field[3].position, fb_table(buffer, NULL, 0));
+		}
+
+		fb_patch(buffer, field[4].position, fb_offsets(buffer, 0));
+	}
+
+	write_message(ctx, state);
+	state->schema_written = true;
+}
+
+static size_t column_buffer_count(const column_t *column) {
+	return column->type == COLUMN_UTF8 ? 3 : 2;
+}
+
+static const output_buffer_t *column_buffer(const column_t *column, size_t index) {
+	if (index == 0)
+		return &column->validity;
+	if (column->type == COLUMN_UTF8 && index == 1)
+		return &column->offsets;
+	return &column->values;
+}
+
+static void reset_column(column_t *column) {
+	column->null_count = 0;
+	column->validity.length = 0;
+	column->values.length = 0;
+	column->offsets.length = 0;
+	if (column->type == COLUMN_UTF8)
+		append_le(&column->offsets, 0, 4);
+}
+
+static void write_batch(output_ctx_t *ctx, arrow_state_t *state) {
+	if (!state->schema_written)
+		write_schema(ctx, state);
+
+	size_t buffer_count = 0;
+	size_t body_length = 0;
+	for (size_t i = 0; i < state->column_count; i++) {
+		const column_t * const column = &state->columns[i];
+		buffer_count += column_buffer_count(column);
+		for (size_t j = 0; j < column_buffer_count(column); j++)
+			body_length += align_to(column_buffer(column, j)->length, 8);
+	}
+
+	output_buffer_t * const buffer = &state->message;
+	buffer->length = 0;
+
+	const size_t header = fb_message(buffer, ARROW_HEADER_RECORD_BATCH, body_length);
+
+	fb_field_t batch[] = {
+		{ 0, 8, state->row_count, 0 },	// length
+		{ 1, 4, 0, 0 },					// nodes
+		{ 2, 4, 0, 0 },					// buffers
+	};
+	fb_patch(buffer, header, fb_table(buffer, batch, 3));
+
+	fb_patch(buffer, batch[1].position, fb_structs(buffer, state->column_count));
+	for (size_t i = 0; i < state->column_count; i++) {
+		append_le(buffer, state->row_count, 8);
+		append_le(buffer, state->columns[i].null_count, 8);
+	}
+
+	fb_patch(buffer, batch[2].position, fb_structs(buffer, buffer_count));
+	size_t offset = 0;
+	for (size_t i = 0; i < state->column_count; i++) {
+		const column_t * const column = &state->columns[i];
+		for (size_t j = 0; j < column_buffer_count(column); j++) {
+			const size_t length = column_buffer(column, j)->length;
+			append_le(buffer, offset, 8);
+			append_le(buffer, length, 8);
+			offset += align_to(length, 8);
+		}
+	}
+
+	write_message(ctx, state);
+
+	static const char zeros[8] = { 0 };
+	for (size_t i = 0; i < state->column_count; i++) {
+		column_t * const column = &state->columns[i];
+		for (size_t j = 0; j < column_buffer_count(column); j++) {
+			const output_buffer_t * const data = column_buffer(column, j);
+			g_pev_api->output->write(ctx, data->data, data->length);
+			g_pev_api->output->write(ctx, zeros, align_to(data->length, 8) - data->length);
+		}
+		reset_column(column);
+	}
+
+	state->row_count = 0;
+}
+
+//
+// Columns.
+//
+
+// Appends `str` as UTF-8. Bytes that aren't part of a valid sequence are
+// taken as Latin-1, so that no string is lost or makes the column invalid.
+static void append_utf8(output_buffer_t *buffer, const char *str) {
+	const unsigned char *p = (const unsigned char *)str;
+
+	while (*p != '\0') {
+		const unsigned char c = *p;
+		size_t length = 1;
+		if (c >= 0x80) {
+			size_t continuation = 0;
+			uint32_t min = 0;
+			uint32_t codepoint = 0;
+			if ((c & 0xe0) == 0xc0) {
+				continuation = 1; min = 0x80; codepoint = c & 0x1f;
+			} else if ((c & 0xf0) == 0xe0) {
+				continuation = 2; min = 0x800; codepoint = c & 0x0f;
+			} else if ((c & 0xf8) == 0xf0) {
+				continuation = 3; min = 0x10000; codepoint = c & 0x07;
+			}
+
+			bool valid = continuation > 0;
+			for (size_t i = 1; valid && i <= continuation; i++) {
+				if ((p[i] & 0xc0) != 0x80)
+					valid = false;
+				else
+					codepoint = codepoint << 6 | (p[i] & 0x3f);
+			}
+			// Overlong forms, surrogates and code points beyond Unicode.
+			if (valid && (codepoint < min || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff))
+				valid = false;
+
+			if (!valid) {
+				const char latin1[2] = { (char)(0xc0 | c >> 6), (char)(0x80 | (c & 0x3f)) };
+				append(buffer, latin1, sizeof(latin1));
+				p++;
+				continue;
+			}
+			length = continuation + 1;
+		}
+		append(buffer, p, length);
+		p += length;
+	}
+}
+
+static void append_validity(column_t *column, size_t row, bool is_valid) {
+	if (row % 8 == 0)
+		append_zeros(&column->validity, 1);
+	if (is_valid)
+		column->validity.data[row / 8] |= (char)(1 << (row % 8));
+	else
+		column->null_count++;
+}
+
+// Ends the current row of `column`, with a null if it wasn't set.
+static void commit_value(column_t *column, size_t row) {
+	append_validity(column, row, column->is_set);
+	if (column->type == COLUMN_UINT64)
+		append_le(&column->values, column->is_set ? column->pending : 0, 8);
+	else
+		append_le(&column->offsets, column->values.length, 4);
+	column->is_set = false;
+}
+
+static column_t *add_column(arrow_state_t *state, const char *name, column_type_e type) {
+	if (state->column_count == state->column_capacity) {
+		state->column_capacity = state->column_capacity ? state->column_capacity * 2 : 16;
+		state->columns = xrealloc(state->columns, state->column_capacity * sizeof(column_t));
+	}
+
+	column_t * const column = &state->columns[state->column_count++];
+	memset(column, 0, sizeof(*column));
+	column->name = xstrdup(name);
+	column->type = type;
+	reset_column(column);
+
+	// Nulls for the rows that came before it.
+	for (size_t row = 0; row < state->row_count; row++)
+		commit_value(column, row);
+
+	return column;
+}
+
+// Turns a column of integers into one of strings, before the schema is out.
+static void convert_to_utf8(column_t *column, size_t row_count) {
+	const output_buffer_t values = column->values;
+	const output_buffer_t validity = column->validity;
+	memset(&column->values, 0, sizeof(column->values));
+	memset(&column->validity, 0, sizeof(column->validity));
+	column->type = COLUMN_UTF8;
+	reset_column(column);
+
+	const bool is_set = column->is_set;
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	for (size_t row = 0; row < row_count; row++) {
+		column->is_set = (validity.data[row / 8] >> (row % 8)) & 1;
+		if (column->is_set) {
+			uint64_t value = 0;
+			for (size_t i = 0; i < 8; i++)
+				value |= (uint64_t)(unsigned char)values.data[row * 8 + i] << (8 * i);
+			snprintf(formatted, sizeof(formatted), "%" PRIu64, value);
+			append(&column->values, formatted, strlen(formatted));
+		}
+		commit_value(column, row);
+	}
+
+	column->is_set = is_set;
+	if (is_set) {
+		snprintf(formatted, sizeof(formatted), "%" PRIu64, column->pending);
+		append(&column->values, formatted, strlen(formatted));
+	}
+
+	free(values.data);
+	free(validity.data);
+}
+
+static column_t *find_column(arrow_state_t *state, const char *name, column_type_e type) {
+	for (size_t i = 0; i < state->column_count; i++) {
+		if (strcmp(state->columns[i].name, name) == 0)
+			return &state->columns[i];
+	}
+
+	if (!state->schema_written)
+		return add_column(state, name, type);
+
+	if (!state->dropped_warning) {
+		fprintf(stderr, "arrow: dropping \"%s\" and any other attribute that wasn't in the first batch\n", name);
+		state->dropped_warning = true;
+	}
+	return NULL;
+}
+
+static void set_string(arrow_state_t *state, const char *name, const char *value) {
+	column_t * const column = find_column(state, name, COLUMN_UTF8);
+	if (column == NULL)
+		return;
+
+	if (column->type == COLUMN_UINT64) {
+		if (!state->schema_written) {
+			convert_to_utf8(column, state->row_count);
+		} else {
+			// The schema says integer; keep the value only if it is one.
+			char *end;
+			const unsigned long long number = strtoull(value, &end, 0);
+			if (*value != '\0' && *end == '\0') {
+				column->pending = number;
+				column->is_set = true;
+			}
+			return;
+		}
+	}
+
+	// Values of an array of strings, or repeated keys, are joined.
+	if (column->is_set)
+		append(&column->values, ", ", 2);
+	append_utf8(&column->values, value);
+	column->is_set = true;
+}
+
+static void set_int(arrow_state_t *state, const char *name, uint64_t value, output_int_hint_e hint) {
+	column_t * const column = find_column(state, name, COLUMN_UINT64);
+	if (column == NULL)
+		return;
+
+	if (column->type == COLUMN_UINT64) {
+		column->pending = value;
+		column->is_set = true;
+		return;
+	}
+
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+	set_string(state, name, formatted);
+}
+
+static void commit_row(output_ctx_t *ctx, arrow_state_t *state) {
+	const size_t batch_rows = state->batch_rows != 0 ? state->batch_rows : ARROW_DEFAULT_BATCH_ROWS;
+	bool is_full = state->row_count + 1 >= batch_rows;
+	for (size_t i = 0; i < state->column_count; i++) {
+		column_t * const column = &state->columns[i];
+		commit_value(column, state->row_count);
+		if (column->values.length >= ARROW_MAX_BATCH_BYTES)
+			is_full = true;
+	}
+	state->row_count++;
+
+	if (is_full)
+		write_batch(ctx, state);
+}
+
+//
+// Scopes and rows.
+//
+
+// Name of the record a scope is: its key, or that of the array it is in.
+static const char *record_name(const arrow_state_t *state, size_t depth) {
+	const scope_entry_t * const scope = &state->scopes[depth];
+	if (depth > 0 && state->scopes[depth - 1].type == OUTPUT_SCOPE_TYPE_ARRAY)
+		return state->scopes[depth - 1].name;
+	return scope->name;
+}
+
+// Builds a column name from the scopes after `from_depth` and `key`.
+static const char *column_name(arrow_state_t *state, size_t from_depth, const char *key) {
+	output_buffer_t * const buffer = &state->name_buffer;
+	buffer->length = 0;
+
+	for (size_t depth = from_depth + 1; depth <= state->depth; depth++) {
+		const scope_entry_t * const scope = &state->scopes[depth];
+		// Objects in an array are named after it, which already is in the name.
+		if (scope->name == NULL || state->scopes[depth - 1].type == OUTPUT_SCOPE_TYPE_ARRAY)
+			continue;
+		if (buffer->length > 0)
+			append(buffer, ".", 1);
+		append(buffer, scope->name, strlen(scope->name));
+	}
+
+	if (key != NULL) {
+		if (buffer->length > 0)
+			append(buffer, ".", 1);
+		append(buffer, key, strlen(key));
+	}
+
+	append(buffer, "", 1);
+	return buffer->data;
+}
+
+static void begin_row(arrow_state_t *state) {
+	state->row_depth = state->depth;
+	for (size_t i = 0; i < state->context_count; i++) {
+		const context_attribute_t * const attribute = &state->context[i];
+		if (attribute->is_int)
+			set_int(state, attribute->column, attribute->int_value, OUTPUT_INT_DECIMAL);
+		else
+			set_string(state, attribute->column, attribute->value);
+	}
+}
+
+static void add_context(arrow_state_t *state, const char *key, bool is_int, uint64_t int_value, const char *value) {
+	if (state->context_count == state->context_capacity) {
+		state->context_capacity = state->context_capacity ? state->context_capacity * 2 : 8;
+		state->context = xrealloc(state->context, state->context_capacity * sizeof(context_attribute_t));
+	}
+
+	context_attribute_t * const attribute = &state->context[state->context_count++];
+	attribute->depth = state->depth;
+	attribute->column = xstrdup(column_name(state, 0, key));
+	attribute->is_int = is_int;
+	attribute->int_value = int_value;
+	attribute->value = is_int ? NULL : xstrdup(value);
+}
+
+static void attribute(arrow_state_t *state, const char *key, bool is_int, uint64_t int_value, const char *value, output_int_hint_e hint) {
+	if (!is_int && value == NULL) {
+		if (key == NULL)
+			return;
+		// In arrays, a key alone is a value, as in arrays of names. Elsewhere
+		// it's an attribute without a value, which makes a null.
+		if (state->scopes[state->depth].type == OUTPUT_SCOPE_TYPE_ARRAY) {
+			value = key;
+			key = NULL;
+		}
+	}
+
+	// Without a `rows` option, the first record with attributes makes the rows.
+	if (state->row_depth == 0 && state->rows == NULL
+		&& state->depth > 0 && state->scopes[state->depth].type == OUTPUT_SCOPE_TYPE_OBJECT
+		&& record_name(state, state->depth) != NULL)
+	{
+		state->rows = xstrdup(record_name(state, state->depth));
+		begin_row(state);
+	}
+
+	if (state->row_depth == 0) {
+		if (is_int || value != NULL)
+			add_context(state, key, is_int, int_value, value);
+		return;
+	}
+
+	const char * const name = column_name(state, state->row_depth, key);
+	if (!is_int && value == NULL)
+		find_column(state, name, COLUMN_UTF8);
+	else if (is_int)
+		set_int(state, name, int_value, hint);
+	else
+		set_string(state, name, value);
+}
+
+static void open_scope(arrow_state_t *state, const output_scope_t *scope) {
+	if (scope->type == OUTPUT_SCOPE_TYPE_DOCUMENT) {
+		state->depth = 0;
+		state->is_used = true;
+	} else if (++state->depth >= ARROW_MAX_DEPTH) {
+		fprintf(stderr, "arrow: programming error? too many nested scopes");
+		abort();
+	}
+
+	state->scopes[state->depth].name = scope->name;
+	state->scopes[state->depth].type = scope->type;
+
+	if (state->row_depth == 0 && state->rows != NULL && scope->type == OUTPUT_SCOPE_TYPE_OBJECT) {
+		const char * const name = record_name(state, state->depth);
+		if (name != NULL && strcmp(name, state->rows) == 0)
+			begin_row(state);
+	}
+}
+
+static void close_scope(output_ctx_t *ctx, arrow_state_t *state) {
+	if (state->row_depth != 0 && state->depth == state->row_depth) {
+		commit_row(ctx, state);
+		state->row_depth = 0;
+	}
+
+	while (state->context_count > 0 && state->context[state->context_count - 1].depth >= state->depth) {
+		context_attribute_t * const attribute = &state->context[--state->context_count];
+		free(attribute->column);
+		free(attribute->value);
+	}
+
+	if (state->depth > 0)
+		state->depth--;
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	(void)format;
+	arrow_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	switch (type) {
+		default:
+			break;
+		case OUTPUT_TYPE_SCOPE_OPEN:
+			open_scope(state, scope);
+			break;
+		case OUTPUT_TYPE_SCOPE_CLOSE:
+			close_scope(ctx, state);
+			break;
+		case OUTPUT_TYPE_ATTRIBUTE:
+			attribute(state, key, false, 0, value, OUTPUT_INT_DECIMAL);
+			break;
+	}
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	(void)format;
+	(void)scope;
+	arrow_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	attribute(state, key, true, value, NULL, hint);
+}
+
+// Writes the last batch and ends the stream.
+static void finish(output_ctx_t *ctx, const format_t *format) {
+	(void)format;
+	arrow_state_t * const state = g_pev_api->output->format_state(ctx);
+	if (state == NULL || !state->is_used)
+		return;
+
+	if (state->row_count > 0 || !state->schema_written)
+		write_batch(ctx, state);
+
+	static const unsigned char end_of_stream[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+	g_pev_api->output->write(ctx, (const char *)end_of_stream, sizeof(end_of_stream));
+	state->is_used = false;
+}
+
+// Options are comma-separated: `rows=<name>` and `batch=<rows>`.
+static int set_option(output_ctx_t *ctx, const format_t *format, const char *option) {
+	(void)format;
+	arrow_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	char * const options = xstrdup(option);
+	int result = 0;
+
+	for (char *saveptr = NULL, *item = strtok_r(options, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+		if (strncmp(item, "rows=", 5) == 0 && item[5] != '\0') {
+			free(state->rows);
+			state->rows = xstrdup(item + 5);
+		} else if (strncmp(item, "batch=", 6) == 0) {
+			char *end;
+			const unsigned long rows = strtoul(item + 6, &end, 10);
+			if (item[6] == '\0' || *end != '\0' || rows == 0 || rows > INT32_MAX) {
+				result = -1;
+				break;
+			}
+			state->batch_rows = rows;
+		} else {
+			result = -1;
+			break;
+		}
+	}
+
+	free(options);
+	return result;
+}
+
+static void free_state(void *state) {
+	arrow_state_t * const arrow_state = state;
+
+	for (size_t i = 0; i < arrow_state->column_count; i++) {
+		column_t * const column = &arrow_state->columns[i];
+		free(column->name);
+		g_pev_api->output->buffer_free(&column->validity);
+		g_pev_api->output->buffer_free(&column->offsets);
+		g_pev_api->output->buffer_free(&column->values);
+	}
+	free(arrow_state->columns);
+
+	for (size_t i = 0; i < arrow_state->context_count; i++) {
+		free(arrow_state->context[i].column);
+		free(arrow_state->context[i].value);
+	}
+	free(arrow_state->context);
+
+	free(arrow_state->rows);
+	g_pev_api->output->buffer_free(&arrow_state->name_buffer);
+	g_pev_api->output->buffer_free(&arrow_state->message);
+}
+
+// ----------------------------------------------------------------------------
+
+#define FORMAT_ID	9
+#define FORMAT_NAME "arrow"
+
+static const format_t g_format = {
+	FORMAT_ID,
+	FORMAT_NAME,
+	&to_format,
+	&escape_arrow,
+	NULL,
+	&to_format_int,
+	sizeof(arrow_state_t),
+	&free_state,
+	&set_option,
+	&finish
+};
+
+#define PLUGIN_TYPE "output"
+#define PLUGIN_NAME FORMAT_NAME
+
+int plugin_loaded(void) {
+	//printf("Loading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+	return 0;
+}
+
+void plugin_unloaded(void) {
+	//printf("Unloading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+}
+
+int plugin_initialize(const pev_api_t *api) {
+	g_pev_api = api;
+	int ret = g_pev_api->output->output_plugin_register_format(&g_format);
+	if (ret < 0)
+		return -1;
+	return 0;
+}
+
+void plugin_shutdown(void) {
+	g_pev_api->output->output_plugin_unregister_format(&g_format);
+}
@@ -0,0 +1,303 @@
+/*
+	pev - the PE file analyzer toolkit
+
+	cbor.c - Principal implementation file for the CBOR output plugin
+
+	Copyright (C) 2012 - 2014 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations
+    including the two.
+    
+    You must obey the GNU General Public License in all respects
+    for all of the code used other than OpenSSL.  If you modify
+    file(s) with this exception, you may extend this exception to your
+    version of the file(s), but you are not obligated to do so.  If you
+    do not wish to do so, delete this exception statement from your
+    version.  If you delete this exception statement from all source
+    files in the program, then also delete it here.
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pev_api.h"
+#include "output_plugin.h"
+
+const pev_api_t *g_pev_api = NULL;
+
+//
+// Binary output in CBOR, for consumers that parse large amounts of output.
+// Documents, objects and arrays map to CBOR maps and arrays with the same
+// structure the JSON output has. Scopes are written as they are opened, so
+// their size isn't known yet and they use indefinite-length encoding, while
+// strings and integers use definite-length encoding. Nothing is escaped.
+//
+// Attributes inside an array are written as single-entry maps, so that the
+// key isn't lost. Integers output through output_int() are written as CBOR
+// integers, regardless of how they would be presented by text formats.
+// Strings that are not valid UTF-8 are written as byte strings.
+//
+// REFERENCE: https://www.rfc-editor.org/rfc/rfc8949
+//
+
+#define CBOR_MAJOR_UNSIGNED		0
+#define CBOR_MAJOR_BYTES		2
+#define CBOR_MAJOR_TEXT			3
+#define CBOR_MAJOR_ARRAY		4
+#define CBOR_MAJOR_MAP			5
+#define CBOR_MAJOR_TAG			6
+
+#define CBOR_INDEFINITE			31
+#define CBOR_NULL				0xf6
+#define CBOR_BREAK				0xff
+
+// Marks each document as CBOR, so it can be identified by its first bytes.
+#define CBOR_TAG_SELF_DESCRIBE	55799
+
+static char *escape_cbor(const format_t *format, const char *str) {
+	return g_pev_api->output->escape(format, str);
+}
+
+static void write_byte(output_ctx_t *ctx, uint8_t byte) {
+	g_pev_api->output->write(ctx, (const char *)&byte, 1);
+}
+
+// Writes the initial byte of an item and its argument, big-endian.
+static void write_head(output_ctx_t *ctx, uint8_t major, uint64_t argument) {
+	uint8_t head[9];
+	size_t size;
+
+	if (argument < 24) {
+		head[0] = (uint8_t)(major << 5 | argument);
+		size = 1;
+	} else if (argument <= UINT8_MAX) {
+		head[0] = (uint8_t)(major << 5 | 24);
+		size = 2;
+	} else if (argument <= UINT16_MAX) {
+		head[0] = (uint8_t)(major << 5 | 25);
+		size = 3;
+	} else if (argument <= UINT32_MAX) {
+		head[0] = (uint8_t)(major << 5 | 26);
+		size = 5;
+	} else {
+		head[0] = (uint8_t)(major << 5 | 27);
+		size = 9;
+	}
+
+	for (size_t i = size - 1; i > 0; i--) {
+		head[i] = (uint8_t)argument;
+		argument >>= 8;
+	}
+
+	g_pev_api->output->write(ctx, (const char *)head, size);
+}
+
+static void write_indefinite(output_ctx_t *ctx, uint8_t major) {
+	write_byte(ctx, (uint8_t)(major << 5 | CBOR_INDEFINITE));
+}
+
+static bool is_utf8(const unsigned char *str, size_t length) {
+	const unsigned char * const end = str + length;
+
+	while (str < end) {
+		const unsigned char c = *str;
+		if (c < 0x80) {
+			str++;
+			continue;
+		}
+
+		size_t continuation;
+		uint32_t min;
+		uint32_t codepoint;
+		if ((c & 0xe0) == 0xc0) {
+			continuation = 1; min = 0x80; codepoint = c & 0x1f;
+		} else if ((c & 0xf0) == 0xe0) {
+			continuation = 2; min = 0x800; codepoint = c & 0x0f;
+		} else if ((c & 0xf8) == 0xf0) {
+			continuation = 3; min = 0x10000; codepoint = c & 0x07;
+		} else {
+			return false;
+		}
+
+		if ((size_t)(end - str) <= continuation)
+			return false;
+		for (size_t i = 1; i <= continuation; i++) {
+			if ((str[i] & 0xc0) != 0x80)
+				return false;
+			codepoint = codepoint << 6 | (str[i] & 0x3f);
+		}
+
+		// Overlong forms, surrogates and code points beyond Unicode.
+		if (codepoint < min || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff)
+			return false;
+
+		str += continuation + 1;
+	}
+
+	return true;
+}
+
+static void write_string(output_ctx_t *ctx, const char *str) {
+	if (str == NULL) {
+		write_byte(ctx, CBOR_NULL);
+		return;
+	}
+
+	const size_t length = strlen(str);
+	const bool text = is_utf8((const unsigned char *)str, length);
+	write_head(ctx, text ? CBOR_MAJOR_TEXT : CBOR_MAJOR_BYTES, length);
+	g_pev_api->output->write(ctx, str, length);
+}
+
+// Whether items in `scope_type` are written as map entries.
+static bool is_map(output_scope_type_e scope_type) {
+	return scope_type == OUTPUT_SCOPE_TYPE_DOCUMENT || scope_type == OUTPUT_SCOPE_TYPE_OBJECT;
+}
+
+// Writes what precedes an attribute's value, and returns whether a break
+// must follow it.
+static bool write_attribute_key(output_ctx_t *ctx, const output_scope_t *scope, const char *key) {
+	if (scope != NULL && is_map(scope->type)) {
+		write_string(ctx, key);
+		return false;
+	}
+	if (key == NULL)
+		return false;
+	write_indefinite(ctx, CBOR_MAJOR_MAP);
+	write_string(ctx, key);
+	return true;
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	(void)format;
+
+	switch (type) {
+		default:
+			break;
+		case OUTPUT_TYPE_SCOPE_OPEN:
+			switch (scope->type) {
+				default:
+					break;
+				case OUTPUT_SCOPE_TYPE_DOCUMENT:
+					write_head(ctx, CBOR_MAJOR_TAG, CBOR_TAG_SELF_DESCRIBE);
+					write_indefinite(ctx, CBOR_MAJOR_MAP);
+					break;
+				case OUTPUT_SCOPE_TYPE_OBJECT:
+				case OUTPUT_SCOPE_TYPE_ARRAY:
+					if (is_map(scope->parent_type))
+						write_string(ctx, key);
+					write_indefinite(ctx, scope->type == OUTPUT_SCOPE_TYPE_OBJECT ? CBOR_MAJOR_MAP : CBOR_MAJOR_ARRAY);
+					break;
+			}
+			break;
+		case OUTPUT_TYPE_SCOPE_CLOSE:
+			switch (scope->type) {
+				default:
+					break;
+				case OUTPUT_SCOPE_TYPE_DOCUMENT:
+				case OUTPUT_SCOPE_TYPE_OBJECT:
+				case OUTPUT_SCOPE_TYPE_ARRAY:
+					write_byte(ctx, CBOR_BREAK);
+					break;
+			}
+			break;
+		case OUTPUT_TYPE_ATTRIBUTE:
+		{
+			// An attribute with only a key, outside of a map, is its key.
+			if (value == NULL && (scope == NULL || !is_map(scope->type))) {
+				write_string(ctx, key);
+				break;
+			}
+			const bool wrapped = write_attribute_key(ctx, scope, key);
+			write_string(ctx, value);
+			if (wrapped)
+				write_byte(ctx, CBOR_BREAK);
+			break;
+		}
+	}
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	(void)format;
+	(void)hint;
+
+	const bool wrapped = write_attribute_key(ctx, scope, key);
+	write_head(ctx, CBOR_MAJOR_UNSIGNED, value);
+	if (wrapped)
+		write_byte(ctx, CBOR_BREAK);
+}
+
+// ----------------------------------------------------------------------------
+
+#define FORMAT_ID	7
+#define FORMAT_NAME "cbor"
+
+static const format_t g_format = {
+	FORMAT_ID,
+	FORMAT_NAME,
+	&to_format,
+	&escape_cbor,
+	NULL,
+	&to_format_int,
+	0,
+	NULL,
+	NULL,
+	NULL
+};
+
+#define PLUGIN_TYPE "output"
+#define PLUGIN_NAME FORMAT_NAME
+
+int plugin_loaded(void) {
+	//printf("Loading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+	return 0;
+}
+
+void plugin_unloaded(void) {
+	//printf("Unloading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+}
+
+int plugin_initialize(const pev_api_t *api) {
+	g_pev_api = api;
+	int ret = g_pev_api->output->output_plugin_register_format(&g_format);
+	if (ret < 0)
+		return -1;
+	return 0;
+}
+
+void plugin_shutdown(void) {
+	g_pev_api->output->output_plugin_unregister_format(&g_format);
+}
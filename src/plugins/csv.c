@@ -43,7 +43,7 @@ const pev_api_t *g_pev_api = NULL;
 
 // REFERENCE: http://en.wikipedia.org/wiki/List_of_XML_and_HTML_character_entity_references
 // CSV entities ',', '"', '\n'
-static const entity_t g_entities[255] = {
+static const entity_t g_entities[256] = {
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	"\\n",	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
@@ -101,16 +101,22 @@ static char *escape_csv(const format_t *format, const char *str) {
 //
 // REFERENCE: http://en.wikipedia.org/wiki/Comma-separated_values
 //
-static void to_format(
-	const format_t *format,
+// What each output context keeps for this format.
+typedef struct {
+	output_buffer_t key_buffer;		// Escaped keys and values go to these
+	output_buffer_t value_buffer;	// buffers, reused across calls.
+} csv_state_t;
+
+// `key` and `value` are the raw strings; the escaped ones are what gets printed.
+static void write_entry(
+	output_ctx_t *ctx,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
-	const char *value)
+	const char *value,
+	const char *escaped_key,
+	const char *escaped_value)
 {
-	char * const escaped_key = format->escape_fn(format, key);
-	char * const escaped_value = format->escape_fn(format, value);
-
 	switch (type) {
 		default:
 			break;
@@ -122,7 +128,7 @@ static void to_format(
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf("\n%s\n", escaped_key);
+					g_pev_api->output->write_strs(ctx, "\n", escaped_key, "\n", NULL);
 					break;
 			}
 			break;
@@ -134,24 +140,77 @@ static void to_format(
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf("\n");
+					g_pev_api->output->write(ctx, "\n", 1);
 					break;
 			}
 			break;
 		case OUTPUT_TYPE_ATTRIBUTE:
 			if (key && value)
-				printf("%s,%s\n", escaped_key, escaped_value);
+				g_pev_api->output->write_strs(ctx, escaped_key, ",", escaped_value, "\n", NULL);
 			else if (key)
-				printf("\n%s\n", escaped_key);
+				g_pev_api->output->write_strs(ctx, "\n", escaped_key, "\n", NULL);
 			else if (value)
-				printf(",%s\n", escaped_value);
+				g_pev_api->output->write_strs(ctx, ",", escaped_value, "\n", NULL);
 			break;
 	}
+}
+
+// Like escape_csv(), without allocating.
+static const char *escape_csv_into(output_buffer_t *buffer, const char *str, const entity_table_t entities) {
+	if (str == NULL)
+		return NULL;
+	return strpbrk(str, "\n\",") != NULL
+		? g_pev_api->output->escape_into_quoted(buffer, str, entities)
+		: g_pev_api->output->escape_into(buffer, str, entities);
+}
+
+// Same for keys, which may have been escaped in advance.
+static const char *escape_csv_key_into(output_buffer_t *buffer, const char *key, const entity_table_t entities) {
+	if (key == NULL)
+		return NULL;
+	return strpbrk(key, "\n\",") != NULL
+		? g_pev_api->output->escape_into_quoted(buffer, key, entities)
+		: g_pev_api->output->escape_key_into(buffer, key, entities);
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	csv_state_t * const state = g_pev_api->output->format_state(ctx);
+	const char * const escaped_key = escape_csv_key_into(&state->key_buffer, key, format->entities_table);
+	const char * const escaped_value = escape_csv_into(&state->value_buffer, value, format->entities_table);
+
+	write_entry(ctx, type, scope, key, value, escaped_key, escaped_value);
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	csv_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	const char * const escaped_key = escape_csv_key_into(&state->key_buffer, key, format->entities_table);
+
+	write_entry(ctx, OUTPUT_TYPE_ATTRIBUTE, scope, key, formatted, escaped_key, formatted);
+}
 
-	if (escaped_key != NULL)
-		free(escaped_key);
-	if (escaped_value != NULL)
-		free(escaped_value);
+static void free_state(void *state) {
+	csv_state_t * const csv_state = state;
+	g_pev_api->output->buffer_free(&csv_state->key_buffer);
+	g_pev_api->output->buffer_free(&csv_state->value_buffer);
 }
 
 // ----------------------------------------------------------------------------
@@ -164,7 +223,12 @@ static const format_t g_format = {
 	FORMAT_NAME,
 	&to_format,
 	&escape_csv,
-	(entity_table_t)g_entities
+	(entity_table_t)g_entities,
+	&to_format_int,
+	sizeof(csv_state_t),
+	&free_state,
+	NULL,
+	NULL
 };
 
 #define PLUGIN_TYPE "output"
@@ -43,7 +43,7 @@ const pev_api_t *g_pev_api = NULL;
 
 // REFERENCE: http://en.wikipedia.org/wiki/List_of_XML_and_HTML_character_entity_references
 // HTML entities '"', '&', '\'', '<', '>', ...
-static const entity_t g_entities[255] = {
+static const entity_t g_entities[256] = {
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
@@ -89,17 +89,24 @@ static char *escape_html(const format_t *format, const char *str) {
 	"</body>\n" \
 	"</html>\n"
 
-static void to_format(
-	const format_t *format,
+// What each output context keeps for this format.
+typedef struct {
+	int indent;
+	output_buffer_t key_buffer;		// Escaped keys and values go to these
+	output_buffer_t value_buffer;	// buffers, reused across calls.
+} html_state_t;
+
+// `key` and `value` are the raw strings; the escaped ones are what gets printed.
+static void write_entry(
+	output_ctx_t *ctx,
+	html_state_t *state,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
-	const char *value)
+	const char *value,
+	const char *escaped_key,
+	const char *escaped_value)
 {
-	static int indent = 0;
-
-	char * const escaped_key = format->escape_fn(format, key);
-	char * const escaped_value = format->escape_fn(format, value);
 	const bool is_within_array = scope->parent_type == OUTPUT_SCOPE_TYPE_ARRAY;
 
 	switch (type) {
@@ -114,24 +121,29 @@ static void to_format(
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(TEMPLATE_DOCUMENT_OPEN, g_pev_api->output->output_cmdline());
-					indent++;
+					g_pev_api->output->writef(ctx, TEMPLATE_DOCUMENT_OPEN, g_pev_api->output->output_cmdline());
+					state->indent++;
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
-					printf(INDENT(indent++, "<%s class=\"object\">\n"), wrap_el);
-					printf(INDENT(indent,   "<h2>%s</h2>\n"), escaped_key);
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write_strs(ctx, "<", wrap_el, " class=\"object\">\n", NULL);
+					g_pev_api->output->write_indent(ctx, state->indent);
+					g_pev_api->output->write_strs(ctx, "<h2>", escaped_key, "</h2>\n", NULL);
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf(INDENT(indent++, "<%s class=\"array\">\n"), wrap_el);
-					printf(INDENT(indent,   "<h2>%s</h2>\n"), escaped_key);
-					printf(INDENT(indent++, "<ul>\n"));
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write_strs(ctx, "<", wrap_el, " class=\"array\">\n", NULL);
+					g_pev_api->output->write_indent(ctx, state->indent);
+					g_pev_api->output->write_strs(ctx, "<h2>", escaped_key, "</h2>\n", NULL);
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write_str(ctx, "<ul>\n");
 					break;
 			}
 			break;
 		}
 		case OUTPUT_TYPE_SCOPE_CLOSE:
 		{
-			if (indent <= 0) {
+			if (state->indent <= 0) {
 				fprintf(stderr, "html: programming error? indent is <= 0");
 				abort();
 			}
@@ -142,14 +154,17 @@ static void to_format(
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(TEMPLATE_DOCUMENT_CLOSE);
+					g_pev_api->output->write_str(ctx, TEMPLATE_DOCUMENT_CLOSE);
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
-					printf(INDENT(--indent, "</%s>\n"), wrap_el);
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write_strs(ctx, "</", wrap_el, ">\n", NULL);
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf(INDENT(--indent, "</ul>\n"));
-					printf(INDENT(--indent, "</%s>\n"), wrap_el);
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write_str(ctx, "</ul>\n");
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write_strs(ctx, "</", wrap_el, ">\n", NULL);
 					break;
 			}
 			break;
@@ -158,21 +173,59 @@ static void to_format(
 		{
 			const char * wrap_el = scope->type == OUTPUT_SCOPE_TYPE_ARRAY ? "li" : "p";
 			if (key && value) {
-				printf(INDENT(indent, "<%s><span class=\"key\"><b>%s</b></span>: <span class=\"value\">%s</span></%s>\n"), wrap_el, escaped_key, escaped_value, wrap_el);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<", wrap_el, "><span class=\"key\"><b>", escaped_key, "</b></span>: <span class=\"value\">", escaped_value, "</span></", wrap_el, ">\n", NULL);
 			} else if (key) {
-				putchar('\n');
-				printf(INDENT(indent, "<%s><span class=\"key\"><b>%s</b></span></%s>\n"), wrap_el, escaped_key, wrap_el);
+				g_pev_api->output->write(ctx, "\n", 1);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<", wrap_el, "><span class=\"key\"><b>", escaped_key, "</b></span></", wrap_el, ">\n", NULL);
 			} else if (value) {
-				printf(INDENT(indent, "<%s><span class=\"value\">%s</span></%s>\n"), wrap_el, escaped_value, wrap_el);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<", wrap_el, "><span class=\"value\">", escaped_value, "</span></", wrap_el, ">\n", NULL);
 			}
 			break;
 		}
 	}
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	html_state_t * const state = g_pev_api->output->format_state(ctx);
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+	const char * const escaped_value = g_pev_api->output->escape_into(&state->value_buffer, value, format->entities_table);
+
+	write_entry(ctx, state, type, scope, key, value, escaped_key, escaped_value);
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	html_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+
+	write_entry(ctx, state, OUTPUT_TYPE_ATTRIBUTE, scope, key, formatted, escaped_key, formatted);
+}
 
-	if (escaped_key != NULL)
-		free(escaped_key);
-	if (escaped_value != NULL)
-		free(escaped_value);
+static void free_state(void *state) {
+	html_state_t * const html_state = state;
+	g_pev_api->output->buffer_free(&html_state->key_buffer);
+	g_pev_api->output->buffer_free(&html_state->value_buffer);
 }
 
 // ----------------------------------------------------------------------------
@@ -185,7 +238,12 @@ static const format_t g_format = {
 	FORMAT_NAME,
 	&to_format,
 	&escape_html,
-	(entity_table_t)g_entities
+	(entity_table_t)g_entities,
+	&to_format_int,
+	sizeof(html_state_t),
+	&free_state,
+	NULL,
+	NULL
 };
 
 #define PLUGIN_TYPE "output"
@@ -44,7 +44,7 @@ const pev_api_t *g_pev_api = NULL;
 
 // REFERENCE: https://tools.ietf.org/html/rfc7159
 // JSON entities '"', '\', ...
-static const entity_t g_entities[255] = {
+static const entity_t g_entities[256] = {
 	NULL,	"\\u0001","\\u0002","\\u0003","\\u0004","\\u0005","\\u0006","\\u0007","\\b","\\u0009", // 0-9
 	"\\n",	"\\t",	"\\u000c","\\r","\\u000e","\\u000f","\\u0010","\\u0011","\\u0012","\\u0013", // 10-19
 	"\\u0014","\\u0015","\\u0016","\\u0017","\\u0018","\\u0019","\\u001a","\\u001b","\\u001c","\\u001d", // 20-29
@@ -77,18 +77,25 @@ static char *escape_json(const format_t *format, const char *str) {
 	return g_pev_api->output->escape(format, str);
 }
 
-static void to_format(
-	const format_t *format,
+// What each output context keeps for this format.
+typedef struct {
+	int indent;
+	int num_attr;
+	output_buffer_t key_buffer;		// Escaped keys and values go to these
+	output_buffer_t value_buffer;	// buffers, reused across calls.
+} json_state_t;
+
+// `key` and `value` are the raw strings; the escaped ones are what gets printed.
+static void write_entry(
+	output_ctx_t *ctx,
+	json_state_t *state,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
-	const char *value)
+	const char *value,
+	const char *escaped_key,
+	const char *escaped_value)
 {
-	static int indent = 0;
-	static int num_attr = 0;
-
-	char * const escaped_key = format->escape_fn(format, key);
-	char * const escaped_value = format->escape_fn(format, value);
 	const bool is_within_array = scope->parent_type == OUTPUT_SCOPE_TYPE_ARRAY;
 
 	switch (type) {
@@ -99,77 +106,120 @@ static void to_format(
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(INDENT(indent++, "{"));
-					num_attr = 0;
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write(ctx, "{", 1);
+					state->num_attr = 0;
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
 					// Already printed an attribute in the same scope?
-					if (num_attr > 0)
-						putchar(',');
-					putchar('\n');
+					if (state->num_attr > 0)
+						g_pev_api->output->write(ctx, ",", 1);
+					g_pev_api->output->write(ctx, "\n", 1);
+					g_pev_api->output->write_indent(ctx, state->indent++);
 					// NOTE: We don't want duplicate keys inside the array.
 					if (key && !is_within_array)
-						printf(INDENT(indent++, "\"%s\": {"), escaped_key);
+						g_pev_api->output->write_strs(ctx, "\"", escaped_key, "\": {", NULL);
 					else
-						printf(INDENT(indent++, "{"));
-					num_attr = 0;
+						g_pev_api->output->write(ctx, "{", 1);
+					state->num_attr = 0;
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
 					// Already printed an attribute in the same scope?
-					if (num_attr > 0)
-						putchar(',');
-					putchar('\n');
+					if (state->num_attr > 0)
+						g_pev_api->output->write(ctx, ",", 1);
+					g_pev_api->output->write(ctx, "\n", 1);
+					g_pev_api->output->write_indent(ctx, state->indent++);
 					// NOTE: We don't want duplicate keys inside the array.
 					if (key && !is_within_array)
-						printf(INDENT(indent++, "\"%s\": ["), escaped_key);
+						g_pev_api->output->write_strs(ctx, "\"", escaped_key, "\": [", NULL);
 					else
-						printf(INDENT(indent++, "["));
-					num_attr = 0;
+						g_pev_api->output->write(ctx, "[", 1);
+					state->num_attr = 0;
 					break;
 			}
 			break;
 		case OUTPUT_TYPE_SCOPE_CLOSE:
-			if (indent <= 0) {
+			if (state->indent <= 0) {
 				fprintf(stderr, "json: programming error? indent is <= 0");
 				abort();
 			}
-			putchar('\n');
+			g_pev_api->output->write(ctx, "\n", 1);
 			switch (scope->type) {
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(INDENT(--indent, "}\n"));
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write(ctx, "}\n", 2);
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
-					printf(INDENT(--indent, "}"));
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write(ctx, "}", 1);
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf(INDENT(--indent, "]"));
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write(ctx, "]", 1);
 					break;
 			}
 			// Increment the number of attributes because this scope is itself an
 			// attribute.
-			num_attr++;
+			state->num_attr++;
 			break;
 		case OUTPUT_TYPE_ATTRIBUTE:
 			// Already printed an attribute in the same scope?
-			if (num_attr > 0)
-				putchar(',');
-			putchar('\n');
+			if (state->num_attr > 0)
+				g_pev_api->output->write(ctx, ",", 1);
+			g_pev_api->output->write(ctx, "\n", 1);
+			if (key || value)
+				g_pev_api->output->write_indent(ctx, state->indent);
 			if (key && value)
-				printf(INDENT(indent, "\"%s\": \"%s\""), escaped_key, escaped_value);
+				g_pev_api->output->write_strs(ctx, "\"", escaped_key, "\": \"", escaped_value, "\"", NULL);
 			else if (key)
-				printf(INDENT(indent, "\"%s\""), escaped_key);
+				g_pev_api->output->write_strs(ctx, "\"", escaped_key, "\"", NULL);
 			else if (value)
-				printf(INDENT(indent, "\"%s\""), escaped_value);
-			num_attr++;
+				g_pev_api->output->write_strs(ctx, "\"", escaped_value, "\"", NULL);
+			state->num_attr++;
 			break;
 	}
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	json_state_t * const state = g_pev_api->output->format_state(ctx);
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+	const char * const escaped_value = g_pev_api->output->escape_into(&state->value_buffer, value, format->entities_table);
+
+	write_entry(ctx, state, type, scope, key, value, escaped_key, escaped_value);
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	json_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+
+	write_entry(ctx, state, OUTPUT_TYPE_ATTRIBUTE, scope, key, formatted, escaped_key, formatted);
+}
 
-	if (escaped_key != NULL)
-		free(escaped_key);
-	if (escaped_value != NULL)
-		free(escaped_value);
+static void free_state(void *state) {
+	json_state_t * const json_state = state;
+	g_pev_api->output->buffer_free(&json_state->key_buffer);
+	g_pev_api->output->buffer_free(&json_state->value_buffer);
 }
 
 // ----------------------------------------------------------------------------
@@ -182,7 +232,12 @@ static const format_t g_format = {
 	FORMAT_NAME,
 	&to_format,
 	&escape_json,
-	(entity_table_t)g_entities
+	(entity_table_t)g_entities,
+	&to_format_int,
+	sizeof(json_state_t),
+	&free_state,
+	NULL,
+	NULL
 };
 
 #define PLUGIN_TYPE "output"
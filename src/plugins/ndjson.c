@@ -0,0 +1,323 @@
+/*
+	pev - the PE file analyzer toolkit
+
+	ndjson.c - Principal implementation file for the NDJSON output plugin
+
+	Copyright (C) 2012 - 2014 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations
+    including the two.
+    
+    You must obey the GNU General Public License in all respects
+    for all of the code used other than OpenSSL.  If you modify
+    file(s) with this exception, you may extend this exception to your
+    version of the file(s), but you are not obligated to do so.  If you
+    do not wish to do so, delete this exception statement from your
+    version.  If you delete this exception statement from all source
+    files in the program, then also delete it here.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pev_api.h"
+#include "output_plugin.h"
+
+const pev_api_t *g_pev_api = NULL;
+
+// REFERENCE: https://tools.ietf.org/html/rfc7159 and http://ndjson.org
+// JSON entities '"', '\', ...
+static const entity_t g_entities[256] = {
+	NULL,	"\\u0001","\\u0002","\\u0003","\\u0004","\\u0005","\\u0006","\\u0007","\\b","\\t", // 0-9
+	"\\n",	"\\u000b","\\f","\\r","\\u000e","\\u000f","\\u0010","\\u0011","\\u0012","\\u0013", // 10-19
+	"\\u0014","\\u0015","\\u0016","\\u0017","\\u0018","\\u0019","\\u001a","\\u001b","\\u001c","\\u001d", // 20-29
+	"\\u001e","\\u001f",NULL,	NULL,	"\\\"",	NULL,	NULL,	NULL,	NULL,	NULL, // 30-39
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 40-49
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 50-59
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 60-69
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 70-79
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 80-89
+	NULL,	NULL,	"\\\\",	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 90-99
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 100-109
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 110-119
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	"\\u007f",NULL,	NULL, // 120-129
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 130-139
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 140-149
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 150-159
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 160-169
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 170-179
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 180-189
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 190-199
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 200-209
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 210-219
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 220-229
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 230-239
+	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL, // 240-249
+	NULL,	NULL,	NULL,	NULL,	NULL, // 250-254
+};
+
+//
+// Newline-delimited JSON: each document is one compact JSON object on a
+// line of its own, for log shippers and stream processors. The document is
+// built in memory and written at once when it's closed, so that records
+// appended to a file by concurrent writers don't interleave.
+//
+// Unlike the JSON output, attributes inside an array are written as
+// single-entry objects, so that every line is valid JSON.
+//
+
+static char *escape_ndjson(const format_t *format, const char *str) {
+	return g_pev_api->output->escape(format, str);
+}
+
+// What each output context keeps for this format.
+typedef struct {
+	int num_attr;
+	output_buffer_t line;	// The document being built.
+} ndjson_state_t;
+
+static void append(ndjson_state_t *state, const char *str, size_t length) {
+	g_pev_api->output->buffer_append(&state->line, str, length);
+}
+
+// Length of the valid UTF-8 sequence at `p`, or 0 if there's none.
+static size_t utf8_sequence_length(const unsigned char *p) {
+	size_t length;
+	uint32_t min;
+	uint32_t codepoint;
+
+	if ((p[0] & 0xe0) == 0xc0) {
+		length = 2; min = 0x80; codepoint = p[0] & 0x1f;
+	} else if ((p[0] & 0xf0) == 0xe0) {
+		length = 3; min = 0x800; codepoint = p[0] & 0x0f;
+	} else if ((p[0] & 0xf8) == 0xf0) {
+		length = 4; min = 0x10000; codepoint = p[0] & 0x07;
+	} else {
+		return 0;
+	}
+
+	// The NUL terminator fails this check, so this never reads past it.
+	for (size_t i = 1; i < length; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+		codepoint = codepoint << 6 | (p[i] & 0x3f);
+	}
+
+	// Overlong forms, surrogates and code points beyond Unicode.
+	if (codepoint < min || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff)
+		return 0;
+
+	return length;
+}
+
+// JSON text must be UTF-8, so bytes that aren't part of a valid sequence
+// are escaped as the code point with the same value, as in Latin-1.
+static void append_string(ndjson_state_t *state, const char *str) {
+	if (str == NULL) {
+		append(state, "null", 4);
+		return;
+	}
+
+	append(state, "\"", 1);
+	const unsigned char *run = (const unsigned char *)str;
+	const unsigned char *p = run;
+	while (*p != '\0') {
+		if (*p < 0x80 && g_entities[*p] == NULL) {
+			p++;
+			continue;
+		}
+		const size_t sequence_length = *p >= 0x80 ? utf8_sequence_length(p) : 0;
+		if (sequence_length > 0) {
+			p += sequence_length;
+			continue;
+		}
+
+		append(state, (const char *)run, (size_t)(p - run));
+		if (*p < 0x80) {
+			const entity_t entity = g_entities[*p];
+			append(state, entity, strlen(entity));
+		} else {
+			static const char digits[] = "0123456789abcdef";
+			const char escaped[6] = { '\\', 'u', '0', '0', digits[*p >> 4], digits[*p & 0xf] };
+			append(state, escaped, sizeof(escaped));
+		}
+		run = ++p;
+	}
+	append(state, (const char *)run, (size_t)(p - run));
+	append(state, "\"", 1);
+}
+
+// Already written an attribute in the same scope?
+static void append_separator(ndjson_state_t *state) {
+	if (state->num_attr > 0)
+		append(state, ",", 1);
+}
+
+static bool is_object(output_scope_type_e scope_type) {
+	return scope_type == OUTPUT_SCOPE_TYPE_DOCUMENT || scope_type == OUTPUT_SCOPE_TYPE_OBJECT;
+}
+
+static void append_attribute(ndjson_state_t *state, const output_scope_t *scope, const char *key, const char *value) {
+	append_separator(state);
+	if (scope != NULL && is_object(scope->type)) {
+		// JSON keys must be strings.
+		append_string(state, key != NULL ? key : "");
+		append(state, ":", 1);
+		append_string(state, value);
+	} else if (key != NULL && value != NULL) {
+		append(state, "{", 1);
+		append_string(state, key);
+		append(state, ":", 1);
+		append_string(state, value);
+		append(state, "}", 1);
+	} else {
+		append_string(state, value != NULL ? value : key);
+	}
+	state->num_attr++;
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	(void)format;
+
+	ndjson_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	switch (type) {
+		default:
+			break;
+		case OUTPUT_TYPE_SCOPE_OPEN:
+			switch (scope->type) {
+				default:
+					break;
+				case OUTPUT_SCOPE_TYPE_DOCUMENT:
+					state->line.length = 0;
+					append(state, "{", 1);
+					state->num_attr = 0;
+					break;
+				case OUTPUT_SCOPE_TYPE_OBJECT:
+				case OUTPUT_SCOPE_TYPE_ARRAY:
+					append_separator(state);
+					if (is_object(scope->parent_type)) {
+						append_string(state, key != NULL ? key : "");
+						append(state, ":", 1);
+					}
+					append(state, scope->type == OUTPUT_SCOPE_TYPE_OBJECT ? "{" : "[", 1);
+					state->num_attr = 0;
+					break;
+			}
+			break;
+		case OUTPUT_TYPE_SCOPE_CLOSE:
+			switch (scope->type) {
+				default:
+					break;
+				case OUTPUT_SCOPE_TYPE_DOCUMENT:
+					append(state, "}\n", 2);
+					g_pev_api->output->write(ctx, state->line.data, state->line.length);
+					state->line.length = 0;
+					break;
+				case OUTPUT_SCOPE_TYPE_OBJECT:
+					append(state, "}", 1);
+					break;
+				case OUTPUT_SCOPE_TYPE_ARRAY:
+					append(state, "]", 1);
+					break;
+			}
+			// Increment the number of attributes because this scope is itself an
+			// attribute.
+			state->num_attr++;
+			break;
+		case OUTPUT_TYPE_ATTRIBUTE:
+			append_attribute(state, scope, key, value);
+			break;
+	}
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	(void)format;
+
+	ndjson_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	append_attribute(state, scope, key, formatted);
+}
+
+static void free_state(void *state) {
+	ndjson_state_t * const ndjson_state = state;
+	g_pev_api->output->buffer_free(&ndjson_state->line);
+}
+
+// ----------------------------------------------------------------------------
+
+#define FORMAT_ID	8
+#define FORMAT_NAME "ndjson"
+
+static const format_t g_format = {
+	FORMAT_ID,
+	FORMAT_NAME,
+	&to_format,
+	&escape_ndjson,
+	(entity_table_t)g_entities,
+	&to_format_int,
+	sizeof(ndjson_state_t),
+	&free_state,
+	NULL,
+	NULL
+};
+
+#define PLUGIN_TYPE "output"
+#define PLUGIN_NAME FORMAT_NAME
+
+int plugin_loaded(void) {
+	//printf("Loading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+	return 0;
+}
+
+void plugin_unloaded(void) {
+	//printf("Unloading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+}
+
+int plugin_initialize(const pev_api_t *api) {
+	g_pev_api = api;
+	int ret = g_pev_api->output->output_plugin_register_format(&g_format);
+	if (ret < 0)
+		return -1;
+	return 0;
+}
+
+void plugin_shutdown(void) {
+	g_pev_api->output->output_plugin_unregister_format(&g_format);
+}
@@ -0,0 +1,680 @@
+/*
+	pev - the PE file analyzer toolkit
+
+	sqlite.c - Principal implementation file for the SQLite output plugin
+
+	Copyright (C) 2012 - 2014 pev authors
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations
+    including the two.
+
+    You must obey the GNU General Public License in all respects
+    for all of the code used other than OpenSSL.  If you modify
+    file(s) with this exception, you may extend this exception to your
+    version of the file(s), but you are not obligated to do so.  If you
+    do not wish to do so, delete this exception statement from your
+    version.  If you delete this exception statement from all source
+    files in the program, then also delete it here.
+*/
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "pev_api.h"
+#include "output_plugin.h"
+
+const pev_api_t *g_pev_api = NULL;
+
+//
+// Writes documents into a local SQLite database instead of the output, as
+// in `-f sqlite:db=results.db`, so they can be queried with SQL.
+//
+// Each document is a row in `files`, which every other table refers to
+// through `file_id`. Sections, imported and exported functions (as output by
+// readpe) go to `sections`, `imports` and `exports`, and hashes (as output by
+// pehash) go to `hashes`. Attributes of the document itself, like the
+// verdicts of pescan, pepack and pesec, go to `findings`. Anything else goes
+// to `attributes`, along with the path of scopes it was in, so nothing is
+// lost.
+//
+// The database uses WAL mode, and inserts use prepared statements within
+// transactions that span `batch=N` documents (1000 by default), so that large
+// corpora aren't held back by commits. Documents of a batch that isn't
+// complete yet are committed when the output ends.
+//
+// REFERENCE: https://www.sqlite.org/wal.html
+//
+
+#define SQLITE_DEFAULT_BATCH_FILES	1000
+#define SQLITE_BUSY_TIMEOUT_MS		5000
+#define SQLITE_MAX_DEPTH			16
+
+static const char * const g_schema =
+	"PRAGMA journal_mode = WAL;"
+	"PRAGMA synchronous = NORMAL;"
+	"CREATE TABLE IF NOT EXISTS files ("
+		"id INTEGER PRIMARY KEY, path TEXT, tool TEXT);"
+	"CREATE TABLE IF NOT EXISTS sections ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), name TEXT, virtual_address INTEGER, "
+		"virtual_size INTEGER, raw_data_pointer INTEGER, raw_data_size INTEGER, characteristics INTEGER);"
+	"CREATE TABLE IF NOT EXISTS imports ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), library TEXT, function TEXT, hint INTEGER, ordinal INTEGER);"
+	"CREATE TABLE IF NOT EXISTS exports ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), library TEXT, function TEXT, ordinal INTEGER, address INTEGER);"
+	"CREATE TABLE IF NOT EXISTS hashes ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), scope TEXT, name TEXT, algorithm TEXT, value TEXT);"
+	"CREATE TABLE IF NOT EXISTS findings ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), name TEXT, value);"
+	"CREATE TABLE IF NOT EXISTS attributes ("
+		"file_id INTEGER NOT NULL REFERENCES files(id), scope TEXT, name TEXT, value);"
+	"CREATE INDEX IF NOT EXISTS sections_file_id ON sections(file_id);"
+	"CREATE INDEX IF NOT EXISTS imports_file_id ON imports(file_id);"
+	"CREATE INDEX IF NOT EXISTS exports_file_id ON exports(file_id);"
+	"CREATE INDEX IF NOT EXISTS hashes_file_id ON hashes(file_id);"
+	"CREATE INDEX IF NOT EXISTS findings_file_id ON findings(file_id);"
+	"CREATE INDEX IF NOT EXISTS attributes_file_id ON attributes(file_id);";
+
+typedef enum {
+	STATEMENT_FILE,
+	STATEMENT_SECTION,
+	STATEMENT_IMPORT,
+	STATEMENT_EXPORT,
+	STATEMENT_HASH,
+	STATEMENT_FINDING,
+	STATEMENT_ATTRIBUTE,
+	STATEMENT_BEGIN,
+	STATEMENT_COMMIT,
+	STATEMENT_COUNT
+} statement_e;
+
+static const char * const g_statements[STATEMENT_COUNT] = {
+	[STATEMENT_FILE]		= "INSERT INTO files (path, tool) VALUES (?1, ?2)",
+	[STATEMENT_SECTION]		= "INSERT INTO sections VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)",
+	[STATEMENT_IMPORT]		= "INSERT INTO imports VALUES (?1, ?2, ?3, ?4, ?5)",
+	[STATEMENT_EXPORT]		= "INSERT INTO exports VALUES (?1, ?2, ?3, ?4, ?5)",
+	[STATEMENT_HASH]		= "INSERT INTO hashes VALUES (?1, ?2, ?3, ?4, ?5)",
+	[STATEMENT_FINDING]		= "INSERT INTO findings VALUES (?1, ?2, ?3)",
+	[STATEMENT_ATTRIBUTE]	= "INSERT INTO attributes VALUES (?1, ?2, ?3, ?4)",
+	[STATEMENT_BEGIN]		= "BEGIN",
+	[STATEMENT_COMMIT]		= "COMMIT"
+};
+
+// Which parameter of a record's statement each attribute binds to.
+typedef struct {
+	statement_e statement;
+	const char *key;
+	int parameter;
+} record_column_t;
+
+static const record_column_t g_record_columns[] = {
+	{ STATEMENT_SECTION,	"Name",					2 },
+	{ STATEMENT_SECTION,	"Virtual Address",		3 },
+	{ STATEMENT_SECTION,	"Virtual Size",			4 },
+	{ STATEMENT_SECTION,	"Pointer To Raw Data",	5 },
+	{ STATEMENT_SECTION,	"Size Of Raw Data",		6 },
+	{ STATEMENT_SECTION,	"Characteristics",		7 },
+	{ STATEMENT_IMPORT,		"Name",					3 },
+	{ STATEMENT_IMPORT,		"Hint",					4 },
+	{ STATEMENT_IMPORT,		"Ordinal",				5 },
+	{ STATEMENT_EXPORT,		"Name",					3 },
+	{ STATEMENT_EXPORT,		"Ordinal",				4 },
+	{ STATEMENT_EXPORT,		"Address",				5 },
+};
+
+static const char * const g_hash_algorithms[] = { "md5", "sha1", "sha256", "ssdeep", "imphash" };
+// Attributes that name what the hashes in the same scope are of.
+static const char * const g_hash_labels[] = { "filepath", "header_name", "section_name" };
+
+typedef struct {
+	const char *name;
+	output_scope_type_e type;
+} scope_entry_t;
+
+// What each output context keeps for this format.
+typedef struct {
+	char *database;				// Path of the database, from `db=`.
+	size_t batch_size;			// Documents per transaction, from `batch=`.
+	sqlite3 *db;
+	sqlite3_stmt *statements[STATEMENT_COUNT];
+	bool failed;				// Set on the first error; later output is dropped.
+	bool in_transaction;
+	size_t batch_files;			// Documents in the current transaction.
+	sqlite3_int64 file_id;
+
+	scope_entry_t scopes[SQLITE_MAX_DEPTH];
+	size_t depth;
+	size_t record_depth;		// Depth of the current record's scope, or 0.
+	statement_e record;			// Statement of the current record.
+	char *library;				// Name of the library of imports and exports.
+	char *hash_label;			// What the hashes of the current scope are of.
+
+	output_buffer_t scope_path;
+} sqlite_state_t;
+
+static char *escape_sqlite(const format_t *format, const char *str) {
+	return g_pev_api->output->escape(format, str);
+}
+
+static bool string_in(const char *str, const char * const *list, size_t count) {
+	if (str == NULL)
+		return false;
+	for (size_t i = 0; i < count; i++) {
+		if (strcmp(str, list[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void replace_string(char **target, const char *value) {
+	free(*target);
+	*target = NULL;
+	if (value != NULL) {
+		*target = strdup(value);
+		if (*target == NULL)
+			abort(); // Abort because it failed miserably!
+	}
+}
+
+// Reports the first error, after which nothing else is written.
+static void fail(sqlite_state_t *state, const char *what) {
+	if (state->failed)
+		return;
+	fprintf(stderr, "sqlite: %s: %s: %s\n", state->database, what,
+		state->db != NULL ? sqlite3_errmsg(state->db) : "out of memory");
+	state->failed = true;
+}
+
+static void execute(sqlite_state_t *state, statement_e statement) {
+	if (state->failed)
+		return;
+
+	sqlite3_stmt * const stmt = state->statements[statement];
+	const int rc = sqlite3_step(stmt);
+	if (rc != SQLITE_DONE)
+		fail(state, "insert failed");
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+}
+
+//
+// Binding values.
+//
+
+static void bind_text(sqlite3_stmt *stmt, int parameter, const char *value) {
+	if (value == NULL)
+		sqlite3_bind_null(stmt, parameter);
+	else
+		sqlite3_bind_text(stmt, parameter, value, -1, SQLITE_TRANSIENT);
+}
+
+static void bind_uint64(sqlite3_stmt *stmt, int parameter, uint64_t value) {
+	if (value <= INT64_MAX) {
+		sqlite3_bind_int64(stmt, parameter, (sqlite3_int64)value);
+	} else {
+		char formatted[OUTPUT_INT_BUFFER_SIZE];
+		snprintf(formatted, sizeof(formatted), "%" PRIu64, value);
+		bind_text(stmt, parameter, formatted);
+	}
+}
+
+// Binds `value` as an integer if it is one, as "7" or "0x5000" are.
+static void bind_number(sqlite3_stmt *stmt, int parameter, const char *value) {
+	if (value != NULL && *value != '\0') {
+		char *end;
+		const unsigned long long number = strtoull(value, &end, 0);
+		if (*end == '\0') {
+			bind_uint64(stmt, parameter, number);
+			return;
+		}
+	}
+	bind_text(stmt, parameter, value);
+}
+
+static void bind_value(sqlite3_stmt *stmt, int parameter, bool is_int, uint64_t int_value, const char *value) {
+	if (is_int)
+		bind_uint64(stmt, parameter, int_value);
+	else
+		bind_text(stmt, parameter, value);
+}
+
+//
+// Database.
+//
+
+static void open_database(sqlite_state_t *state) {
+	if (state->database == NULL) {
+		fprintf(stderr, "sqlite: no database given; use -f sqlite:db=<file>\n");
+		state->failed = true;
+		return;
+	}
+
+	// Only local files; set_option() rejects URIs and special names.
+	const int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	if (sqlite3_open_v2(state->database, &state->db, flags, NULL) != SQLITE_OK) {
+		fail(state, "cannot open the database");
+		return;
+	}
+
+	sqlite3_busy_timeout(state->db, SQLITE_BUSY_TIMEOUT_MS);
+
+	if (sqlite3_exec(state->db, g_schema, NULL, NULL, NULL) != SQLITE_OK) {
+		fail(state, "cannot create the tables");
+		return;
+	}
+
+	for (size_t i = 0; i < STATEMENT_COUNT; i++) {
+		if (sqlite3_prepare_v2(state->db, g_statements[i], -1, &state->statements[i], NULL) != SQLITE_OK) {
+			fail(state, "cannot prepare statements");
+			return;
+		}
+	}
+}
+
+static void close_database(sqlite_state_t *state) {
+	for (size_t i = 0; i < STATEMENT_COUNT; i++) {
+		sqlite3_finalize(state->statements[i]);
+		state->statements[i] = NULL;
+	}
+	sqlite3_close(state->db);
+	state->db = NULL;
+}
+
+static void commit(sqlite_state_t *state) {
+	if (!state->in_transaction)
+		return;
+	execute(state, STATEMENT_COMMIT);
+	state->in_transaction = false;
+	state->batch_files = 0;
+}
+
+// Name of the tool, from the command line.
+static const char *tool_name(output_buffer_t *buffer) {
+	const char * const cmdline = g_pev_api->output->output_cmdline();
+	if (cmdline == NULL)
+		return NULL;
+
+	const char *start = cmdline;
+	const char *end = strchr(cmdline, ' ');
+	if (end == NULL)
+		end = cmdline + strlen(cmdline);
+	for (const char *p = cmdline; p < end; p++) {
+		if (*p == '/' || *p == '\\')
+			start = p + 1;
+	}
+
+	buffer->length = 0;
+	g_pev_api->output->buffer_append(buffer, start, (size_t)(end - start));
+	g_pev_api->output->buffer_append(buffer, "", 1);
+	return buffer->data;
+}
+
+static void begin_file(sqlite_state_t *state, const char *path) {
+	if (state->db == NULL && !state->failed)
+		open_database(state);
+	if (state->failed)
+		return;
+
+	if (!state->in_transaction) {
+		execute(state, STATEMENT_BEGIN);
+		state->in_transaction = true;
+	}
+
+	sqlite3_stmt * const stmt = state->statements[STATEMENT_FILE];
+	bind_text(stmt, 1, path);
+	bind_text(stmt, 2, tool_name(&state->scope_path));
+	execute(state, STATEMENT_FILE);
+	state->file_id = sqlite3_last_insert_rowid(state->db);
+}
+
+static void end_file(sqlite_state_t *state) {
+	const size_t batch_size = state->batch_size != 0 ? state->batch_size : SQLITE_DEFAULT_BATCH_FILES;
+	if (++state->batch_files >= batch_size)
+		commit(state);
+}
+
+//
+// Scopes and records.
+//
+
+// Name of the record a scope is: its key, or that of the array it is in.
+static const char *record_name(const sqlite_state_t *state, size_t depth) {
+	if (depth > 0 && state->scopes[depth - 1].type == OUTPUT_SCOPE_TYPE_ARRAY)
+		return state->scopes[depth - 1].name;
+	return state->scopes[depth].name;
+}
+
+static bool name_is(const char *name, const char *expected) {
+	return name != NULL && strcmp(name, expected) == 0;
+}
+
+static void begin_record(sqlite_state_t *state, statement_e record) {
+	state->record = record;
+	state->record_depth = state->depth;
+
+	sqlite3_stmt * const stmt = state->statements[record];
+	sqlite3_bind_int64(stmt, 1, state->file_id);
+	if (record == STATEMENT_IMPORT || record == STATEMENT_EXPORT)
+		bind_text(stmt, 2, state->library);
+}
+
+// Sections are objects in "Sections", and imported and exported functions
+// are objects in the "Functions" of each library.
+static void match_record(sqlite_state_t *state) {
+	const size_t depth = state->depth;
+	const char * const name = record_name(state, depth);
+
+	if (name_is(name, "Sections")) {
+		begin_record(state, STATEMENT_SECTION);
+	} else if (name_is(name, "Functions") && depth >= 3) {
+		const char * const list = state->scopes[depth - 3].name;
+		if (name_is(list, "Imported functions"))
+			begin_record(state, STATEMENT_IMPORT);
+		else if (name_is(list, "Exported functions"))
+			begin_record(state, STATEMENT_EXPORT);
+	}
+}
+
+// Path of the scopes enclosing the current attribute, as "Sections/Section".
+static const char *scope_path(sqlite_state_t *state) {
+	output_buffer_t * const buffer = &state->scope_path;
+	buffer->length = 0;
+
+	for (size_t depth = 1; depth <= state->depth; depth++) {
+		const char * const name = state->scopes[depth].name;
+		if (name == NULL)
+			continue;
+		if (buffer->length > 0)
+			g_pev_api->output->buffer_append(buffer, "/", 1);
+		g_pev_api->output->buffer_append(buffer, name, strlen(name));
+	}
+
+	if (buffer->length == 0)
+		return NULL;
+	g_pev_api->output->buffer_append(buffer, "", 1);
+	return buffer->data;
+}
+
+static bool bind_record_column(sqlite_state_t *state, const char *key, bool is_int, uint64_t int_value, const char *value) {
+	if (state->record_depth == 0 || state->depth != state->record_depth || key == NULL)
+		return false;
+
+	for (size_t i = 0; i < sizeof(g_record_columns) / sizeof(g_record_columns[0]); i++) {
+		const record_column_t * const column = &g_record_columns[i];
+		if (column->statement != state->record || strcmp(column->key, key) != 0)
+			continue;
+
+		sqlite3_stmt * const stmt = state->statements[state->record];
+		// Names are text; everything else is a number, even if output as text.
+		if (strcmp(key, "Name") == 0)
+			bind_value(stmt, column->parameter, is_int, int_value, value);
+		else if (is_int)
+			bind_uint64(stmt, column->parameter, int_value);
+		else
+			bind_number(stmt, column->parameter, value);
+		return true;
+	}
+
+	return false;
+}
+
+static void attribute(sqlite_state_t *state, const char *key, bool is_int, uint64_t int_value, const char *value) {
+	if (state->failed || state->db == NULL)
+		return;
+
+	// In arrays, a key alone is a value, as in arrays of names.
+	if (!is_int && value == NULL && state->scopes[state->depth].type == OUTPUT_SCOPE_TYPE_ARRAY) {
+		value = key;
+		key = NULL;
+	}
+
+	if (bind_record_column(state, key, is_int, int_value, value))
+		return;
+
+	// The name of a library, for its imported or exported functions.
+	if (name_is(key, "Name") && !is_int && state->depth >= 1) {
+		const char * const list = record_name(state, state->depth);
+		if (name_is(list, "Imported functions") || name_is(list, "Exported functions")) {
+			replace_string(&state->library, value);
+			return;
+		}
+	}
+
+	if (string_in(key, g_hash_labels, sizeof(g_hash_labels) / sizeof(g_hash_labels[0])) && !is_int) {
+		replace_string(&state->hash_label, value);
+		return;
+	}
+
+	if (string_in(key, g_hash_algorithms, sizeof(g_hash_algorithms) / sizeof(g_hash_algorithms[0])) && !is_int) {
+		sqlite3_stmt * const stmt = state->statements[STATEMENT_HASH];
+		sqlite3_bind_int64(stmt, 1, state->file_id);
+		bind_text(stmt, 2, state->scopes[state->depth].name);
+		bind_text(stmt, 3, state->hash_label);
+		bind_text(stmt, 4, key);
+		bind_text(stmt, 5, value);
+		execute(state, STATEMENT_HASH);
+		return;
+	}
+
+	if (state->depth == 0) {
+		sqlite3_stmt * const stmt = state->statements[STATEMENT_FINDING];
+		sqlite3_bind_int64(stmt, 1, state->file_id);
+		bind_text(stmt, 2, key);
+		bind_value(stmt, 3, is_int, int_value, value);
+		execute(state, STATEMENT_FINDING);
+		return;
+	}
+
+	sqlite3_stmt * const stmt = state->statements[STATEMENT_ATTRIBUTE];
+	sqlite3_bind_int64(stmt, 1, state->file_id);
+	bind_text(stmt, 2, scope_path(state));
+	bind_text(stmt, 3, key);
+	bind_value(stmt, 4, is_int, int_value, value);
+	execute(state, STATEMENT_ATTRIBUTE);
+}
+
+static void open_scope(sqlite_state_t *state, const output_scope_t *scope) {
+	if (scope->type == OUTPUT_SCOPE_TYPE_DOCUMENT) {
+		state->depth = 0;
+		begin_file(state, scope->name);
+	} else if (++state->depth >= SQLITE_MAX_DEPTH) {
+		fprintf(stderr, "sqlite: programming error? too many nested scopes");
+		abort();
+	}
+
+	state->scopes[state->depth].name = scope->name;
+	state->scopes[state->depth].type = scope->type;
+
+	if (scope->type == OUTPUT_SCOPE_TYPE_OBJECT) {
+		replace_string(&state->hash_label, NULL);
+		if (state->record_depth == 0 && !state->failed)
+			match_record(state);
+	}
+}
+
+static void close_scope(sqlite_state_t *state) {
+	if (state->record_depth != 0 && state->depth == state->record_depth) {
+		execute(state, state->record);
+		state->record_depth = 0;
+	}
+
+	if (state->depth == 0) {
+		replace_string(&state->library, NULL);
+		replace_string(&state->hash_label, NULL);
+		if (!state->failed)
+			end_file(state);
+		return;
+	}
+
+	state->depth--;
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	(void)format;
+	sqlite_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	switch (type) {
+		default:
+			break;
+		case OUTPUT_TYPE_SCOPE_OPEN:
+			open_scope(state, scope);
+			break;
+		case OUTPUT_TYPE_SCOPE_CLOSE:
+			close_scope(state);
+			break;
+		case OUTPUT_TYPE_ATTRIBUTE:
+			attribute(state, key, false, 0, value);
+			break;
+	}
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	(void)format;
+	(void)scope;
+	(void)hint;
+	sqlite_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	attribute(state, key, true, value, NULL);
+}
+
+// Commits the documents of the last batch.
+static void finish(output_ctx_t *ctx, const format_t *format) {
+	(void)format;
+	sqlite_state_t * const state = g_pev_api->output->format_state(ctx);
+	if (state != NULL)
+		commit(state);
+}
+
+// Whether `name` is a plain path. SQLite reads names that start with
+// "file:" as URIs, if it was built to, and reserves those that start with
+// ':', as ":memory:" is.
+static bool is_local_file(const char *name) {
+	return *name != '\0' && *name != ':' && strncmp(name, "file:", 5) != 0;
+}
+
+// Options are comma-separated: `db=<file>`, which is required, and
+// `batch=<documents>`. The database is opened here, so that a tool fails
+// early, rather than analysing files whose output would be lost.
+static int set_option(output_ctx_t *ctx, const format_t *format, const char *option) {
+	(void)format;
+	sqlite_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	char * const options = strdup(option);
+	if (options == NULL)
+		abort(); // Abort because it failed miserably!
+	int result = 0;
+
+	for (char *saveptr = NULL, *item = strtok_r(options, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+		if (strncmp(item, "db=", 3) == 0) {
+			if (!is_local_file(item + 3)) {
+				fprintf(stderr, "sqlite: %s: not a local file\n", item + 3);
+				result = -1;
+				break;
+			}
+			replace_string(&state->database, item + 3);
+		} else if (strncmp(item, "batch=", 6) == 0) {
+			char *end;
+			const unsigned long files = strtoul(item + 6, &end, 10);
+			if (item[6] == '\0' || *end != '\0' || files == 0) {
+				result = -1;
+				break;
+			}
+			state->batch_size = files;
+		} else {
+			result = -1;
+			break;
+		}
+	}
+
+	free(options);
+	if (result < 0)
+		return -1;
+
+	open_database(state);
+	return state->failed ? -1 : 0;
+}
+
+static void free_state(void *state) {
+	sqlite_state_t * const sqlite_state = state;
+
+	close_database(sqlite_state);
+	free(sqlite_state->database);
+	free(sqlite_state->library);
+	free(sqlite_state->hash_label);
+	g_pev_api->output->buffer_free(&sqlite_state->scope_path);
+}
+
+// ----------------------------------------------------------------------------
+
+#define FORMAT_ID	10
+#define FORMAT_NAME "sqlite"
+
+static const format_t g_format = {
+	FORMAT_ID,
+	FORMAT_NAME,
+	&to_format,
+	&escape_sqlite,
+	NULL,
+	&to_format_int,
+	sizeof(sqlite_state_t),
+	&free_state,
+	&set_option,
+	&finish
+};
+
+#define PLUGIN_TYPE "output"
+#define PLUGIN_NAME FORMAT_NAME
+
+int plugin_loaded(void) {
+	//printf("Loading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+	return 0;
+}
+
+void plugin_unloaded(void) {
+	//printf("Unloading %s plugin %s\n", PLUGIN_TYPE, PLUGIN_NAME);
+}
+
+int plugin_initialize(const pev_api_t *api) {
+	g_pev_api = api;
+	int ret = g_pev_api->output->output_plugin_register_format(&g_format);
+	if (ret < 0)
+		return -1;
+	return 0;
+}
+
+void plugin_shutdown(void) {
+	g_pev_api->output->output_plugin_unregister_format(&g_format);
+}
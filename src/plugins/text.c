@@ -47,18 +47,31 @@ static char *escape_text(const format_t *format, const char *str) {
 
 #define SPACES 32 // spaces # for text-based output
 
-static void to_format(
-	const format_t *format,
+// Writes what printf("%*c", width, ' ') would.
+static void write_padding(output_ctx_t *ctx, int width) {
+	if (width < 0)
+		width = -width;
+	g_pev_api->output->write_spaces(ctx, width > 1 ? (size_t)width : 1);
+}
+
+// What each output context keeps for this format.
+typedef struct {
+	int indent;
+	output_buffer_t key_buffer;		// Escaped keys and values go to these
+	output_buffer_t value_buffer;	// buffers, reused across calls.
+} text_state_t;
+
+// `key` and `value` are the raw strings; the escaped ones are what gets printed.
+static void write_entry(
+	output_ctx_t *ctx,
+	text_state_t *state,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
-	const char *value)
+	const char *value,
+	const char *escaped_key,
+	const char *escaped_value)
 {
-	static int indent = 0;
-
-	char * const escaped_key = format->escape_fn(format, key);
-	char * const escaped_value = format->escape_fn(format, value);
-
 	switch (type) {
 		default:
 			break;
@@ -70,42 +83,85 @@ static void to_format(
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
 					if (key) {
-						printf(INDENT(indent++, "%s\n"), escaped_key);
+						g_pev_api->output->write_indent(ctx, state->indent++);
+						g_pev_api->output->write_strs(ctx, escaped_key, "\n", NULL);
 					} else {
-						indent++;
+						state->indent++;
 					}
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
 					//putchar('\n');
 					if (key) {
-						printf(INDENT(indent++, "%s\n"), escaped_key);
+						g_pev_api->output->write_indent(ctx, state->indent++);
+						g_pev_api->output->write_strs(ctx, escaped_key, "\n", NULL);
 					} else {
-						indent++;
+						state->indent++;
 					}
 					break;
 			}
 			break;
 		case OUTPUT_TYPE_SCOPE_CLOSE:
-			indent--;
+			state->indent--;
 			break;
 		case OUTPUT_TYPE_ATTRIBUTE:
 		{
 			const size_t key_size = key ? strlen(key) : 0;
 			if (key && value) {
-				printf(INDENT(indent, "%s:%*c%s\n"), escaped_key, (int)(SPACES - key_size), ' ', escaped_value);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, escaped_key, ":", NULL);
+				write_padding(ctx, (int)(SPACES - key_size));
+				g_pev_api->output->write_strs(ctx, escaped_value, "\n", NULL);
 			} else if (key) {
-				printf(INDENT(indent, "%s\n"), escaped_key);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, escaped_key, "\n", NULL);
 			} else if (value) {
-				printf(INDENT(indent, "%*c%s\n"), (int)(SPACES - key_size + 1), ' ', escaped_value);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				write_padding(ctx, (int)(SPACES - key_size + 1));
+				g_pev_api->output->write_strs(ctx, escaped_value, "\n", NULL);
 			}
 			break;
 		}
 	}
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	text_state_t * const state = g_pev_api->output->format_state(ctx);
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+	const char * const escaped_value = g_pev_api->output->escape_into(&state->value_buffer, value, format->entities_table);
+
+	write_entry(ctx, state, type, scope, key, value, escaped_key, escaped_value);
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	text_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+
+	write_entry(ctx, state, OUTPUT_TYPE_ATTRIBUTE, scope, key, formatted, escaped_key, formatted);
+}
 
-	if (escaped_key != NULL)
-		free(escaped_key);
-	if (escaped_value != NULL)
-		free(escaped_value);
+static void free_state(void *state) {
+	text_state_t * const text_state = state;
+	g_pev_api->output->buffer_free(&text_state->key_buffer);
+	g_pev_api->output->buffer_free(&text_state->value_buffer);
 }
 
 // ----------------------------------------------------------------------------
@@ -118,6 +174,11 @@ static const format_t g_format = {
 	FORMAT_NAME,
 	&to_format,
 	&escape_text,
+	NULL,
+	&to_format_int,
+	sizeof(text_state_t),
+	&free_state,
+	NULL,
 	NULL
 };
 
@@ -42,7 +42,7 @@ const pev_api_t *g_pev_api = NULL;
 
 // REFERENCE: http://en.wikipedia.org/wiki/List_of_XML_and_HTML_character_entity_references
 // XML entities '"', '&', '\'', '<', '>'
-static const entity_t g_entities[255] = {
+static const entity_t g_entities[256] = {
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
 	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,	NULL,
@@ -81,20 +81,26 @@ static char *escape_xml(const format_t *format, const char *str) {
 #define TEMPLATE_DOCUMENT_CLOSE \
 	"</document>\n"
 
-static void to_format(
-	const format_t *format,
+// What each output context keeps for this format.
+typedef struct {
+	int indent;
+	output_buffer_t key_buffer;		// Escaped keys and values go to these
+	output_buffer_t value_buffer;	// buffers, reused across calls.
+} xml_state_t;
+
+// `key` and `value` are the raw strings; the escaped ones are what gets printed.
+static void write_entry(
+	output_ctx_t *ctx,
+	xml_state_t *state,
 	const output_type_e type,
 	const output_scope_t *scope,
 	const char *key,
-	const char *value)
+	const char *value,
+	const char *escaped_key,
+	const char *escaped_value)
 {
-	static int indent = 0;
-
 	// FIXME(jweyrich): Somehow output the XML root element.
 
-	char * const escaped_key = format->escape_fn(format, key);
-	char * const escaped_value = format->escape_fn(format, value);
-
 	//
 	// Quoting http://www.w3schools.com/xml/xml_elements.asp
 	//
@@ -113,19 +119,21 @@ static void to_format(
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(TEMPLATE_DOCUMENT_OPEN, g_pev_api->output->output_cmdline());
-					indent++;
+					g_pev_api->output->writef(ctx, TEMPLATE_DOCUMENT_OPEN, g_pev_api->output->output_cmdline());
+					state->indent++;
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
-					printf(INDENT(indent++, "<object name=\"%s\">\n"), escaped_key);
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write_strs(ctx, "<object name=\"", escaped_key, "\">\n", NULL);
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf(INDENT(indent++, "<array name=\"%s\">\n"), escaped_key);
+					g_pev_api->output->write_indent(ctx, state->indent++);
+					g_pev_api->output->write_strs(ctx, "<array name=\"", escaped_key, "\">\n", NULL);
 					break;
 			}
 			break;
 		case OUTPUT_TYPE_SCOPE_CLOSE:
-			if (indent <= 0) {
+			if (state->indent <= 0) {
 				fprintf(stderr, "xml: programming error? indent is <= 0");
 				abort();
 			}
@@ -133,31 +141,71 @@ static void to_format(
 				default:
 					break;
 				case OUTPUT_SCOPE_TYPE_DOCUMENT:
-					printf(TEMPLATE_DOCUMENT_CLOSE);
+					g_pev_api->output->write_str(ctx, TEMPLATE_DOCUMENT_CLOSE);
 					break;
 				case OUTPUT_SCOPE_TYPE_OBJECT:
-					printf(INDENT(--indent, "</object>\n"));
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write_str(ctx, "</object>\n");
 					break;
 				case OUTPUT_SCOPE_TYPE_ARRAY:
-					printf(INDENT(--indent, "</array>\n"));
+					g_pev_api->output->write_indent(ctx, --state->indent);
+					g_pev_api->output->write_str(ctx, "</array>\n");
 					break;
 			}
 			break;
 		case OUTPUT_TYPE_ATTRIBUTE:
 			if (key && value) {
-				printf(INDENT(indent, "<attribute name=\"%s\">%s</attribute>\n"), escaped_key, escaped_value);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<attribute name=\"", escaped_key, "\">", escaped_value, "</attribute>\n", NULL);
 			} else if (key) {
-				printf(INDENT(indent, "<attribute name=\"%s\">\n"), escaped_key);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<attribute name=\"", escaped_key, "\">\n", NULL);
 			} else if (value) {
-				printf(INDENT(indent, "<attribute>%s</attribute>\n"), value);
+				g_pev_api->output->write_indent(ctx, state->indent);
+				g_pev_api->output->write_strs(ctx, "<attribute>", value, "</attribute>\n", NULL);
 			}
 			break;
 	}
+}
+
+static void to_format(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_type_e type,
+	const output_scope_t *scope,
+	const char *key,
+	const char *value)
+{
+	xml_state_t * const state = g_pev_api->output->format_state(ctx);
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+	const char * const escaped_value = g_pev_api->output->escape_into(&state->value_buffer, value, format->entities_table);
+
+	write_entry(ctx, state, type, scope, key, value, escaped_key, escaped_value);
+}
+
+static void to_format_int(
+	output_ctx_t *ctx,
+	const format_t *format,
+	const output_scope_t *scope,
+	const char *key,
+	uint64_t value,
+	output_int_hint_e hint)
+{
+	xml_state_t * const state = g_pev_api->output->format_state(ctx);
+
+	// Formatted integers never need escaping.
+	char formatted[OUTPUT_INT_BUFFER_SIZE];
+	g_pev_api->output->format_int(formatted, sizeof(formatted), value, hint);
+
+	const char * const escaped_key = g_pev_api->output->escape_key_into(&state->key_buffer, key, format->entities_table);
+
+	write_entry(ctx, state, OUTPUT_TYPE_ATTRIBUTE, scope, key, formatted, escaped_key, formatted);
+}
 
-	if (escaped_key != NULL)
-		free(escaped_key);
-	if (escaped_value != NULL)
-		free(escaped_value);
+static void free_state(void *state) {
+	xml_state_t * const xml_state = state;
+	g_pev_api->output->buffer_free(&xml_state->key_buffer);
+	g_pev_api->output->buffer_free(&xml_state->value_buffer);
 }
 
 // ----------------------------------------------------------------------------
@@ -170,7 +218,12 @@ static const format_t g_format = {
 	FORMAT_NAME,
 	&to_format,
 	&escape_xml,
-	(entity_table_t)g_entities
+	(entity_table_t)g_entities,
+	&to_format_int,
+	sizeof(xml_state_t),
+	&free_state,
+	NULL,
+	NULL
 };
 
 #define PLUGIN_TYPE "output"
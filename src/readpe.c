@@ -37,7 +37,13 @@
 #include "common.h"
 #include <time.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
 #include "output.h"
+#include "hashtable.h"
+#include "pe_clr.h"
+#include "pe_map.h"
+#include "pe_tables.h"
 
 #define PROGRAM "readpe"
 
@@ -51,6 +57,21 @@ typedef struct {
 	bool exports;
 	bool all_headers;
 	bool all_sections;
+	bool clr;
+	bool clr_refs;
+	bool clr_types;
+	bool relocs;
+	bool reloc_entries;
+	bool reloc_summary;
+	bool map;
+	uint64_t *what_is_offsets;
+	size_t what_is_offsets_count;
+	const char **export_names;
+	size_t export_names_count;
+	uint32_t *export_ordinals;
+	size_t export_ordinals_count;
+	const char **import_queries;
+	size_t import_queries_count;
 } options_t;
 
 static void usage(void)
@@ -65,10 +86,24 @@ static void usage(void)
 		" -H, --all-headers						 Show all PE headers.\n"
 		" -S, --all-sections					 Show PE section headers.\n"
 		" -f, --format <%s>  Change output format (default: text).\n"
+		" --fields <key,...>					 Output only these keys and the scopes named so.\n"
+		" --output-fd <fd>						 Write the output to an open file descriptor (default: 1).\n"
+		" --compress <gzip|zstd>				 Compress the output as a single stream.\n"
 		" -d, --dirs							 Show data directories.\n"
 		" -h, --header <dos|coff|optional>		 Show specific header. It can be used multiple times.\n"
 		" -i, --imports							 Show imported functions.\n"
 		" -e, --exports							 Show exported functions.\n"
+		" --export <name>						 Look up an exported function by name. It can be used multiple times.\n"
+		" --ordinal <n>							 Look up an exported function by ordinal. It can be used multiple times.\n"
+		" --import <dll!function>				 Look up an imported function (use #n for ordinals). It can be used multiple times.\n"
+		" -r, --relocs							 Show base relocations, per page.\n"
+		" --reloc-entries						 Show every base relocation fixup (implies -r).\n"
+		" --reloc-summary						 Show base relocation totals.\n"
+		" --map									 Show the regions of the file, with gaps and overlaps.\n"
+		" --what-is <offset>					 Show which regions contain a file offset. It can be used multiple times.\n"
+		" --clr									 Show the .NET CLR header and metadata tables.\n"
+		" --clr-refs							 Show .NET assembly references.\n"
+		" --clr-types							 Show .NET type definitions.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
 		PROGRAM, PROGRAM, formats);
@@ -92,6 +127,10 @@ static void free_options(options_t *options)
 	//if (options == NULL)
 	//	return;
 
+	free(options->export_names);
+	free(options->export_ordinals);
+	free(options->import_queries);
+	free(options->what_is_offsets);
 	free(options);
 }
 
@@ -100,7 +139,7 @@ static options_t *parse_options(int argc, char *argv[])
 	options_t *options = calloc_s(1, sizeof(options_t));
 
 	/* Parameters for getopt_long() function */
-	static const char short_options[] = "AHSh:dief:V";
+	static const char short_options[] = "AHSh:dief:rV";
 
 	static const struct option long_options[] = {
 		{ "help",			  no_argument,		 NULL,	1  },
@@ -111,13 +150,33 @@ static options_t *parse_options(int argc, char *argv[])
 		{ "imports",		  no_argument,		 NULL, 'i' },
 		{ "exports",		  no_argument,		 NULL, 'e' },
 		{ "dirs",			  no_argument,		 NULL, 'd' },
+		{ "relocs",			  no_argument,		 NULL, 'r' },
+		{ "reloc-entries",	  no_argument,		 NULL,	8  },
+		{ "reloc-summary",	  no_argument,		 NULL,	9  },
+		{ "map",			  no_argument,		 NULL,	10 },
+		{ "what-is",		  required_argument, NULL,	11 },
+		{ "export",			  required_argument, NULL,	2  },
+		{ "ordinal",		  required_argument, NULL,	3  },
+		{ "import",			  required_argument, NULL,	4  },
+		{ "clr",			  no_argument,		 NULL,	5  },
+		{ "clr-refs",		  no_argument,		 NULL,	6  },
+		{ "clr-types",		  no_argument,		 NULL,	7  },
 		{ "format",			  required_argument, NULL, 'f' },
+		{ "fields",			  required_argument, NULL,	14 },
+		{ "output-fd",		  required_argument, NULL,	12 },
+		{ "compress",		  required_argument, NULL,	13 },
 		{ "version",		  no_argument,		 NULL, 'V' },
 		{  NULL,			  0,				 NULL,	0  }
 	};
 
 	options->all = true;
 
+	// Every query option takes one argument, so `argc` bounds how many there can be.
+	options->export_names = calloc_s(argc, sizeof(*options->export_names));
+	options->export_ordinals = calloc_s(argc, sizeof(*options->export_ordinals));
+	options->import_queries = calloc_s(argc, sizeof(*options->import_queries));
+	options->what_is_offsets = calloc_s(argc, sizeof(*options->what_is_offsets));
+
 	int c, ind;
 
 	while ((c = getopt_long(argc, argv, short_options, long_options, &ind)))
@@ -160,10 +219,97 @@ static options_t *parse_options(int argc, char *argv[])
 				options->all = false;
 				options->exports = true;
 				break;
+			case 'r':
+				options->all = false;
+				options->relocs = true;
+				break;
 			case 'f':
-				if (output_set_format_by_name(optarg) < 0)
+				if (output_add_format_by_name(optarg) < 0)
 					EXIT_ERROR("invalid format option");
 				break;
+			case 14: // --fields option
+				if (output_set_fields(optarg) < 0)
+					EXIT_ERROR("invalid fields option");
+				break;
+			case 2: // --export option
+				options->all = false;
+				options->export_names[options->export_names_count++] = optarg;
+				break;
+			case 3: // --ordinal option
+			{
+				char *endptr;
+				const unsigned long ordinal = strtoul(optarg, &endptr, 0);
+				if (*optarg == '\0' || *endptr != '\0' || ordinal > UINT32_MAX)
+					EXIT_ERROR("invalid ordinal option");
+				options->all = false;
+				options->export_ordinals[options->export_ordinals_count++] = (uint32_t)ordinal;
+				break;
+			}
+			case 4: // --import option
+			{
+				const char *separator = strchr(optarg, '!');
+				if (separator == NULL || separator == optarg || separator[1] == '\0')
+					EXIT_ERROR("invalid import option, expected <dll!function>");
+				if (separator[1] == '#') {
+					// Import ordinals are 16 bits wide.
+					const char *ordinal_str = separator + 2;
+					char *endptr;
+					const unsigned long ordinal = strtoul(ordinal_str, &endptr, 0);
+					if (*ordinal_str < '0' || *ordinal_str > '9' || *endptr != '\0' || ordinal > UINT16_MAX)
+						EXIT_ERROR("invalid import option, expected <dll!#ordinal>");
+				}
+				options->all = false;
+				options->import_queries[options->import_queries_count++] = optarg;
+				break;
+			}
+			case 5: // --clr option
+				options->all = false;
+				options->clr = true;
+				break;
+			case 6: // --clr-refs option
+				options->all = false;
+				options->clr_refs = true;
+				break;
+			case 7: // --clr-types option
+				options->all = false;
+				options->clr_types = true;
+				break;
+			case 8: // --reloc-entries option
+				options->all = false;
+				options->relocs = true;
+				options->reloc_entries = true;
+				break;
+			case 9: // --reloc-summary option
+				options->all = false;
+				options->reloc_summary = true;
+				break;
+			case 10: // --map option
+				options->all = false;
+				options->map = true;
+				break;
+			case 11: // --what-is option
+			{
+				char *endptr;
+				const unsigned long long offset = strtoull(optarg, &endptr, 0);
+				if (*optarg == '\0' || *endptr != '\0')
+					EXIT_ERROR("invalid offset option");
+				options->all = false;
+				options->what_is_offsets[options->what_is_offsets_count++] = (uint64_t)offset;
+				break;
+			}
+			case 12: // --output-fd option
+			{
+				char *endptr;
+				const long fd = strtol(optarg, &endptr, 10);
+				if (*optarg == '\0' || *endptr != '\0' || fd < 0 || fd > INT_MAX || fcntl((int)fd, F_GETFD) < 0)
+					EXIT_ERROR("invalid output file descriptor");
+				output_set_fd((int)fd);
+				break;
+			}
+			case 13: // --compress option
+				if (output_set_compression_by_name(optarg) < 0)
+					EXIT_ERROR("invalid or unsupported compression");
+				break;
 			default:
 				fprintf(stderr, "%s: try '--help' for more information\n", PROGRAM);
 				exit(EXIT_FAILURE);
@@ -219,7 +365,9 @@ static void print_sections(pe_ctx_t *ctx)
 	if (sections == NULL)
 		return;
 
+#ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
 	static char s[MAX_MSG];
+#endif
 	static char section_name_buffer[SECTION_NAME_SIZE+1];
 
 	for (uint32_t i=0; i < num_sections; i++)
@@ -229,25 +377,12 @@ static void print_sections(pe_ctx_t *ctx)
 		const char *section_name = pe_section_name(ctx, sections[i], section_name_buffer, sizeof(section_name_buffer));
 		output("Name", section_name);
 
-		snprintf(s, MAX_MSG, "%#x (%" PRIu32 " bytes)", sections[i]->Misc.VirtualSize,
-			sections[i]->Misc.VirtualSize);
-		output("Virtual Size", s);
-
-		snprintf(s, MAX_MSG, "%#x", sections[i]->VirtualAddress);
-		output("Virtual Address", s);
-
-		snprintf(s, MAX_MSG, "%#x (%" PRIu32 " bytes)", sections[i]->SizeOfRawData,
-			sections[i]->SizeOfRawData);
-		output("Size Of Raw Data", s);
-
-		snprintf(s, MAX_MSG, "%#x", sections[i]->PointerToRawData);
-		output("Pointer To Raw Data", s);
-
-		snprintf(s, MAX_MSG, "%" PRIu16, sections[i]->NumberOfRelocations);
-		output("Number Of Relocations", s);
-
-		snprintf(s, MAX_MSG, "%#x", sections[i]->Characteristics);
-		output("Characteristics", s);
+		output_int("Virtual Size", sections[i]->Misc.VirtualSize, OUTPUT_INT_HEX_SIZE);
+		output_int("Virtual Address", sections[i]->VirtualAddress, OUTPUT_INT_HEX);
+		output_int("Size Of Raw Data", sections[i]->SizeOfRawData, OUTPUT_INT_HEX_SIZE);
+		output_int("Pointer To Raw Data", sections[i]->PointerToRawData, OUTPUT_INT_HEX);
+		output_int("Number Of Relocations", sections[i]->NumberOfRelocations, OUTPUT_INT_DECIMAL);
+		output_int("Characteristics", sections[i]->Characteristics, OUTPUT_INT_HEX);
 
 		output_open_scope("Characteristic Names", OUTPUT_SCOPE_TYPE_ARRAY);
 
@@ -374,65 +509,26 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			snprintf(s, MAX_MSG, "%#x (%s)", header->_32->Magic, "PE32");
 			output("Magic number", s);
 
-			snprintf(s, MAX_MSG, "%" PRIu8, header->_32->MajorLinkerVersion);
-			output("Linker major version", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu8, header->_32->MinorLinkerVersion);
-			output("Linker minor version", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfCode);
-			output("Size of .text section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfInitializedData);
-			output("Size of .data section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfUninitializedData);
-			output("Size of .bss section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->AddressOfEntryPoint);
-			output("Entrypoint", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->BaseOfCode);
-			output("Address of .text section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->BaseOfData);
-			output("Address of .data section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->ImageBase);
-			output("ImageBase", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SectionAlignment);
-			output("Alignment of sections", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->FileAlignment);
-			output("Alignment factor", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MajorOperatingSystemVersion);
-			output("Major version of required OS", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MinorOperatingSystemVersion);
-			output("Minor version of required OS", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MajorImageVersion);
-			output("Major version of image", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MinorImageVersion);
-			output("Minor version of image", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MajorSubsystemVersion);
-			output("Major version of subsystem", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_32->MinorSubsystemVersion);
-			output("Minor version of subsystem", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfImage);
-			output("Size of image", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfHeaders);
-			output("Size of headers", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->CheckSum);
-			output("Checksum", s);
+			output_int("Linker major version", header->_32->MajorLinkerVersion, OUTPUT_INT_DECIMAL);
+			output_int("Linker minor version", header->_32->MinorLinkerVersion, OUTPUT_INT_DECIMAL);
+			output_int("Size of .text section", header->_32->SizeOfCode, OUTPUT_INT_HEX);
+			output_int("Size of .data section", header->_32->SizeOfInitializedData, OUTPUT_INT_HEX);
+			output_int("Size of .bss section", header->_32->SizeOfUninitializedData, OUTPUT_INT_HEX);
+			output_int("Entrypoint", header->_32->AddressOfEntryPoint, OUTPUT_INT_HEX);
+			output_int("Address of .text section", header->_32->BaseOfCode, OUTPUT_INT_HEX);
+			output_int("Address of .data section", header->_32->BaseOfData, OUTPUT_INT_HEX);
+			output_int("ImageBase", header->_32->ImageBase, OUTPUT_INT_HEX);
+			output_int("Alignment of sections", header->_32->SectionAlignment, OUTPUT_INT_HEX);
+			output_int("Alignment factor", header->_32->FileAlignment, OUTPUT_INT_HEX);
+			output_int("Major version of required OS", header->_32->MajorOperatingSystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of required OS", header->_32->MinorOperatingSystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Major version of image", header->_32->MajorImageVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of image", header->_32->MinorImageVersion, OUTPUT_INT_DECIMAL);
+			output_int("Major version of subsystem", header->_32->MajorSubsystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of subsystem", header->_32->MinorSubsystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Size of image", header->_32->SizeOfImage, OUTPUT_INT_HEX);
+			output_int("Size of headers", header->_32->SizeOfHeaders, OUTPUT_INT_HEX);
+			output_int("Checksum", header->_32->CheckSum, OUTPUT_INT_HEX);
 
 			const uint16_t subsystem = header->_32->Subsystem;
 #ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
@@ -449,8 +545,7 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			snprintf(s, MAX_MSG, "%#x (%s)", subsystem, subsystem_name);
 			output("Subsystem required", s);
 
-			snprintf(s, MAX_MSG, "%#x", header->_32->DllCharacteristics);
-			output("DLL characteristics", s);
+			output_int("DLL characteristics", header->_32->DllCharacteristics, OUTPUT_INT_HEX);
 
 #ifndef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
 			output_open_scope("DLL characteristics names", OUTPUT_SCOPE_TYPE_ARRAY);
@@ -470,17 +565,10 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			output_close_scope(); // DLL characteristics names
 #endif
 
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfStackReserve);
-			output("Size of stack to reserve", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfStackCommit);
-			output("Size of stack to commit", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfHeapReserve);
-			output("Size of heap space to reserve", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_32->SizeOfHeapCommit);
-			output("Size of heap space to commit", s);
+			output_int("Size of stack to reserve", header->_32->SizeOfStackReserve, OUTPUT_INT_HEX);
+			output_int("Size of stack to commit", header->_32->SizeOfStackCommit, OUTPUT_INT_HEX);
+			output_int("Size of heap space to reserve", header->_32->SizeOfHeapReserve, OUTPUT_INT_HEX);
+			output_int("Size of heap space to commit", header->_32->SizeOfHeapCommit, OUTPUT_INT_HEX);
 			break;
 		}
 		case MAGIC_PE64:
@@ -488,62 +576,25 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			snprintf(s, MAX_MSG, "%#x (%s)", header->_64->Magic, "PE32+");
 			output("Magic number", s);
 
-			snprintf(s, MAX_MSG, "%" PRIu8, header->_64->MajorLinkerVersion);
-			output("Linker major version", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu8, header->_64->MinorLinkerVersion);
-			output("Linker minor version", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SizeOfCode);
-			output("Size of .text section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SizeOfInitializedData);
-			output("Size of .data section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SizeOfUninitializedData);
-			output("Size of .bss section", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->AddressOfEntryPoint);
-			output("Entrypoint", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->BaseOfCode);
-			output("Address of .text section", s);
-
-			snprintf(s, MAX_MSG, "%#"PRIx64, header->_64->ImageBase);
-			output("ImageBase", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SectionAlignment);
-			output("Alignment of sections", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->FileAlignment);
-			output("Alignment factor", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MajorOperatingSystemVersion);
-			output("Major version of required OS", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MinorOperatingSystemVersion);
-			output("Minor version of required OS", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MajorImageVersion);
-			output("Major version of image", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MinorImageVersion);
-			output("Minor version of image", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MajorSubsystemVersion);
-			output("Major version of subsystem", s);
-
-			snprintf(s, MAX_MSG, "%" PRIu16, header->_64->MinorSubsystemVersion);
-			output("Minor version of subsystem", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SizeOfImage);
-			output("Size of image", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->SizeOfHeaders);
-			output("Size of headers", s);
-
-			snprintf(s, MAX_MSG, "%#x", header->_64->CheckSum);
-			output("Checksum", s);
+			output_int("Linker major version", header->_64->MajorLinkerVersion, OUTPUT_INT_DECIMAL);
+			output_int("Linker minor version", header->_64->MinorLinkerVersion, OUTPUT_INT_DECIMAL);
+			output_int("Size of .text section", header->_64->SizeOfCode, OUTPUT_INT_HEX);
+			output_int("Size of .data section", header->_64->SizeOfInitializedData, OUTPUT_INT_HEX);
+			output_int("Size of .bss section", header->_64->SizeOfUninitializedData, OUTPUT_INT_HEX);
+			output_int("Entrypoint", header->_64->AddressOfEntryPoint, OUTPUT_INT_HEX);
+			output_int("Address of .text section", header->_64->BaseOfCode, OUTPUT_INT_HEX);
+			output_int("ImageBase", header->_64->ImageBase, OUTPUT_INT_HEX);
+			output_int("Alignment of sections", header->_64->SectionAlignment, OUTPUT_INT_HEX);
+			output_int("Alignment factor", header->_64->FileAlignment, OUTPUT_INT_HEX);
+			output_int("Major version of required OS", header->_64->MajorOperatingSystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of required OS", header->_64->MinorOperatingSystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Major version of image", header->_64->MajorImageVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of image", header->_64->MinorImageVersion, OUTPUT_INT_DECIMAL);
+			output_int("Major version of subsystem", header->_64->MajorSubsystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Minor version of subsystem", header->_64->MinorSubsystemVersion, OUTPUT_INT_DECIMAL);
+			output_int("Size of image", header->_64->SizeOfImage, OUTPUT_INT_HEX);
+			output_int("Size of headers", header->_64->SizeOfHeaders, OUTPUT_INT_HEX);
+			output_int("Checksum", header->_64->CheckSum, OUTPUT_INT_HEX);
 
 			const uint16_t subsystem = header->_64->Subsystem;
 #ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
@@ -560,8 +611,7 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			snprintf(s, MAX_MSG, "%#x (%s)", subsystem, subsystem_name);
 			output("Subsystem required", s);
 
-			snprintf(s, MAX_MSG, "%#x", header->_64->DllCharacteristics);
-			output("DLL characteristics", s);
+			output_int("DLL characteristics", header->_64->DllCharacteristics, OUTPUT_INT_HEX);
 
 #ifndef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
 			output_open_scope("DLL characteristics names", OUTPUT_SCOPE_TYPE_ARRAY);
@@ -581,17 +631,10 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 			output_close_scope(); // DLL characteristics names
 #endif
 
-			snprintf(s, MAX_MSG, "%#"PRIx64, header->_64->SizeOfStackReserve);
-			output("Size of stack to reserve", s);
-
-			snprintf(s, MAX_MSG, "%#"PRIx64, header->_64->SizeOfStackCommit);
-			output("Size of stack to commit", s);
-
-			snprintf(s, MAX_MSG, "%#"PRIx64, header->_64->SizeOfHeapReserve);
-			output("Size of heap space to reserve", s);
-
-			snprintf(s, MAX_MSG, "%#"PRIx64, header->_64->SizeOfHeapCommit);
-			output("Size of heap space to commit", s);
+			output_int("Size of stack to reserve", header->_64->SizeOfStackReserve, OUTPUT_INT_HEX);
+			output_int("Size of stack to commit", header->_64->SizeOfStackCommit, OUTPUT_INT_HEX);
+			output_int("Size of heap space to reserve", header->_64->SizeOfHeapReserve, OUTPUT_INT_HEX);
+			output_int("Size of heap space to commit", header->_64->SizeOfHeapCommit, OUTPUT_INT_HEX);
 			break;
 		}
 	}
@@ -675,8 +718,7 @@ static void print_coff_header(IMAGE_COFF_HEADER *header)
 	snprintf(s, MAX_MSG, "%#x %s", header->Machine, machine);
 	output("Machine", s);
 
-	snprintf(s, MAX_MSG, "%" PRIu16, header->NumberOfSections);
-	output("Number of sections", s);
+	output_int("Number of sections", header->NumberOfSections, OUTPUT_INT_DECIMAL);
 
 	char timestr[40] = "invalid";
 	struct tm *t = gmtime((time_t *) &header->TimeDateStamp);
@@ -685,17 +727,10 @@ static void print_coff_header(IMAGE_COFF_HEADER *header)
 	snprintf(s, MAX_MSG, "%" PRIu32 " (%s)", header->TimeDateStamp, timestr);
 	output("Date/time stamp", s);
 
-	snprintf(s, MAX_MSG, "%#x", header->PointerToSymbolTable);
-	output("Symbol Table offset", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu32, header->NumberOfSymbols);
-	output("Number of symbols", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->SizeOfOptionalHeader);
-	output("Size of optional header", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->Characteristics);
-	output("Characteristics", s);
+	output_int("Symbol Table offset", header->PointerToSymbolTable, OUTPUT_INT_HEX);
+	output_int("Number of symbols", header->NumberOfSymbols, OUTPUT_INT_DECIMAL);
+	output_int("Size of optional header", header->SizeOfOptionalHeader, OUTPUT_INT_HEX);
+	output_int("Characteristics", header->Characteristics, OUTPUT_INT_HEX);
 
 	output_open_scope("Characteristics names", OUTPUT_SCOPE_TYPE_ARRAY);
 
@@ -729,93 +764,91 @@ static void print_dos_header(IMAGE_DOS_HEADER *header)
 	snprintf(s, MAX_MSG, "%#x (MZ)", header->e_magic);
 	output("Magic number", s);
 
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_cblp);
-	output("Bytes in last page", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_cp);
-	output("Pages in file", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_crlc);
-	output("Relocations", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_cparhdr);
-	output("Size of header in paragraphs", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_minalloc);
-	output("Minimum extra paragraphs", s);
-
-	snprintf(s, MAX_MSG, "%" PRIu16, header->e_maxalloc);
-	output("Maximum extra paragraphs", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_ss);
-	output("Initial (relative) SS value", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_sp);
-	output("Initial SP value", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_ip);
-	output("Initial IP value", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_cs);
-	output("Initial (relative) CS value", s);
+	output_int("Bytes in last page", header->e_cblp, OUTPUT_INT_DECIMAL);
+	output_int("Pages in file", header->e_cp, OUTPUT_INT_DECIMAL);
+	output_int("Relocations", header->e_crlc, OUTPUT_INT_DECIMAL);
+	output_int("Size of header in paragraphs", header->e_cparhdr, OUTPUT_INT_DECIMAL);
+	output_int("Minimum extra paragraphs", header->e_minalloc, OUTPUT_INT_DECIMAL);
+	output_int("Maximum extra paragraphs", header->e_maxalloc, OUTPUT_INT_DECIMAL);
+	output_int("Initial (relative) SS value", header->e_ss, OUTPUT_INT_HEX);
+	output_int("Initial SP value", header->e_sp, OUTPUT_INT_HEX);
+	output_int("Initial IP value", header->e_ip, OUTPUT_INT_HEX);
+	output_int("Initial (relative) CS value", header->e_cs, OUTPUT_INT_HEX);
+	output_int("Address of relocation table", header->e_lfarlc, OUTPUT_INT_HEX);
+	output_int("Overlay number", header->e_ovno, OUTPUT_INT_HEX);
+	output_int("OEM identifier", header->e_oemid, OUTPUT_INT_HEX);
+	output_int("OEM information", header->e_oeminfo, OUTPUT_INT_HEX);
+	output_int("PE header offset", header->e_lfanew, OUTPUT_INT_HEX);
 
-	snprintf(s, MAX_MSG, "%#x", header->e_lfarlc);
-	output("Address of relocation table", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_ovno);
-	output("Overlay number", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_oemid);
-	output("OEM identifier", s);
-
-	snprintf(s, MAX_MSG, "%#x", header->e_oeminfo);
-	output("OEM information", s);
+	output_close_scope(); // DOS Header
+}
 
-	snprintf(s, MAX_MSG, "%#x", header->e_lfanew);
-	output("PE header offset", s);
+// Keys output for each imported or exported function, interned so that
+// formats don't escape them every time.
+typedef struct {
+	const char *function;
+	const char *ordinal;
+	const char *hint;
+	const char *address;
+	const char *name;
+} function_keys_t;
+
+static void intern_function_keys(function_keys_t *keys)
+{
+	keys->function = output_intern_key("Function");
+	keys->ordinal = output_intern_key("Ordinal");
+	keys->hint = output_intern_key("Hint");
+	keys->address = output_intern_key("Address");
+	keys->name = output_intern_key("Name");
+}
 
-	output_close_scope(); // DOS Header
+static void print_exported_function(const pe_export_entry_t *func, const function_keys_t *keys)
+{
+	char ordinal_str[32] = { 0 };
+	char address_str[16] = { 0 };
+	snprintf(ordinal_str, sizeof(ordinal_str)-1, "%"PRIu32, func->ordinal);
+	snprintf(address_str, sizeof(address_str)-1, "%#"PRIx32, func->address);
+
+	if (func->fwd_name != NULL) {
+		char full_name[PE_TABLES_MAX_FUNCTION_NAME * 2 + 4];
+		snprintf(full_name, sizeof(full_name)-1, "%s -> %s", func->name != NULL ? func->name : "", func->fwd_name);
+		output(keys->ordinal, ordinal_str);
+		output(keys->address, address_str);
+		output(keys->name, full_name);
+	} else {
+		output(keys->ordinal, ordinal_str);
+		output(keys->address, address_str);
+		output(keys->name, func->name);
+	}
 }
 
 static void print_exports(pe_ctx_t *ctx)
 {
 	output_open_scope("Exported functions", OUTPUT_SCOPE_TYPE_ARRAY);
 
-	const pe_exports_t *exports = pe_exports(ctx);
-	
-	if (exports->functions_count > 0) {
+	// Entries are decoded straight from the mapping and printed as they come.
+	pe_export_iter_t iter;
+	const bool has_exports = pe_export_iter_init(&iter, ctx) && iter.functions_count > 0;
+
+	if (has_exports) {
 		output_open_scope("Library", OUTPUT_SCOPE_TYPE_OBJECT);
-		output("Name", exports->name);
+		output("Name", iter.dll_name);
 		output_open_scope("Functions", OUTPUT_SCOPE_TYPE_ARRAY);
 	}
-		
-	for (size_t i=0; i < exports->functions_count; i++) {
-		const pe_exported_function_t *func = &exports->functions[i];
-		if (func->address != 0) {
-			output_open_scope("Function", OUTPUT_SCOPE_TYPE_OBJECT);
 
-			char ordinal_str[32] = { 0 };
-			char address_str[16] = { 0 };
-			snprintf(ordinal_str, sizeof(ordinal_str)-1, "%"PRIu32, func->ordinal);
-			snprintf(address_str, sizeof(address_str)-1, "%#"PRIx32, func->address);
-
-			if (func->fwd_name != NULL) {
-				char full_name[300 * 2 + 4];
-				snprintf(full_name, sizeof(full_name)-1, "%s -> %s", func->name, func->fwd_name);
-				output("Ordinal", ordinal_str);
-				output("Address", address_str);
-				output("Name", full_name);
-			} else {
-				output("Ordinal", ordinal_str);
-				output("Address", address_str);
-				output("Name", func->name);
-			}
+	function_keys_t keys;
+	intern_function_keys(&keys);
 
+	pe_export_entry_t func;
+	while (has_exports && pe_export_iter_next(&iter, &func)) {
+		if (func.address != 0) {
+			output_open_scope(keys.function, OUTPUT_SCOPE_TYPE_OBJECT);
+			print_exported_function(&func, &keys);
 			output_close_scope(); // Function
 		}
 	}
 
-	if (exports->functions_count > 0) {
+	if (has_exports) {
 		output_close_scope(); // Functions
 		output_close_scope(); // Library
 	}
@@ -827,31 +860,36 @@ static void print_imports(pe_ctx_t *ctx)
 {
 	output_open_scope("Imported functions", OUTPUT_SCOPE_TYPE_ARRAY);
 
-	const pe_imports_t *imports = pe_imports(ctx);
-	for (size_t i=0; i < imports->dll_count; i++) {
-		const pe_imported_dll_t *dll = &imports->dlls[i];
+	// Descriptors and thunks are decoded straight from the mapping and printed as they come.
+	pe_import_iter_t iter;
+	const bool has_imports = pe_import_iter_init(&iter, ctx);
+
+	function_keys_t keys;
+	intern_function_keys(&keys);
+
+	while (has_imports && pe_import_iter_next_dll(&iter)) {
 		output_open_scope("Library", OUTPUT_SCOPE_TYPE_OBJECT);
-		output("Name", dll->name);
+		output("Name", iter.dll_name);
 		output_open_scope("Functions", OUTPUT_SCOPE_TYPE_ARRAY);
 
-		for (size_t j=0; j < dll->functions_count; j++) {
-			const pe_imported_function_t *func = &dll->functions[j];
-			output_open_scope("Function", OUTPUT_SCOPE_TYPE_OBJECT);
+		pe_import_entry_t func;
+		while (pe_import_iter_next_function(&iter, &func)) {
+			output_open_scope(keys.function, OUTPUT_SCOPE_TYPE_OBJECT);
 			{
-				if (func->ordinal) {
+				if (func.ordinal) {
 					char ordinal_str[16];
-					snprintf(ordinal_str, sizeof(ordinal_str)-1, "%"PRIu16, func->ordinal);
-					output("Ordinal", ordinal_str);
+					snprintf(ordinal_str, sizeof(ordinal_str)-1, "%"PRIu16, func.ordinal);
+					output(keys.ordinal, ordinal_str);
 				} else {
 					char hint_str[16];
-					snprintf(hint_str, sizeof(hint_str)-1, "%"PRIu16, func->hint);
-					output("Hint", hint_str);
-					output("Name", func->name);
+					snprintf(hint_str, sizeof(hint_str)-1, "%"PRIu16, func.hint);
+					output(keys.hint, hint_str);
+					output(keys.name, func.name);
 				}
 			}
 			output_close_scope(); // Function
 		}
-		
+
 		output_close_scope(); // Functions
 		output_close_scope(); // Library
 	}
@@ -859,6 +897,547 @@ static void print_imports(pe_ctx_t *ctx)
 	output_close_scope(); // Imported functions
 }
 
+static void print_export_queries(pe_ctx_t *ctx, const options_t *options)
+{
+	output_open_scope("Export queries", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	// No index to build: names are looked up by binary search over the
+	// (sorted) export name pointer table, ordinals are direct indexes.
+	pe_export_iter_t iter;
+	const bool has_exports = pe_export_iter_init(&iter, ctx);
+
+	function_keys_t keys;
+	intern_function_keys(&keys);
+
+	for (size_t i=0; i < options->export_names_count; i++) {
+		const char *name = options->export_names[i];
+		pe_export_entry_t func;
+		const bool found = has_exports && pe_export_lookup_name(&iter, name, &func);
+
+		output_open_scope("Query", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Query", name);
+		output("Found", found ? "yes" : "no");
+		if (found)
+			print_exported_function(&func, &keys);
+		output_close_scope(); // Query
+	}
+
+	for (size_t i=0; i < options->export_ordinals_count; i++) {
+		const uint32_t ordinal = options->export_ordinals[i];
+		pe_export_entry_t func;
+		const bool found = has_exports && pe_export_lookup_ordinal(&iter, ordinal, &func);
+
+		char query_str[16];
+		snprintf(query_str, sizeof(query_str), "#%"PRIu32, ordinal);
+
+		output_open_scope("Query", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Query", query_str);
+		output("Found", found ? "yes" : "no");
+		if (found)
+			print_exported_function(&func, &keys);
+		output_close_scope(); // Query
+	}
+
+	output_close_scope(); // Export queries
+}
+
+typedef struct {
+	const char *query;
+	char *key;
+	bool found;
+	pe_import_entry_t func;
+} import_query_t;
+
+// Builds the lookup key of an imported function: "dll!name" or "dll!#ordinal",
+// with the DLL name in lowercase since Windows resolves DLL names case-insensitively.
+static void make_import_key(char *key, size_t size, const char *dll_name, size_t dll_name_len, const char *func_name, uint16_t ordinal)
+{
+	size_t len = 0;
+	for (size_t i=0; i < dll_name_len && len < size - 1; i++)
+		key[len++] = (char)tolower((unsigned char)dll_name[i]);
+	key[len] = '\0';
+
+	if (func_name != NULL)
+		snprintf(key + len, size - len, "!%s", func_name);
+	else
+		snprintf(key + len, size - len, "!#%"PRIu16, ordinal);
+}
+
+#define IMPORT_KEY_SIZE (PE_TABLES_MAX_DLL_NAME + PE_TABLES_MAX_FUNCTION_NAME + 2)
+
+static void print_import_queries(pe_ctx_t *ctx, const options_t *options)
+{
+	const size_t count = options->import_queries_count;
+	import_query_t *queries = calloc_s(count, sizeof(*queries));
+
+	// Index the queries by key, then walk the import tables once. Each
+	// imported function costs a single hash lookup, no matter how many
+	// queries were given.
+	hashtable_t index;
+	if (hashtable_init(&index, count) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	for (size_t i=0; i < count; i++) {
+		import_query_t *query = &queries[i];
+		query->query = options->import_queries[i];
+		query->key = malloc_s(IMPORT_KEY_SIZE);
+
+		const char *separator = strchr(query->query, '!');
+		const char *func_name = separator + 1;
+		if (func_name[0] == '#') {
+			// Validated by parse_options().
+			const uint16_t ordinal = (uint16_t)strtoul(func_name + 1, NULL, 0);
+			make_import_key(query->key, IMPORT_KEY_SIZE, query->query, (size_t)(separator - query->query), NULL, ordinal);
+		} else {
+			make_import_key(query->key, IMPORT_KEY_SIZE, query->query, (size_t)(separator - query->query), func_name, 0);
+		}
+
+		// Duplicate queries share the first entry.
+		if (hashtable_get(&index, query->key) == NULL && hashtable_put(&index, query->key, query) < 0)
+			EXIT_ERROR("memory allocation failed");
+	}
+
+	size_t pending = index.count;
+	pe_import_iter_t iter;
+	const bool has_imports = pe_import_iter_init(&iter, ctx);
+
+	while (pending > 0 && has_imports && pe_import_iter_next_dll(&iter)) {
+		if (iter.dll_name == NULL)
+			continue;
+
+		const size_t dll_name_len = strlen(iter.dll_name);
+		pe_import_entry_t func;
+		while (pending > 0 && pe_import_iter_next_function(&iter, &func)) {
+			char key[IMPORT_KEY_SIZE];
+			make_import_key(key, sizeof(key), iter.dll_name, dll_name_len, func.name, func.ordinal);
+
+			import_query_t *query = hashtable_get(&index, key);
+			if (query == NULL || query->found)
+				continue;
+
+			query->found = true;
+			query->func = func;
+			pending--;
+		}
+	}
+
+	output_open_scope("Import queries", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	for (size_t i=0; i < count; i++) {
+		const import_query_t *query = hashtable_get(&index, queries[i].key);
+
+		output_open_scope("Query", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Query", queries[i].query);
+		output("Found", query->found ? "yes" : "no");
+		if (query->found) {
+			if (query->func.ordinal) {
+				char ordinal_str[16];
+				snprintf(ordinal_str, sizeof(ordinal_str)-1, "%"PRIu16, query->func.ordinal);
+				output("Ordinal", ordinal_str);
+			} else {
+				char hint_str[16];
+				snprintf(hint_str, sizeof(hint_str)-1, "%"PRIu16, query->func.hint);
+				output("Hint", hint_str);
+				output("Name", query->func.name);
+			}
+		}
+		output_close_scope(); // Query
+	}
+
+	output_close_scope(); // Import queries
+
+	hashtable_destroy(&index);
+	for (size_t i=0; i < count; i++)
+		free(queries[i].key);
+	free(queries);
+}
+
+#define RELOC_TYPES 16
+
+static void print_reloc_types(const uint32_t *counts)
+{
+	output_open_scope("Types", OUTPUT_SCOPE_TYPE_OBJECT);
+	for (uint8_t type=0; type < RELOC_TYPES; type++) {
+		if (counts[type] == 0)
+			continue;
+		output_int(pe_reloc_type_name(type), counts[type], OUTPUT_INT_DECIMAL);
+	}
+	output_close_scope(); // Types
+}
+
+static void print_relocs(pe_ctx_t *ctx, bool with_entries)
+{
+	output_open_scope("Base relocations", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	pe_reloc_iter_t iter;
+	pe_reloc_block_t block;
+	if (pe_reloc_iter_init(&iter, ctx)) {
+		while (pe_reloc_iter_next_block(&iter, &block)) {
+			output_open_scope("Block", OUTPUT_SCOPE_TYPE_OBJECT);
+
+			output_int("Page RVA", block.page_rva, OUTPUT_INT_HEX);
+			output_int("Block size", block.size, OUTPUT_INT_DECIMAL);
+
+			if (with_entries)
+				output_open_scope("Fixups", OUTPUT_SCOPE_TYPE_ARRAY);
+
+			// The number of entries and the per-type counts are only known
+			// once the whole block has been decoded, so they come after the
+			// fixups.
+			uint32_t entries = 0;
+			uint32_t counts[RELOC_TYPES] = { 0 };
+			pe_reloc_entry_t entry;
+			while (pe_reloc_iter_next_entry(&iter, &entry)) {
+				entries++;
+				counts[entry.type]++;
+				if (!with_entries)
+					continue;
+
+				output_open_scope("Fixup", OUTPUT_SCOPE_TYPE_OBJECT);
+				output_int("RVA", entry.rva, OUTPUT_INT_HEX);
+				output("Type", pe_reloc_type_name(entry.type));
+				output_close_scope(); // Fixup
+			}
+
+			if (with_entries)
+				output_close_scope(); // Fixups
+
+			output_int("Entries", entries, OUTPUT_INT_DECIMAL);
+			print_reloc_types(counts);
+
+			output_close_scope(); // Block
+		}
+	}
+
+	output_close_scope(); // Base relocations
+
+	if (iter.malformed)
+		LIBPE_WARNING("malformed base relocation block");
+}
+
+static void print_reloc_summary(pe_ctx_t *ctx)
+{
+	uint32_t blocks = 0;
+	uint64_t entries = 0;
+	uint32_t counts[RELOC_TYPES] = { 0 };
+	uint32_t lowest_rva = UINT32_MAX;
+	uint32_t highest_rva = 0;
+
+	// One pass over the directory, keeping only the totals.
+	pe_reloc_iter_t iter;
+	pe_reloc_block_t block;
+	if (pe_reloc_iter_init(&iter, ctx)) {
+		while (pe_reloc_iter_next_block(&iter, &block)) {
+			blocks++;
+
+			pe_reloc_entry_t entry;
+			while (pe_reloc_iter_next_entry(&iter, &entry)) {
+				entries++;
+				counts[entry.type]++;
+				// ABSOLUTE entries are padding and don't patch anything.
+				if (entry.type == 0)
+					continue;
+				if (entry.rva < lowest_rva)
+					lowest_rva = entry.rva;
+				if (entry.rva > highest_rva)
+					highest_rva = entry.rva;
+			}
+		}
+	}
+
+	output_open_scope("Base relocations summary", OUTPUT_SCOPE_TYPE_OBJECT);
+
+	output_int("Blocks", blocks, OUTPUT_INT_DECIMAL);
+	output_int("Entries", entries, OUTPUT_INT_DECIMAL);
+
+	if (lowest_rva <= highest_rva) {
+		output_int("Lowest RVA", lowest_rva, OUTPUT_INT_HEX);
+		output_int("Highest RVA", highest_rva, OUTPUT_INT_HEX);
+	}
+
+	print_reloc_types(counts);
+
+	output("Malformed", iter.malformed ? "yes" : "no");
+
+	output_close_scope(); // Base relocations summary
+}
+
+static const char *map_region_type(pe_map_region_kind_e kind)
+{
+	switch (kind) {
+		case PE_MAP_REGION_HEADERS:		return "header";
+		case PE_MAP_REGION_SECTION:		return "section";
+		case PE_MAP_REGION_DIRECTORY:	return "directory";
+		case PE_MAP_REGION_CERTIFICATE:	return "certificate";
+		case PE_MAP_REGION_OVERLAY:		return "overlay";
+		default:						return "other";
+	}
+}
+
+static void print_map_region(uint64_t start, uint64_t end, const char *type, const char *name, bool overlaps)
+{
+	output_open_scope("Region", OUTPUT_SCOPE_TYPE_OBJECT);
+	output_int("Offset", start, OUTPUT_INT_HEX);
+	output_int("Size", end - start, OUTPUT_INT_DECIMAL);
+	output("Type", type);
+	output("Name", name);
+	if (overlaps)
+		output("Overlaps", "yes");
+	output_close_scope(); // Region
+}
+
+static void print_map(const pe_map_t *map)
+{
+	output_open_scope("File map", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	// Bytes up to `covered` belong to some top-level region.
+	uint64_t covered = 0;
+
+	for (size_t i=0; i < map->count; i++) {
+		const pe_map_region_t *region = &map->regions[i];
+
+		if (region->level == PE_MAP_LEVEL_TOP) {
+			if (region->start > covered)
+				print_map_region(covered, region->start, "gap", "", false);
+			if (region->end > covered)
+				covered = region->end;
+		}
+
+		print_map_region(region->start, region->end, map_region_type(region->kind), region->name, region->overlaps);
+	}
+
+	if (covered < map->file_size)
+		print_map_region(covered, map->file_size, "gap", "", false);
+
+	output_close_scope(); // File map
+}
+
+static void print_what_is(const pe_map_t *map, const options_t *options)
+{
+	char s[MAX_MSG];
+
+	output_open_scope("Offset queries", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	for (size_t i=0; i < options->what_is_offsets_count; i++) {
+		const uint64_t offset = options->what_is_offsets[i];
+		const pe_map_region_t *found[16];
+		const size_t count = pe_map_find(map, offset, found, LIBPE_SIZEOF_ARRAY(found));
+
+		output_open_scope("Query", OUTPUT_SCOPE_TYPE_OBJECT);
+		output_int("Offset", offset, OUTPUT_INT_HEX);
+
+		output_open_scope("Regions", OUTPUT_SCOPE_TYPE_ARRAY);
+		if (count == 0)
+			output(NULL, offset < map->file_size ? "gap" : "past end of file");
+		for (size_t j=0; j < count && j < LIBPE_SIZEOF_ARRAY(found); j++) {
+			snprintf(s, MAX_MSG, "%s (%s)", found[j]->name, map_region_type(found[j]->kind));
+			output(NULL, s);
+		}
+		output_close_scope(); // Regions
+
+		output_close_scope(); // Query
+	}
+
+	output_close_scope(); // Offset queries
+}
+
+static void print_clr_version(const pe_clr_assembly_t *assembly, char *s, size_t size)
+{
+	snprintf(s, size, "%"PRIu16".%"PRIu16".%"PRIu16".%"PRIu16,
+		assembly->major_version, assembly->minor_version,
+		assembly->build_number, assembly->revision_number);
+}
+
+static void print_clr_public_key(const pe_clr_assembly_t *assembly)
+{
+	if (assembly->public_key == NULL || assembly->public_key_size == 0)
+		return;
+
+	// Tokens are 8 bytes; full public keys are only summarized.
+	if (assembly->public_key_size > 8) {
+		char s[MAX_MSG];
+		snprintf(s, MAX_MSG, "%"PRIu32" bytes", assembly->public_key_size);
+		output("Public key", s);
+		return;
+	}
+
+	char hex[8 * 2 + 1];
+	for (uint32_t i=0; i < assembly->public_key_size; i++)
+		snprintf(hex + i * 2, 3, "%02x", assembly->public_key[i]);
+	output("Public key token", hex);
+}
+
+static void print_clr(const pe_clr_t *clr)
+{
+	static const struct {
+		pe_clr_flags_e flag;
+		const char * const name;
+	} flagsTable[] = {
+		{ PE_CLR_FLAGS_ILONLY,				"COMIMAGE_FLAGS_ILONLY"				},
+		{ PE_CLR_FLAGS_32BITREQUIRED,		"COMIMAGE_FLAGS_32BITREQUIRED"		},
+		{ PE_CLR_FLAGS_IL_LIBRARY,			"COMIMAGE_FLAGS_IL_LIBRARY"			},
+		{ PE_CLR_FLAGS_STRONGNAMESIGNED,	"COMIMAGE_FLAGS_STRONGNAMESIGNED"	},
+		{ PE_CLR_FLAGS_NATIVE_ENTRYPOINT,	"COMIMAGE_FLAGS_NATIVE_ENTRYPOINT"	},
+		{ PE_CLR_FLAGS_TRACKDEBUGDATA,		"COMIMAGE_FLAGS_TRACKDEBUGDATA"		},
+		{ PE_CLR_FLAGS_32BITPREFERRED,		"COMIMAGE_FLAGS_32BITPREFERRED"		}
+	};
+
+	const PEV_IMAGE_COR20_HEADER *header = clr->header;
+	char s[MAX_MSG];
+
+	output_open_scope("CLR header", OUTPUT_SCOPE_TYPE_OBJECT);
+
+	output_int("Size", header->cb, OUTPUT_INT_DECIMAL);
+
+	snprintf(s, MAX_MSG, "%"PRIu16".%"PRIu16, header->MajorRuntimeVersion, header->MinorRuntimeVersion);
+	output("Runtime version", s);
+
+	output_int("Metadata RVA", header->MetaData.VirtualAddress, OUTPUT_INT_HEX);
+	output_int("Metadata size", header->MetaData.Size, OUTPUT_INT_DECIMAL);
+
+	output_int("Flags", header->Flags, OUTPUT_INT_HEX);
+
+	output_open_scope("Flags names", OUTPUT_SCOPE_TYPE_ARRAY);
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(flagsTable); i++) {
+		if (header->Flags & flagsTable[i].flag)
+			output(NULL, flagsTable[i].name);
+	}
+	output_close_scope(); // Flags names
+
+	output_int(header->Flags & PE_CLR_FLAGS_NATIVE_ENTRYPOINT ? "Entrypoint RVA" : "Entrypoint token",
+		header->EntryPointToken, OUTPUT_INT_HEX);
+
+	output_int("Resources RVA", header->Resources.VirtualAddress, OUTPUT_INT_HEX);
+	output_int("Resources size", header->Resources.Size, OUTPUT_INT_DECIMAL);
+
+	output_int("Strong name signature RVA", header->StrongNameSignature.VirtualAddress, OUTPUT_INT_HEX);
+	output_int("Strong name signature size", header->StrongNameSignature.Size, OUTPUT_INT_DECIMAL);
+
+	output_close_scope(); // CLR header
+
+	output_open_scope("CLR metadata", OUTPUT_SCOPE_TYPE_OBJECT);
+
+	snprintf(s, MAX_MSG, "%"PRIu16".%"PRIu16, clr->major_version, clr->minor_version);
+	output("Metadata version", s);
+
+	snprintf(s, MAX_MSG, "%.*s", (int)clr->version_length, clr->version);
+	output("Runtime", s);
+
+	output_open_scope("Streams", OUTPUT_SCOPE_TYPE_ARRAY);
+	for (unsigned i=0; i < clr->streams_count && i < PE_CLR_MAX_STREAMS; i++) {
+		const pe_clr_stream_t *stream = &clr->streams[i];
+		if (stream->name == NULL)
+			break;
+
+		output_open_scope("Stream", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Name", stream->name);
+		output_int("Offset", stream->offset, OUTPUT_INT_HEX);
+		output_int("Size", stream->size, OUTPUT_INT_DECIMAL);
+		output_close_scope(); // Stream
+	}
+	output_close_scope(); // Streams
+
+	if (clr->tables_stream != NULL) {
+		snprintf(s, MAX_MSG, "%"PRIu8".%"PRIu8, clr->tables_major_version, clr->tables_minor_version);
+		output("Tables version", s);
+
+		output_open_scope("Tables", OUTPUT_SCOPE_TYPE_ARRAY);
+		for (unsigned i=0; i < PE_CLR_MAX_TABLES; i++) {
+			const pe_clr_table_t *table = &clr->tables[i];
+			if (table->rows == 0)
+				continue;
+
+			output_open_scope("Table", OUTPUT_SCOPE_TYPE_OBJECT);
+			if (table->name != NULL) {
+				output("Name", table->name);
+			} else {
+				snprintf(s, MAX_MSG, "Unknown (%#x)", i);
+				output("Name", s);
+			}
+			output_int("Rows", table->rows, OUTPUT_INT_DECIMAL);
+			if (table->name != NULL)
+				output_int("Row size", table->row_size, OUTPUT_INT_DECIMAL);
+			output_close_scope(); // Table
+		}
+		output_close_scope(); // Tables
+	}
+
+	pe_clr_assembly_t assembly;
+	if (pe_clr_assembly(clr, &assembly)) {
+		output_open_scope("Assembly", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Name", assembly.name);
+		print_clr_version(&assembly, s, MAX_MSG);
+		output("Version", s);
+		if (assembly.culture != NULL && assembly.culture[0] != '\0')
+			output("Culture", assembly.culture);
+		print_clr_public_key(&assembly);
+		output_close_scope(); // Assembly
+	}
+
+	output_close_scope(); // CLR metadata
+}
+
+static void print_clr_refs(const pe_clr_t *clr)
+{
+	char s[MAX_MSG];
+
+	output_open_scope("Assembly references", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	// Only the AssemblyRef rows are decoded.
+	const uint32_t rows = pe_clr_rows(clr, PE_CLR_TABLE_ASSEMBLYREF);
+	for (uint32_t rid=1; rid <= rows; rid++) {
+		pe_clr_assembly_t assembly;
+		if (!pe_clr_assembly_ref(clr, rid, &assembly))
+			break;
+
+		output_open_scope("Assembly reference", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("Name", assembly.name);
+		print_clr_version(&assembly, s, MAX_MSG);
+		output("Version", s);
+		if (assembly.culture != NULL && assembly.culture[0] != '\0')
+			output("Culture", assembly.culture);
+		print_clr_public_key(&assembly);
+		output_close_scope(); // Assembly reference
+	}
+
+	output_close_scope(); // Assembly references
+}
+
+static void print_clr_types(const pe_clr_t *clr)
+{
+	// Full names can be far longer than MAX_MSG, so the buffer grows as needed.
+	char *s = NULL;
+	size_t s_size = 0;
+
+	output_open_scope("Types", OUTPUT_SCOPE_TYPE_ARRAY);
+
+	// Only the TypeDef rows are decoded.
+	const uint32_t rows = pe_clr_rows(clr, PE_CLR_TABLE_TYPEDEF);
+	for (uint32_t rid=1; rid <= rows; rid++) {
+		pe_clr_type_t type;
+		if (!pe_clr_typedef(clr, rid, &type))
+			break;
+
+		const char *name = type.name != NULL ? type.name : "";
+		if (type.namespace_ == NULL || type.namespace_[0] == '\0') {
+			output(NULL, name);
+			continue;
+		}
+
+		const size_t size = strlen(type.namespace_) + 1 + strlen(name) + 1;
+		if (size > s_size) {
+			free(s);
+			s = malloc_s(size);
+			s_size = size;
+		}
+		snprintf(s, size, "%s.%s", type.namespace_, name);
+		output(NULL, s);
+	}
+
+	output_close_scope(); // Types
+	free(s);
+}
+
 int main(int argc, char *argv[])
 {
 	pev_config_t config;
@@ -890,7 +1469,7 @@ int main(int argc, char *argv[])
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	output_open_document();
+	output_open_document_with_name(ctx.path);
 
 	// dos header
 	if (options->dos || options->all_headers || options->all) {
@@ -949,6 +1528,73 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// export queries
+	if (options->export_names_count > 0 || options->export_ordinals_count > 0) {
+		if (directories != NULL)
+			print_export_queries(&ctx, options);
+		else if (!directories_warned) {
+			LIBPE_WARNING("directories not found");
+			directories_warned = true;
+		}
+	}
+
+	// import queries
+	if (options->import_queries_count > 0) {
+		if (directories != NULL)
+			print_import_queries(&ctx, options);
+		else if (!directories_warned) {
+			LIBPE_WARNING("directories not found");
+			directories_warned = true;
+		}
+	}
+
+	// base relocations
+	if (options->relocs || options->reloc_summary) {
+		if (directories == NULL) {
+			if (!directories_warned) {
+				LIBPE_WARNING("directories not found");
+				directories_warned = true;
+			}
+		} else {
+			if (options->relocs)
+				print_relocs(&ctx, options->reloc_entries);
+			if (options->reloc_summary)
+				print_reloc_summary(&ctx);
+		}
+	}
+
+	// file map
+	if (options->map || options->what_is_offsets_count > 0) {
+		pe_map_t map;
+		if (pe_map_build(&map, &ctx) < 0)
+			EXIT_ERROR("memory allocation failed");
+		if (options->map)
+			print_map(&map);
+		if (options->what_is_offsets_count > 0)
+			print_what_is(&map, options);
+		pe_map_destroy(&map);
+	}
+
+	// .NET CLR
+	if (options->clr || options->clr_refs || options->clr_types) {
+		pe_clr_t clr;
+		if (directories == NULL) {
+			if (!directories_warned) {
+				LIBPE_WARNING("directories not found");
+				directories_warned = true;
+			}
+		} else if (!pe_clr_init(&clr, &ctx)) {
+			LIBPE_WARNING("CLR header not found");
+		} else {
+			if (options->clr)
+				print_clr(&clr);
+			if (options->clr_refs)
+				print_clr_refs(&clr);
+			if (options->clr_types)
+				print_clr_types(&clr);
+		}
+	}
+
 	// sections
 	if (options->all_sections || options->all) {
 		if (pe_sections(&ctx) != NULL)
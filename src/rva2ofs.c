@@ -35,33 +35,49 @@
 */
 
 #include "common.h"
+#include "pe_addr.h"
 
 #define PROGRAM "rva2ofs"
 
+typedef struct {
+	bool va;
+	const char *input;
+} options_t;
+
+static options_t g_options;
+
 static void usage(void)
 {
-	printf("Usage: %s <rva> FILE\n"
+	printf("Usage: %s [OPTIONS] <rva> FILE\n"
+		"       %s [OPTIONS] -i <list> FILE\n"
 		"Convert RVA to raw file offset\n"
 		"\nExample: %s 0x12db cards.dll\n"
 		"\nOptions:\n"
+		" -i, --input <list>					 Convert the RVAs in <list>, one per line. Use - for stdin.\n"
+		"										 Output lines match input lines; invalid ones show as \"invalid\".\n"
+		" --va									 Input addresses are VAs instead of RVAs.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
-		PROGRAM, PROGRAM);
+		PROGRAM, PROGRAM, PROGRAM);
 }
 
 static void parse_options(int argc, char *argv[])
 {
 	/* Parameters for getopt_long() function */
-	static const char short_options[] = "V";
+	static const char short_options[] = "Vi:";
 
 	static const struct option long_options[] = {
-		{ "help",		no_argument,	NULL,  1  },
-		{ "version",	no_argument,	NULL, 'V' },
-		{  NULL,		0,				NULL,  0  }
+		{ "help",		no_argument,		NULL,  1  },
+		{ "input",		required_argument,	NULL, 'i' },
+		{ "va",			no_argument,		NULL,  2  },
+		{ "version",	no_argument,		NULL, 'V' },
+		{  NULL,		0,					NULL,  0  }
 	};
 
 	int c, ind;
 
+	memset(&g_options, 0, sizeof(g_options));
+
 	while ((c = getopt_long(argc, argv, short_options, long_options, &ind)))
 	{
 		if (c < 0)
@@ -72,6 +88,12 @@ static void parse_options(int argc, char *argv[])
 			case 1: // --help option
 				usage();
 				exit(EXIT_SUCCESS);
+			case 'i':
+				g_options.input = optarg;
+				break;
+			case 2: // --va option
+				g_options.va = true;
+				break;
 			case 'V':
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
@@ -82,30 +104,45 @@ static void parse_options(int argc, char *argv[])
 	}
 }
 
+static bool translate(const pe_addr_table_t *table, uint64_t rva, uint64_t *ofs)
+{
+	if (g_options.va) {
+		if (rva < table->image_base)
+			return false;
+		rva -= table->image_base;
+	}
+
+	if (!rva)
+		return false;
+
+	*ofs = pe_addr_rva2ofs(table, rva);
+	return true;
+}
+
+static size_t format_address(char *buffer, size_t size, uint64_t value)
+{
+	return output_format_int(buffer, size, value, OUTPUT_INT_HEX);
+}
+
 int main(int argc, char *argv[])
 {
 	//PEV_INITIALIZE();
 
-	if (argc != 3) {
+	parse_options(argc, argv); // opcoes
+
+	if (argc - optind != (g_options.input != NULL ? 1 : 2)) {
 		usage();
 		return EXIT_FAILURE;
 	}
 
-	parse_options(argc, argv); // opcoes
-
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, argv[2]);
+	pe_err_e err = pe_load_file(&ctx, argv[argc-1]);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
 	}
 
-	uint64_t rva = (uint64_t)strtoll(argv[1], NULL, 0);
-
-	if (!rva)
-		EXIT_ERROR("invalid RVA");
-
 	err = pe_parse(&ctx);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
@@ -115,11 +152,40 @@ int main(int argc, char *argv[])
 	if (!pe_is_pe(&ctx))
 		EXIT_ERROR("not a valid PE file");
 
-	printf("%#"PRIx64"\n", pe_rva2ofs(&ctx, rva));
+	// The table is sorted once, so that streams of RVAs don't scan the
+	// section table for each one.
+	pe_addr_table_t table;
+	if (pe_addr_table_init(&table, &ctx) < 0)
+		EXIT_ERROR("memory allocation failed");
+
+	int ret = EXIT_SUCCESS;
+
+	if (g_options.input != NULL) {
+		const bool use_stdin = strcmp(g_options.input, "-") == 0;
+		FILE *input = use_stdin ? stdin : fopen(g_options.input, "r");
+		if (input == NULL)
+			EXIT_ERROR("unable to open the input file");
+
+		size_t invalid_count;
+		if (pe_addr_translate_stream(&table, translate, format_address, input, stdout, &invalid_count) < 0)
+			EXIT_ERROR("unable to read the input file");
+		if (invalid_count > 0)
+			ret = EXIT_FAILURE;
+
+		if (!use_stdin)
+			fclose(input);
+	} else {
+		uint64_t ofs;
+		if (!translate(&table, (uint64_t)strtoll(argv[optind], NULL, 0), &ofs))
+			EXIT_ERROR(g_options.va ? "invalid VA" : "invalid RVA");
+
+		printf("%#"PRIx64"\n", ofs);
+	}
 
+	pe_addr_table_destroy(&table);
 	pe_unload(&ctx);
 
 	//PEV_FINALIZE();
 
-	return EXIT_SUCCESS;
+	return ret;
 }
@@ -7,7 +7,7 @@ TOOLS_DIR=$SRC_DIR/build
 TESTS_DIR=tests
 REPORTS_DIR=$TESTS_DIR/running_report
 EXPECTED_OUTPUTS_DIR=$TESTS_DIR/expected_outputs
-SUPPORTED_FORMATS="csv html json text xml"
+SUPPORTED_FORMATS="arrow cbor csv html json ndjson text xml"
 BINDIFF=$(which diff)
 
 now=$(date +"%F_%H-%M")
@@ -113,6 +113,45 @@ function test_binary_output_against_expected_output
 	fi
 }
 
+# Feeds `input` to the tool and checks its output and exit status.
+function test_binary_stdin
+{
+	local expected_status=$1; shift;
+	local expected_output=$1; shift;
+	local input=$1; shift;
+	local logname=$1; shift;
+	local binname=$1; shift;
+	local args=$*
+
+	echo -n "Testing ${binname} ${args} with ${logname} input... "
+	local output
+	output=$(printf "${input}" | $TOOLS_DIR/${binname} ${args})
+	local status=$?
+	if [ "${status}" -eq "${expected_status}" ] && [ "${output}" == "$(printf "${expected_output}")" ]
+	then
+		echo "OK"
+	else
+		echo "NOK"
+	fi
+}
+
+# Compares an output against the one written plainly. The command line,
+# which xml and html output, is left out as it differs.
+function test_same_output
+{
+	local logname=$1; shift;
+	local expected=$1; shift;
+	local actual=$1; shift;
+
+	echo -n "Comparing ${logname} output against \"${expected}\"... "
+	if cmp -s <(sed -e '/cmdline=/d' -e '/<title>/d' "${expected}") <(sed -e '/cmdline=/d' -e '/<title>/d' "${actual}")
+	then
+		echo "OK"
+	else
+		echo "NOK"
+	fi
+}
+
 function run_pepack
 {
 	local binname=pepack
@@ -131,6 +170,7 @@ function run_pehash
 	test_binary_using_all_formats "echo OK" "echo NOK" "a_sha512"           ${binname} -a sha512 ${args}
 	test_binary_using_all_formats "echo OK" "echo NOK" "s_text"             ${binname} -s '.text' ${args}
 	test_binary_using_all_formats "echo OK" "echo NOK" "section_index_1"    ${binname} --section-index 1 ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "fields"             ${binname} --fields sha256,imphash ${args}
 }
 
 function run_pescan
@@ -140,6 +180,7 @@ function run_pescan
 	echo "---------- ${binname} ----------"
 	test_binary_using_all_formats "echo OK" "echo NOK" "default"    ${binname} ${args}
 	test_binary_using_all_formats "echo OK" "echo NOK" "v"          ${binname} -v ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "fields"     ${binname} --fields "file entropy,TLS directory" ${args}
 }
 
 function run_pestr
@@ -196,6 +237,164 @@ function run_pesec
 	test_binary_using_all_formats pesec_on_success  "echo NOK" "o_tmp_cert" ${binname} -o tmp_cert ${args}
 }
 
+function run_peldd
+{
+	local binname=peldd
+	local binsample=$1
+	# DLLs are looked up next to the sample, unless a directory is given.
+	local dlldir=${2:-$(dirname ${binsample})}
+	# No DLL can be found in an empty directory.
+	local emptydir=$REPORTS_DIR/${binname}/empty
+	mkdir -p ${emptydir}
+	echo "---------- ${binname} ----------"
+	test_binary_using_all_formats "echo OK" "echo NOK" "default"    ${binname} ${binsample}
+	test_binary_using_all_formats "echo OK" "echo NOK" "r"          ${binname} -r -s ${dlldir} ${binsample}
+	test_binary_using_all_formats "echo OK" "echo NOK" "r_flat"     ${binname} -r --flat -s ${dlldir} ${binsample}
+	test_binary_using_all_formats "echo OK" "echo NOK" "r_j1"       ${binname} -r -j 1 -s ${dlldir} ${binsample}
+	test_binary_using_all_formats "echo OK" "echo NOK" "r_missing"  ${binname} -r -s ${emptydir} ${binsample}
+	# With a Windows system directory, kernel32.dll forwards exports to
+	# ntdll.dll, so verifying imports also follows forwarders.
+	test_binary_using_all_formats "echo OK" "echo NOK" "verify"     ${binname} --verify -s ${dlldir} ${binsample}
+	test_binary_using_all_formats "echo OK" "echo NOK" "verify_missing" ${binname} --verify -s ${emptydir} ${binsample}
+}
+
+# Translations are checked by converting back, so any sample with a section
+# at RVA 0x1000 will do.
+function run_rva2ofs
+{
+	local binname=rva2ofs
+	local binsample=$1
+	local list=$REPORTS_DIR/${binname}/list.txt
+	mkdir -p $REPORTS_DIR/${binname}
+	echo "---------- ${binname} ----------"
+	test_binary "echo OK" "echo NOK" "default"  ${binname} 0x1000 ${binsample}
+
+	local ofs=$($TOOLS_DIR/${binname} 0x1000 ${binsample})
+	local va=$($TOOLS_DIR/ofs2rva --va ${ofs} ${binsample})
+	test_binary_stdin 0 "${ofs}"             "${va}\n"                "va"       ${binname} --va -i - ${binsample}
+	test_binary_stdin 0 "${ofs}\n\n${ofs}"   "0x1000\n\n4096\n"       "stdin"    ${binname} -i - ${binsample}
+	test_binary_stdin 1 "${ofs}\ninvalid"    "0x1000\nnot-an-rva\n"   "invalid"  ${binname} -i - ${binsample}
+
+	printf "0x1000\n\n4096\n" > ${list}
+	test_binary_stdin 0 "${ofs}\n\n${ofs}"   ""                       "file"     ${binname} -i ${list} ${binsample}
+}
+
+function run_ofs2rva
+{
+	local binname=ofs2rva
+	local binsample=$1
+	local list=$REPORTS_DIR/${binname}/list.txt
+	mkdir -p $REPORTS_DIR/${binname}
+	echo "---------- ${binname} ----------"
+
+	local ofs=$($TOOLS_DIR/rva2ofs 0x1000 ${binsample})
+	test_binary "echo OK" "echo NOK" "default"  ${binname} ${ofs} ${binsample}
+
+	local va=$($TOOLS_DIR/${binname} --va ${ofs} ${binsample})
+	test_binary_stdin 0 "${va}"              "${ofs}\n"               "va"       ${binname} --va -i - ${binsample}
+	test_binary_stdin 0 "0x1000\n\n0x1000"   "${ofs}\n\n${ofs}\n"     "stdin"    ${binname} -i - ${binsample}
+	test_binary_stdin 1 "0x1000\ninvalid"    "${ofs}\n0x\n"           "invalid"  ${binname} -i - ${binsample}
+
+	printf "${ofs}\n\n${ofs}\n" > ${list}
+	test_binary_stdin 0 "0x1000\n\n0x1000"   ""                       "file"     ${binname} -i ${list} ${binsample}
+}
+
+# The output must decompress to exactly what is written without --compress.
+function run_compress
+{
+	local binname=readpe
+	local binsample=$1
+	local dir=$REPORTS_DIR/${binname}/compress
+	mkdir -p ${dir}
+	echo "---------- ${binname} --compress ----------"
+
+	if ! $TOOLS_DIR/${binname} --compress gzip -H ${binsample} > /dev/null 2>&1
+	then
+		echo "gzip compression not built in, skipping"
+		return
+	fi
+
+	for format in $SUPPORTED_FORMATS
+	do
+		$TOOLS_DIR/${binname} -f ${format} -S -i -e ${binsample} > ${dir}/${format}.txt
+		$TOOLS_DIR/${binname} --compress gzip -f ${format} -S -i -e ${binsample} | gzip -dc > ${dir}/${format}_gzip.txt
+		test_same_output "${format} gzip" ${dir}/${format}.txt ${dir}/${format}_gzip.txt
+	done
+}
+
+# The rows written to the database must match what the text output shows, and
+# a second run must add to the same database instead of replacing it.
+function run_sqlite
+{
+	local binname=readpe
+	local binsample=$1
+	local dir=$REPORTS_DIR/${binname}/sqlite
+	local db=${dir}/${binname}.db
+	mkdir -p ${dir}
+	echo "---------- ${binname} -f sqlite ----------"
+
+	if ! $TOOLS_DIR/${binname} --help 2>&1 | grep -q 'sqlite'
+	then
+		echo "sqlite format not built in, skipping"
+		return
+	fi
+	if ! which sqlite3 > /dev/null 2>&1
+	then
+		echo "sqlite3 not found, skipping"
+		return
+	fi
+
+	rm -f ${db} ${db}-wal ${db}-shm
+	test_binary "echo OK" "echo NOK" "sqlite" ${binname} -f sqlite:db=${db} -S -i ${binsample}
+	test_binary "echo OK" "echo NOK" "sqlite_append" ${binname} -f sqlite:db=${db} -S -i ${binsample}
+
+	$TOOLS_DIR/${binname} -S ${binsample} | sed -n 's/^ *Name: *//p' > ${dir}/sections.txt
+	sqlite3 ${db} "SELECT name FROM sections WHERE file_id = 1 ORDER BY rowid;" > ${dir}/sections_db.txt
+	test_same_output "sqlite sections" ${dir}/sections.txt ${dir}/sections_db.txt
+
+	$TOOLS_DIR/${binname} -i ${binsample} | grep -c '^ *Function$' > ${dir}/imports.txt
+	sqlite3 ${db} "SELECT count(*) FROM imports WHERE file_id = 1;" > ${dir}/imports_db.txt
+	test_same_output "sqlite imports" ${dir}/imports.txt ${dir}/imports_db.txt
+
+	echo 2 > ${dir}/files.txt
+	sqlite3 ${db} "SELECT count(*) FROM files;" > ${dir}/files_db.txt
+	test_same_output "sqlite files" ${dir}/files.txt ${dir}/files_db.txt
+}
+
+# Writing from a separate thread must not change the output. The tool runs
+# from directories whose pev.conf turns it off and on, keeping the other
+# settings of the current one.
+function run_async
+{
+	local binname=readpe
+	local binsample=$(cd $(dirname $1) && pwd)/$(basename $1)
+	local tool=$(cd $TOOLS_DIR && pwd)/${binname}
+	local dir=$REPORTS_DIR/${binname}/async
+	mkdir -p ${dir}
+	dir=$(cd ${dir} && pwd)
+	echo "---------- ${binname} output_async=yes ----------"
+
+	mkdir -p ${dir}/sync
+	{ grep -v '^[[:space:]]*output_async' pev.conf 2> /dev/null; echo "output_async=no"; } > ${dir}/sync/pev.conf
+	{ grep -v '^[[:space:]]*output_async' pev.conf 2> /dev/null; echo "output_async=yes"; } > ${dir}/pev.conf
+
+	local with_gzip=false
+	${tool} --compress gzip -H ${binsample} > /dev/null 2>&1 && with_gzip=true
+
+	for format in $SUPPORTED_FORMATS
+	do
+		(cd ${dir}/sync && ${tool} -f ${format} -S -i -e ${binsample}) > ${dir}/${format}.txt
+		(cd ${dir} && ${tool} -f ${format} -S -i -e ${binsample}) > ${dir}/${format}_async.txt
+		test_same_output "${format} async" ${dir}/${format}.txt ${dir}/${format}_async.txt
+
+		if ${with_gzip}
+		then
+			(cd ${dir} && ${tool} --compress gzip -f ${format} -S -i -e ${binsample}) | gzip -dc > ${dir}/${format}_async_gzip.txt
+			test_same_output "${format} async gzip" ${dir}/${format}.txt ${dir}/${format}_async_gzip.txt
+		fi
+	done
+}
+
 function run_readpe
 {
 	local binname=readpe
@@ -208,6 +407,14 @@ function run_readpe
 	test_binary_using_all_formats "echo OK" "echo NOK" "h_dos"      ${binname} -h dos ${args}
 	test_binary_using_all_formats "echo OK" "echo NOK" "i"          ${binname} -i ${args}
 	test_binary_using_all_formats "echo OK" "echo NOK" "e"          ${binname} -e ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "export"     ${binname} --export DllMain --ordinal 1 ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "import"     ${binname} --import kernel32.dll!ExitProcess ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "clr"        ${binname} --clr --clr-refs --clr-types ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "sinks"      ${binname} -f json:/dev/null ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "r"          ${binname} -r ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "reloc"      ${binname} --reloc-entries --reloc-summary ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "map"        ${binname} --map --what-is 0 --what-is 0x400 ${args}
+	test_binary_using_all_formats "echo OK" "echo NOK" "output_fd"  ${binname} --output-fd 2 ${args}
 }
 
 function test_regression
@@ -246,6 +453,12 @@ function test_regression
 	test_binary_output_against_expected_output "echo OK" "echo NOK" "h_dos"             readpe ${binsample} -h dos
 	test_binary_output_against_expected_output "echo OK" "echo NOK" "i"                 readpe ${binsample} -i
 	test_binary_output_against_expected_output "echo OK" "echo NOK" "e"                 readpe ${binsample} -e
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "export"            readpe ${binsample} --export DllMain --ordinal 1
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "import"            readpe ${binsample} --import kernel32.dll!ExitProcess
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "clr"               readpe ${binsample} --clr --clr-refs --clr-types
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "r"                 readpe ${binsample} -r
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "reloc"             readpe ${binsample} --reloc-entries --reloc-summary
+	test_binary_output_against_expected_output "echo OK" "echo NOK" "map"               readpe ${binsample} --map --what-is 0 --what-is 0x400
 }
 
 function test_pe32
@@ -261,12 +474,19 @@ function test_pe32
 	run_peres $1
 	run_pestr $1
 	run_pesec $1
+	run_peldd $1 $2
+	run_rva2ofs $1
+	run_ofs2rva $1
 	run_readpe $1
+	run_compress $1
+	run_async $1
+	run_sqlite $1
 }   
 
 function test_pe64
 {
-	echo 'coming soon...'
+	# The tools read PE32+ files the same way.
+	test_pe32 $1 $2
 }
 
 function clean
@@ -285,15 +505,21 @@ case "$1" in
 	"build")
 		test_build ;;
 	"pe32")
-		if [ $# -ne 2 ]
+		if [ $# -lt 2 ]
 		then
-			echo "missing argument: use $0 pe32 <binary file>"
+			echo "missing argument: use $0 pe32 <binary file> [<dll dir>]"
 		else
-			test_pe32 $2
+			test_pe32 $2 $3
 		fi
 		;;
 	"pe64")
-		test_pe64 ;;
+		if [ $# -lt 2 ]
+		then
+			echo "missing argument: use $0 pe64 <binary file> [<dll dir>]"
+		else
+			test_pe64 $2 $3
+		fi
+		;;
 	"regression")
 		if [ $# -ne 2 ]
 		then
@@ -307,8 +533,8 @@ case "$1" in
 		echo "usage: run.sh <option>"
 		echo "       run.sh clean"
 		echo "       run.sh build"
-		echo "       run.sh pe32 <binary_file_for_testing>"
-		echo "       run.sh pe64 <binary_file_to_testing>"
+		echo "       run.sh pe32 <binary_file_for_testing> [<dll_dir_for_peldd>]"
+		echo "       run.sh pe64 <binary_file_for_testing> [<dll_dir_for_peldd>]"
 		echo "       run.sh regression <binary_file_for_testing>"
 		exit 1 ;;
 esac